@@ -0,0 +1,252 @@
+// Arrow
+
+#ifndef FMC_AUGMENT_HPP
+#define FMC_AUGMENT_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <span>
+#include <vector>
+
+#include "dataset.hpp"
+#include "kernel.hpp"
+#include "utils.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief random transformations of the training images, drawn again for every sample of
+   *        every epoch; all off by default
+   */
+  struct augmentation {
+    int max_shift = 0;       // pixels, either way along both axes
+    bool flip = false;       // mirrors half of the images horizontally
+    double max_rotation = 0; // degrees, either way, around the center
+    double max_scale = 0;    // relative zoom either way, e.g. 0.1 for 90% to 110%
+    int cutout = 0;          // side of a square blacked out at a random position
+
+    bool enabled () const;
+  };
+
+  inline bool augmentation::enabled () const {
+    return max_shift > 0 or flip or max_rotation > 0 or max_scale > 0 or cutout > 0;
+  }
+
+  namespace augment {
+
+    /**
+     * @brief the transformation drawn for one sample
+     */
+    struct transform {
+      int shift_x = 0;
+      int shift_y = 0;
+      bool flip = false;
+      double angle = 0;
+      double scale = 1;
+      int cutout_x = 0;
+      int cutout_y = 0;
+      int cutout = 0;
+    };
+
+    inline transform draw (const augmentation& settings, int height, int width, random::splitmix& generator) {
+      transform result;
+
+      if (settings.max_shift > 0) {
+        result.shift_x = generator.symmetric(settings.max_shift);
+        result.shift_y = generator.symmetric(settings.max_shift);
+      }
+      if (settings.flip)
+        result.flip = generator.next() & 1;
+      if (settings.max_rotation > 0)
+        result.angle = (2 * generator.canonical() - 1) * settings.max_rotation * std::numbers::pi / 180;
+      if (settings.max_scale > 0)
+        result.scale = 1 + (2 * generator.canonical() - 1) * settings.max_scale;
+      if (settings.cutout > 0) {
+        result.cutout = settings.cutout;
+        result.cutout_x = (int)(generator.next() % width) - settings.cutout / 2;
+        result.cutout_y = (int)(generator.next() % height) - settings.cutout / 2;
+      }
+
+      return result;
+    }
+
+    /**
+     * @brief out(x, y) = in(x - shift_x, y - shift_y), with `in` mirrored first if `flip`, and
+     *        black where that falls outside of `in`
+     *
+     * Every row is a single copy (reversed when flipping) between two fills, so the loops
+     * vectorize.
+     */
+    inline void shift_flip (const std::uint8_t* __restrict in, std::uint8_t* __restrict out, int height, int width,
+                            int shift_x, int shift_y, bool flip) {
+      const int first = std::clamp(shift_x, 0, width);
+      const int last = std::clamp(width + shift_x, 0, width);
+
+      for (int y = 0; y < height; ++y) {
+        std::uint8_t* row = out + y * width;
+        const int source_y = y - shift_y;
+
+        if (source_y < 0 or source_y >= height or first >= last) {
+          std::fill(row, row + width, 0);
+          continue;
+        }
+
+        const std::uint8_t* source = in + source_y * width;
+        std::fill(row, row + first, 0);
+        std::fill(row + last, row + width, 0);
+
+        if (flip)
+          for (int x = first; x < last; ++x)
+            row[x] = source[width - 1 - (x - shift_x)];
+        else
+          std::copy(source + first - shift_x, source + last - shift_x, row + first);
+      }
+    }
+
+    /**
+     * @brief Applies the whole affine map of `t` (rotation and zoom around the center, then
+     *        shift, with the mirror image of `in` if `t.flip`) by bilinear interpolation
+     *
+     * The source position of an output pixel moves by a constant step along a row, so it is
+     * carried in 16.16 fixed point and advanced with two integer additions per pixel; the
+     * interpolation weights are 8-bit.
+     */
+    inline void warp (const std::uint8_t* __restrict in, std::uint8_t* __restrict out, int height, int width,
+                      const transform& t) {
+      const double center_x = (width - 1) / 2.0;
+      const double center_y = (height - 1) / 2.0;
+      const double cos_a = std::cos(t.angle) / t.scale;
+      const double sin_a = std::sin(t.angle) / t.scale;
+      const double mirror = t.flip ? -1 : 1;
+      const double unit = 65536;
+
+      // source = inverse rotation and zoom of (output - center - shift), mirrored, + center
+      const std::int32_t step_x = std::lround(mirror * cos_a * unit);
+      const std::int32_t step_y = std::lround(-sin_a * unit);
+
+      auto pixel = [&] (int x, int y) -> std::int32_t {
+        return x < 0 or x >= width or y < 0 or y >= height ? 0 : in[y * width + x];
+      };
+
+      for (int y = 0; y < height; ++y) {
+        const double u = -center_x - t.shift_x;
+        const double v = y - center_y - t.shift_y;
+        std::int32_t source_x = std::lround((mirror * (cos_a * u + sin_a * v) + center_x) * unit);
+        std::int32_t source_y = std::lround((-sin_a * u + cos_a * v + center_y) * unit);
+
+        for (int x = 0; x < width; ++x, source_x += step_x, source_y += step_y) {
+          const int x0 = source_x >> 16;
+          const int y0 = source_y >> 16;
+          const std::int32_t wx = (source_x >> 8) & 0xff;
+          const std::int32_t wy = (source_y >> 8) & 0xff;
+
+          const std::int32_t top = pixel(x0, y0) * (256 - wx) + pixel(x0 + 1, y0) * wx;
+          const std::int32_t bottom = pixel(x0, y0 + 1) * (256 - wx) + pixel(x0 + 1, y0 + 1) * wx;
+          out[y * width + x] = (top * (256 - wy) + bottom * wy + 32768) >> 16;
+        }
+      }
+    }
+
+    // Blacks out the `size` x `size` square with its top left corner at (x, y), clipped to the image
+    inline void cut (std::uint8_t* image, int height, int width, int x, int y, int size) {
+      const int left = std::max(x, 0);
+      const int right = std::min(x + size, width);
+
+      for (int row = std::max(y, 0); row < std::min(y + size, height) and left < right; ++row)
+        std::fill(image + row * width + left, image + row * width + right, 0);
+    }
+
+    /**
+     * @brief Writes `in` transformed by `t` to `out`. Shifts and flips alone take the copying
+     *        path; rotations and zooms need the interpolating one.
+     */
+    inline void apply (const std::uint8_t* in, std::uint8_t* out, int height, int width, const transform& t) {
+      if (t.angle == 0 and t.scale == 1)
+        shift_flip(in, out, height, width, t.shift_x, t.shift_y, t.flip);
+      else
+        warp(in, out, height, width, t);
+
+      if (t.cutout > 0)
+        cut(out, height, width, t.cutout_x, t.cutout_y, t.cutout);
+    }
+
+  } // namespace augment
+
+  /**
+   * @brief widens samples into a batch through the augmentations of an epoch
+   *
+   * The transformation of a sample is drawn from a generator seeded with the seed, the epoch
+   * and the index of the sample alone, so it does not depend on the batch the sample lands
+   * in or the thread that assembles it. Every thread assembling batches needs an augmenter of
+   * its own, since the images are transformed in a scratch buffer before they are widened.
+   */
+  class augmenter {
+    private:
+      augmentation settings;
+      std::uint64_t seed;
+      std::vector <std::uint8_t> scratch;
+
+    public:
+      augmenter (const augmentation&, std::uint64_t);
+
+      template <typename T> void widen (const dataset&, std::span <const int>, int, T*);
+      template <typename T> void widen (const dataset&, std::span <const std::uint64_t>, int, T*);
+
+    private:
+      template <typename T> void transform (std::span <const std::uint8_t>, std::uint64_t, int, int, int, double, T*);
+  };
+
+  inline augmenter::augmenter (const augmentation& settings, std::uint64_t seed)
+    : settings (settings),
+      seed (seed)
+  { }
+
+  /**
+   * @brief Like dataset::widen, with every sample transformed as drawn for `epoch`
+   */
+  template <typename T>
+  void augmenter::widen (const dataset& data, std::span <const int> indices, int epoch, T* out) {
+    if (not settings.enabled()) {
+      data.widen(indices, out);
+      return;
+    }
+
+    for (std::size_t r = 0; r < indices.size(); ++r)
+      transform(data.sample(indices[r]), indices[r], epoch, data.get_height(), data.get_width(), data.get_scale(),
+                out + r * data.get_sample_size());
+  }
+
+  /**
+   * @brief Widens the first `identities.size()` samples of `data`, in order, each transformed
+   *        as drawn for the sample `identities[r]` of the whole set, e.g. a batch read from a
+   *        shard_stream
+   */
+  template <typename T>
+  void augmenter::widen (const dataset& data, std::span <const std::uint64_t> identities, int epoch, T* out) {
+    if (not settings.enabled()) {
+      data.widen(0, identities.size(), out);
+      return;
+    }
+
+    for (std::size_t r = 0; r < identities.size(); ++r)
+      transform(data.sample(r), identities[r], epoch, data.get_height(), data.get_width(), data.get_scale(),
+                out + r * data.get_sample_size());
+  }
+
+  template <typename T>
+  void augmenter::transform (std::span <const std::uint8_t> sample, std::uint64_t index, int epoch, int height,
+                             int width, double scale, T* out) {
+    const std::uint64_t key = (std::uint64_t)epoch << 32 | (std::uint32_t)index;
+    random::splitmix generator (random::splitmix::mix(seed ^ random::splitmix::mix(key)));
+
+    scratch.resize(sample.size());
+    augment::apply(sample.data(), scratch.data(), height, width, augment::draw(settings, height, width, generator));
+    kernel::widen(scratch.data(), out, sample.size(), (T)scale);
+  }
+
+} // namespace fmc
+
+#endif // FMC_AUGMENT_HPP
@@ -0,0 +1,362 @@
+// Arrow
+
+#ifndef FMC_BATCHING_SERVER_HPP
+#define FMC_BATCHING_SERVER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iosfwd>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "inference.hpp"
+#include "matrix.hpp"
+#include "queue.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief lock-free histogram of latencies in microseconds
+   *
+   * Values below 16 get a bucket each, larger values share one of 8 buckets per power of two,
+   * which keeps percentiles within 12.5% of the true value at any scale.
+   */
+  class latency_histogram {
+    private:
+      static const int linear_buckets = 16;
+      static const int sub_buckets = 8;
+      static const int bucket_count = linear_buckets + (64 - 4) * sub_buckets;
+
+      std::array <std::atomic <std::uint64_t>, bucket_count> buckets {};
+
+    public:
+      void          record     (std::uint64_t);
+      std::uint64_t count      () const;
+      double        percentile (double) const;
+
+    private:
+      static int           bucket_of   (std::uint64_t);
+      static std::uint64_t lower_bound (int);
+  };
+
+  inline void latency_histogram::record (std::uint64_t microseconds) {
+    buckets[bucket_of(microseconds)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  inline std::uint64_t latency_histogram::count () const {
+    std::uint64_t total = 0;
+    for (const auto& bucket : buckets)
+      total += bucket.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  /**
+   * @brief Approximates the `p`-th percentile (0 < p <= 100) of the recorded latencies
+   */
+  inline double latency_histogram::percentile (double p) const {
+    std::array <std::uint64_t, bucket_count> snapshot;
+    std::uint64_t total = 0;
+
+    for (int i = 0; i < bucket_count; ++i)
+      total += snapshot[i] = buckets[i].load(std::memory_order_relaxed);
+    if (total == 0)
+      return 0;
+
+    std::uint64_t rank = std::max <std::uint64_t> (1, (std::uint64_t)(p / 100 * total + 0.5));
+    std::uint64_t seen = 0;
+
+    for (int i = 0; i < bucket_count; ++i) {
+      seen += snapshot[i];
+      if (seen >= rank)
+        return i + 1 < bucket_count ? (lower_bound(i) + lower_bound(i + 1)) / 2.0 : lower_bound(i);
+    }
+    return lower_bound(bucket_count - 1);
+  }
+
+  inline int latency_histogram::bucket_of (std::uint64_t value) {
+    if (value < linear_buckets)
+      return value;
+    int exponent = std::bit_width(value) - 1;
+    int sub = (value >> (exponent - 3)) & (sub_buckets - 1);
+    return linear_buckets + (exponent - 4) * sub_buckets + sub;
+  }
+
+  inline std::uint64_t latency_histogram::lower_bound (int bucket) {
+    if (bucket < linear_buckets)
+      return bucket;
+    int exponent = (bucket - linear_buckets) / sub_buckets + 4;
+    int sub = (bucket - linear_buckets) % sub_buckets;
+    return (std::uint64_t(1) << exponent) + ((std::uint64_t)sub << (exponent - 3));
+  }
+
+  /**
+   * @brief point-in-time view of the counters of a batching_server
+   */
+  struct batching_metrics {
+    std::size_t queue_depth = 0;
+    std::uint64_t completed = 0;
+    std::uint64_t batches = 0;
+    std::vector <std::uint64_t> batch_sizes;
+    double mean_batch_size = 0;
+    double p50_latency_us = 0;
+    double p99_latency_us = 0;
+  };
+
+  /**
+   * @brief result of a single request to a batching_server
+   */
+  template <typename T>
+  struct prediction {
+    int label = -1;
+    std::vector <T> probabilities;
+  };
+
+  /**
+   * @brief in-process inference server that coalesces concurrent requests into batches
+   *
+   * Any number of threads submit single inputs and receive a future. Worker threads drain
+   * the shared lock-free queue into batches of at most `max_batch` requests, waiting at most
+   * `max_wait_us` after the oldest request of a batch arrived, and run one batched forward
+   * pass over the frozen model for the whole batch.
+   *
+   * @tparam T type of the weights and activations
+   */
+  template <typename T>
+  class batching_server {
+    public:
+      struct options {
+        int max_batch = 32;
+        int max_wait_us = 200;
+        int worker_count = 1;
+        std::size_t queue_capacity = 4096;
+      };
+
+    private:
+      using clock = std::chrono::steady_clock;
+
+      struct request {
+        std::vector <T> input;
+        std::promise <prediction <T>> result;
+        clock::time_point enqueued;
+      };
+
+      const inference_model <T> model;
+      const options settings;
+      mpmc_queue <request*> queue;
+      std::atomic <std::size_t> depth;
+      std::atomic <bool> running;
+      std::vector <std::thread> workers;
+
+      std::vector <std::atomic <std::uint64_t>> batch_sizes;
+      std::atomic <std::uint64_t> batches;
+      latency_histogram latencies;
+
+    public:
+      batching_server (inference_model <T>, options = options());
+      ~batching_server ();
+
+      batching_server (const batching_server&) = delete;
+      batching_server& operator = (const batching_server&) = delete;
+
+      batching_metrics             metrics () const;
+      void                         stop    ();
+      std::future <prediction <T>> submit  (std::vector <T>);
+      std::future <prediction <T>> submit  (const matrix <T>&);
+
+    private:
+      void run     ();
+      void process (std::vector <request*>&, typename inference_model <T>::scratch&, std::vector <T>&, std::vector <T>&);
+  };
+
+  template <typename T>
+  batching_server <T>::batching_server (inference_model <T> model, options settings)
+    : model (std::move(model)),
+      settings (settings),
+      queue (std::bit_ceil(std::max <std::size_t> (2, settings.queue_capacity))),
+      depth (0),
+      running (true),
+      batch_sizes (settings.max_batch + 1),
+      batches (0) {
+    if (settings.max_batch < 1 or settings.worker_count < 1 or settings.max_wait_us < 0)
+      throw std::runtime_error("invalid batching server options");
+
+    for (int i = 0; i < settings.worker_count; ++i)
+      workers.emplace_back(&batching_server::run, this);
+  }
+
+  template <typename T>
+  batching_server <T>::~batching_server () {
+    stop();
+  }
+
+  template <typename T>
+  batching_metrics batching_server <T>::metrics () const {
+    batching_metrics result;
+
+    result.queue_depth = depth.load(std::memory_order_relaxed);
+    result.batches = batches.load(std::memory_order_relaxed);
+    result.batch_sizes.resize(batch_sizes.size());
+
+    for (std::size_t i = 0; i < batch_sizes.size(); ++i) {
+      result.batch_sizes[i] = batch_sizes[i].load(std::memory_order_relaxed);
+      result.completed += result.batch_sizes[i] * i;
+    }
+
+    result.mean_batch_size = result.batches == 0 ? 0 : (double)result.completed / result.batches;
+    result.p50_latency_us = latencies.percentile(50);
+    result.p99_latency_us = latencies.percentile(99);
+
+    return result;
+  }
+
+  /**
+   * @brief Stops accepting requests, completes every request already queued and joins
+   *        the workers. Called by the destructor; must not race with submit.
+   */
+  template <typename T>
+  void batching_server <T>::stop () {
+    if (not running.exchange(false))
+      return;
+
+    // idle workers sleep until `depth` changes, so bump it once to let them observe the stop,
+    // and take it back once they are gone so that metrics count only queued requests
+    depth.fetch_add(1);
+    depth.notify_all();
+
+    for (auto& worker : workers)
+      worker.join();
+    workers.clear();
+
+    depth.fetch_sub(1);
+  }
+
+  /**
+   * @brief Queues one (1 x input_size) input for prediction
+   *
+   * Blocks only while the queue is full.
+   *
+   * @return std::future <prediction <T>> label and output activations of the input
+   */
+  template <typename T>
+  std::future <prediction <T>> batching_server <T>::submit (std::vector <T> input) {
+    if ((int)input.size() != model.get_input_size())
+      throw std::runtime_error("input size does not match the model input size");
+    if (not running.load(std::memory_order_relaxed))
+      throw std::runtime_error("batching server is stopped");
+
+    request* r = new request {std::move(input), {}, clock::now()};
+    std::future <prediction <T>> future = r->result.get_future();
+
+    // counted before the push so that a worker never decrements a request it has not seen counted
+    depth.fetch_add(1, std::memory_order_relaxed);
+
+    while (not queue.try_push(std::move(r)))
+      std::this_thread::yield();
+
+    depth.notify_one();
+
+    return future;
+  }
+
+  template <typename T>
+  std::future <prediction <T>> batching_server <T>::submit (const matrix <T>& input) {
+    return submit(std::vector <T> (input.data(), input.data() + input.get_cols()));
+  }
+
+  template <typename T>
+  void batching_server <T>::run () {
+    auto buffer = model.make_scratch(settings.max_batch);
+    std::vector <request*> batch;
+    std::vector <T> inputs ((std::size_t)settings.max_batch * model.get_input_size());
+    std::vector <T> outputs ((std::size_t)settings.max_batch * model.get_output_size());
+    const auto max_wait = std::chrono::microseconds (settings.max_wait_us);
+
+    batch.reserve(settings.max_batch);
+
+    for (;;) {
+      request* r;
+
+      if (not queue.try_pop(r)) {
+        if (not running.load(std::memory_order_acquire) and queue.size() == 0)
+          return;
+        depth.wait(0, std::memory_order_acquire);
+        continue;
+      }
+
+      batch.push_back(r);
+      depth.fetch_sub(1, std::memory_order_relaxed);
+
+      const clock::time_point deadline = r->enqueued + max_wait;
+
+      while ((int)batch.size() < settings.max_batch) {
+        if (queue.try_pop(r)) {
+          batch.push_back(r);
+          depth.fetch_sub(1, std::memory_order_relaxed);
+        }
+        else if (clock::now() >= deadline or not running.load(std::memory_order_relaxed))
+          break;
+        else
+          std::this_thread::yield();
+      }
+
+      process(batch, buffer, inputs, outputs);
+      batch.clear();
+    }
+  }
+
+  template <typename T>
+  void batching_server <T>::process (std::vector <request*>& batch, typename inference_model <T>::scratch& buffer,
+                                     std::vector <T>& inputs, std::vector <T>& outputs) {
+    const int input_size = model.get_input_size();
+    const int output_size = model.get_output_size();
+    const int rows = batch.size();
+
+    for (int i = 0; i < rows; ++i)
+      std::copy(batch[i]->input.begin(), batch[i]->input.end(), inputs.begin() + (std::size_t)i * input_size);
+
+    model.predict_proba_batch(std::span <const T> (inputs.data(), (std::size_t)rows * input_size), outputs, buffer);
+
+    // metrics are updated before any future is completed so that callers never observe a
+    // result that the counters do not account for yet
+    const clock::time_point now = clock::now();
+
+    for (int i = 0; i < rows; ++i)
+      latencies.record(std::chrono::duration_cast <std::chrono::microseconds> (now - batch[i]->enqueued).count());
+    batch_sizes[rows].fetch_add(1, std::memory_order_relaxed);
+    batches.fetch_add(1, std::memory_order_relaxed);
+
+    for (int i = 0; i < rows; ++i) {
+      const T* row = outputs.data() + (std::size_t)i * output_size;
+      prediction <T> p;
+
+      p.label = std::max_element(row, row + output_size) - row;
+      p.probabilities.assign(row, row + output_size);
+      batch[i]->result.set_value(std::move(p));
+      delete batch[i];
+    }
+  }
+
+  /**
+   * @brief Operator << overload to insert a one-line summary of batching_metrics into
+   *        a std::ostream object
+   */
+  inline std::ostream& operator << (std::ostream& stream, const batching_metrics& metrics) {
+    stream << "queue_depth=" << metrics.queue_depth
+           << " completed=" << metrics.completed
+           << " batches=" << metrics.batches
+           << " mean_batch=" << metrics.mean_batch_size
+           << " p50_us=" << metrics.p50_latency_us
+           << " p99_us=" << metrics.p99_latency_us;
+    return stream;
+  }
+
+} // namespace fmc
+
+#endif // FMC_BATCHING_SERVER_HPP
@@ -0,0 +1,179 @@
+// Arrow
+
+#ifndef FMC_CACHE_HPP
+#define FMC_CACHE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "dataset.hpp"
+#include "mapped_file.hpp"
+
+namespace fmc {
+
+  namespace cache {
+
+    /**
+     * @brief first bytes of a .fmcd file, followed by `count` 32-bit labels and the
+     *        (count x height x width) pixels of the dataset
+     *
+     * The size, modification time and hash of the file the dataset was parsed from tell
+     * whether the cache still matches it.
+     */
+    struct header {
+      char magic[4];
+      std::uint32_t version;
+      std::uint32_t dtype;
+      std::uint32_t height;
+      std::uint32_t width;
+      std::uint32_t reserved;
+      std::uint64_t count;
+      double scale;
+      std::uint64_t source_size;
+      std::int64_t source_mtime;
+      std::uint64_t source_hash;
+    };
+
+    const char magic[4] = {'F', 'M', 'C', 'D'};
+    const std::uint32_t version = 1;
+
+    // values of header::dtype
+    const std::uint32_t uint8 = 1;
+
+    /**
+     * @brief 64-bit FNV-1a over the bytes of a file, eight at a time so that hashing a
+     *        source keeps up with reading it
+     */
+    inline std::uint64_t hash (std::span <const std::uint8_t> bytes) {
+      const std::uint64_t prime = 0x100000001b3;
+      std::uint64_t result = 0xcbf29ce484222325;
+      std::size_t i = 0;
+
+      for (; i + 8 <= bytes.size(); i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes.data() + i, 8);
+        result = (result ^ word) * prime;
+      }
+      for (; i < bytes.size(); ++i)
+        result = (result ^ bytes[i]) * prime;
+
+      return result;
+    }
+
+    inline std::int64_t modification_time (const std::string& path) {
+      return std::filesystem::last_write_time(path).time_since_epoch().count();
+    }
+
+    /**
+     * @brief Fills `data` with its first `data.size()` samples from the cache at `path`, if
+     *        that cache was written from `source` as it is now
+     *
+     * A cache matches its source when the size and modification time recorded in its header
+     * match those of the source, or, if only the time differs (a copied or touched file), when
+     * the hash of the source does, in which case the new time is recorded so that the next
+     * read does not hash the source again. A cache whose source is gone is used as it is.
+     *
+     * @return whether the cache was used; when it was not, `data` is left as it was
+     */
+    inline bool read (const std::string& path, const std::string& source, dataset& data) {
+      if (not std::filesystem::exists(path))
+        return false;
+
+      const mapped_file file (path);
+      const std::span <const std::uint8_t> bytes = file.bytes();
+      header head;
+
+      if (bytes.size() < sizeof(header))
+        return false;
+      std::memcpy(&head, bytes.data(), sizeof(header));
+
+      const std::size_t sample_size = (std::size_t)head.height * head.width;
+      const std::size_t labels_size = head.count * sizeof(std::int32_t);
+
+      if (not std::equal(magic, magic + 4, head.magic) or head.version != version or head.dtype != uint8
+          or head.height != (std::uint32_t)data.get_height() or head.width != (std::uint32_t)data.get_width()
+          or head.count < data.size() or bytes.size() != sizeof(header) + labels_size + head.count * sample_size)
+        return false;
+
+      if (std::filesystem::exists(source)) {
+        const std::int64_t time = modification_time(source);
+        const bool same_size = std::filesystem::file_size(source) == head.source_size;
+        const bool same_time = time == head.source_mtime;
+
+        if (not same_size or (not same_time and hash(mapped_file(source).bytes()) != head.source_hash))
+          return false;
+
+        if (not same_time) {
+          std::fstream stamp (path, std::ios::binary | std::ios::in | std::ios::out);
+          stamp.seekp(offsetof(header, source_mtime));
+          stamp.write((const char*)&time, sizeof(time));
+        }
+      }
+
+      const std::uint8_t* labels = bytes.data() + sizeof(header);
+      for (std::size_t i = 0; i < data.size(); ++i) {
+        std::int32_t label;
+        std::memcpy(&label, labels + i * sizeof(std::int32_t), sizeof(std::int32_t));
+        data.set_label(i, label);
+      }
+
+      const std::uint8_t* pixels = labels + labels_size;
+      std::copy(pixels, pixels + data.size() * sample_size, data.data());
+      data.set_scale(head.scale);
+
+      return true;
+    }
+
+    /**
+     * @brief Writes `data`, parsed from `source`, to the cache at `path`
+     *
+     * The cache is written under a temporary name and renamed over `path`, so a reader never
+     * sees half of one.
+     */
+    inline void write (const std::string& path, const std::string& source, const dataset& data) {
+      header head {};
+      std::copy(magic, magic + 4, head.magic);
+      head.version = version;
+      head.dtype = uint8;
+      head.height = data.get_height();
+      head.width = data.get_width();
+      head.count = data.size();
+      head.scale = data.get_scale();
+      head.source_size = std::filesystem::file_size(source);
+      head.source_mtime = modification_time(source);
+      head.source_hash = hash(mapped_file(source).bytes());
+
+      const std::string temporary = path + ".tmp";
+
+      {
+        std::ofstream file (temporary, std::ios::binary | std::ios::trunc);
+        if (not file.is_open())
+          throw std::runtime_error("unable to write cache to \"" + temporary + "\"");
+
+        file.write((const char*)&head, sizeof(header));
+        for (int label : data.get_labels()) {
+          const std::int32_t value = label;
+          file.write((const char*)&value, sizeof(std::int32_t));
+        }
+        file.write((const char*)data.data(), data.size() * data.get_sample_size());
+
+        file.flush();
+        if (not file)
+          throw std::runtime_error("unable to write cache to \"" + temporary + "\"");
+      }
+
+      std::filesystem::rename(temporary, path);
+    }
+
+  } // namespace cache
+
+} // namespace fmc
+
+#endif // FMC_CACHE_HPP
@@ -0,0 +1,365 @@
+// Arrow
+
+#ifndef FMC_CHECKPOINT_HPP
+#define FMC_CHECKPOINT_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief everything needed to continue training exactly where it was interrupted
+   *
+   * The parameters and optimizer state of a network are stored as a list of arrays packed
+   * back to back in `values`; which array is which is up to the network that wrote them.
+   *
+   * @tparam T type of the parameters
+   */
+  template <typename T>
+  struct training_state {
+    int epoch = 0;
+    int position = 0;
+    long step_count = 0;
+    int optimizer_kind = 0;
+    std::uint64_t data_seed = 0;
+    std::string generator;
+    std::vector <std::size_t> sizes;
+    std::vector <T> values;
+
+    void append            (const T*, std::size_t);
+    void clear             ();
+    void extract           (std::size_t, T*, std::size_t) const;
+    void restore_generator () const;
+    void save_generator    ();
+  };
+
+  /**
+   * @brief Adds one array to the state
+   */
+  template <typename T>
+  void training_state <T>::append (const T* data, std::size_t size) {
+    sizes.push_back(size);
+    values.insert(values.end(), data, data + size);
+  }
+
+  /**
+   * @brief Empties the state but keeps its buffers, so that taking the next snapshot of the
+   *        same network allocates nothing
+   */
+  template <typename T>
+  void training_state <T>::clear () {
+    sizes.clear();
+    values.clear();
+  }
+
+  /**
+   * @brief Copies the `index`-th array into `data`, which must hold exactly `size` values
+   */
+  template <typename T>
+  void training_state <T>::extract (std::size_t index, T* data, std::size_t size) const {
+    if (index >= sizes.size() or sizes[index] != size)
+      throw std::runtime_error("checkpoint does not match the shape of the network");
+
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < index; ++i)
+      offset += sizes[i];
+
+    std::copy(values.begin() + offset, values.begin() + offset + size, data);
+  }
+
+  /**
+   * @brief Records the state of random::generator
+   */
+  template <typename T>
+  void training_state <T>::save_generator () {
+    std::ostringstream stream;
+    stream << random::generator;
+    generator = stream.str();
+  }
+
+  /**
+   * @brief Puts random::generator back into the recorded state
+   */
+  template <typename T>
+  void training_state <T>::restore_generator () const {
+    std::istringstream stream (generator);
+    stream >> random::generator;
+    if (stream.fail())
+      throw std::runtime_error("checkpoint holds an invalid random generator state");
+  }
+
+  namespace checkpoint {
+
+    /**
+     * @brief Writes a training state to `path`
+     *
+     * The file is written next to its destination under a temporary name and then renamed
+     * over it, so `path` always holds either the previous checkpoint or the complete new one,
+     * even if the process dies halfway through. A short text header is followed by the raw
+     * bytes of the values, which are restored bit for bit and cost no formatting.
+     */
+    template <typename T>
+    void write (const std::string& path, const training_state <T>& state) {
+      const std::string temporary = path + ".tmp";
+
+      {
+        std::ofstream file (temporary, std::ios::binary | std::ios::trunc);
+        if (not file.is_open())
+          throw std::runtime_error("unable to write checkpoint to \"" + temporary + "\"");
+
+        file << "fmc-checkpoint " << sizeof(T) << '\n'
+             << state.epoch << ' ' << state.position << ' ' << state.step_count << ' ' << state.optimizer_kind << ' '
+             << state.data_seed << '\n'
+             << state.generator << '\n'
+             << state.sizes.size();
+        for (std::size_t size : state.sizes)
+          file << ' ' << size;
+        file << '\n';
+        file.write((const char*)state.values.data(), state.values.size() * sizeof(T));
+
+        file.flush();
+        if (not file)
+          throw std::runtime_error("unable to write checkpoint to \"" + temporary + "\"");
+      }
+
+      std::filesystem::rename(temporary, path);
+    }
+
+    /**
+     * @brief Reads a training state written by checkpoint::write
+     */
+    template <typename T>
+    training_state <T> read (const std::string& path) {
+      std::ifstream file (path, std::ios::binary);
+      if (not file.is_open())
+        throw std::runtime_error("unable to read checkpoint from \"" + path + "\"");
+
+      training_state <T> state;
+      std::string magic;
+      std::size_t value_size = 0;
+      std::size_t count = 0;
+
+      file >> magic >> value_size;
+      if (magic != "fmc-checkpoint" or value_size != sizeof(T))
+        throw std::runtime_error("\"" + path + "\" is not a checkpoint of this network type");
+
+      std::string counters;
+      file.ignore();
+      std::getline(file, counters);
+      std::istringstream fields (counters);
+      fields >> state.epoch >> state.position >> state.step_count >> state.optimizer_kind;
+      // checkpoints written before training was shuffled end the line there
+      if (not (fields >> state.data_seed))
+        state.data_seed = 0;
+      std::getline(file, state.generator);
+
+      file >> count;
+      state.sizes.resize(count);
+      std::size_t total = 0;
+      for (std::size_t& size : state.sizes) {
+        file >> size;
+        total += size;
+      }
+      file.ignore();
+
+      state.values.resize(total);
+      file.read((char*)state.values.data(), total * sizeof(T));
+      if (not file)
+        throw std::runtime_error("checkpoint \"" + path + "\" is truncated");
+
+      return state;
+    }
+
+  } // namespace checkpoint
+
+  /**
+   * @brief writes checkpoints on a background thread
+   *
+   * Owns two training states. The training thread fills whichever one is free with acquire(),
+   * hands it over with submit() and carries on, while the writer thread formats and renames
+   * the other one. A snapshot still waiting when a newer one is submitted is dropped, since
+   * only the latest checkpoint is ever kept on disk. acquire() only blocks when the previous
+   * write is still running and a newer snapshot is already waiting behind it.
+   *
+   * @tparam T type of the parameters
+   */
+  template <typename T>
+  class checkpoint_writer {
+    private:
+      enum class slot {
+        free,
+        filling,
+        pending,
+        writing
+      };
+
+      std::string path;
+      std::array <training_state <T>, 2> buffers;
+      std::array <slot, 2> slots;
+      std::mutex mutex;
+      std::condition_variable changed;
+      std::exception_ptr error;
+      bool stopping;
+      std::thread writer;
+
+    public:
+      explicit checkpoint_writer (const std::string&);
+      ~checkpoint_writer ();
+
+      checkpoint_writer (const checkpoint_writer&) = delete;
+      checkpoint_writer& operator = (const checkpoint_writer&) = delete;
+
+      training_state <T>& acquire ();
+      void                finish  ();
+      void                submit  ();
+
+    private:
+      void run ();
+  };
+
+  template <typename T>
+  checkpoint_writer <T>::checkpoint_writer (const std::string& path)
+    : path (path),
+      slots {slot::free, slot::free},
+      stopping (false),
+      writer (&checkpoint_writer::run, this)
+  { }
+
+  template <typename T>
+  checkpoint_writer <T>::~checkpoint_writer () {
+    if (writer.joinable()) {
+      {
+        std::lock_guard <std::mutex> lock (mutex);
+        stopping = true;
+      }
+      changed.notify_all();
+      writer.join();
+    }
+  }
+
+  /**
+   * @brief Returns a free buffer for the training thread to fill, then pass to submit()
+   */
+  template <typename T>
+  training_state <T>& checkpoint_writer <T>::acquire () {
+    std::unique_lock <std::mutex> lock (mutex);
+    changed.wait(lock, [&] { return slots[0] == slot::free or slots[1] == slot::free; });
+
+    const int index = slots[0] == slot::free ? 0 : 1;
+    slots[index] = slot::filling;
+    return buffers[index];
+  }
+
+  /**
+   * @brief Waits for every submitted checkpoint to reach the disk and stops the writer thread.
+   *        Rethrows the first error the writer ran into.
+   */
+  template <typename T>
+  void checkpoint_writer <T>::finish () {
+    {
+      std::lock_guard <std::mutex> lock (mutex);
+      stopping = true;
+    }
+    changed.notify_all();
+    if (writer.joinable())
+      writer.join();
+
+    if (error)
+      std::rethrow_exception(std::exchange(error, nullptr));
+  }
+
+  /**
+   * @brief Queues the buffer returned by the last acquire() for writing
+   */
+  template <typename T>
+  void checkpoint_writer <T>::submit () {
+    {
+      std::lock_guard <std::mutex> lock (mutex);
+      for (slot& state : slots)
+        if (state == slot::pending)
+          state = slot::free;
+        else if (state == slot::filling)
+          state = slot::pending;
+    }
+    changed.notify_all();
+  }
+
+  template <typename T>
+  void checkpoint_writer <T>::run () {
+    std::unique_lock <std::mutex> lock (mutex);
+
+    while (true) {
+      changed.wait(lock, [&] { return stopping or slots[0] == slot::pending or slots[1] == slot::pending; });
+
+      const int index = slots[0] == slot::pending ? 0 : slots[1] == slot::pending ? 1 : -1;
+      if (index < 0)
+        return;
+
+      slots[index] = slot::writing;
+      lock.unlock();
+
+      try {
+        checkpoint::write(path, buffers[index]);
+      }
+      catch (...) {
+        std::lock_guard <std::mutex> guard (mutex);
+        if (not error)
+          error = std::current_exception();
+      }
+
+      lock.lock();
+      slots[index] = slot::free;
+      changed.notify_all();
+    }
+  }
+
+  /**
+   * @brief decides when fit takes a checkpoint: every `steps` optimizer steps and / or every
+   *        `seconds` of wall time, whichever comes first. A zero disables either trigger.
+   */
+  class checkpoint_schedule {
+    private:
+      using clock = std::chrono::steady_clock;
+
+      long steps;
+      double seconds;
+      clock::time_point last;
+
+    public:
+      checkpoint_schedule (long steps, double seconds)
+        : steps (steps),
+          seconds (seconds),
+          last (clock::now())
+      { }
+
+      bool due (long step_count) {
+        const clock::time_point now = clock::now();
+        const bool by_steps = steps > 0 and step_count % steps == 0;
+        const bool by_time = seconds > 0 and std::chrono::duration <double> (now - last).count() >= seconds;
+
+        if (by_steps or by_time)
+          last = now;
+        return by_steps or by_time;
+      }
+  };
+
+} // namespace fmc
+
+#endif // FMC_CHECKPOINT_HPP
@@ -0,0 +1,335 @@
+// Arrow
+
+#ifndef FMC_CONV_HPP
+#define FMC_CONV_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace fmc {
+
+  /**
+   * @brief Kind of transformation a layer applies to the activations of the previous layer
+   */
+  enum class layer_type {
+    dense,
+    conv2d,
+    maxpool2d,
+    avgpool2d,
+    batchnorm
+  };
+
+  /**
+   * @brief Geometry of a 2D convolution over images stored channels-last: a sample is a
+   *        (height x width x channels) array flattened row by row, so a single-channel image
+   *        is just its pixels. The output uses the same layout with `filters` channels.
+   */
+  struct conv2d_shape {
+    int channels = 1;
+    int height = 0;
+    int width = 0;
+    int filters = 1;
+    int kernel_size = 3;
+    int stride = 1;
+    int padding = 0;
+
+    // a kernel larger than the padded input fits nowhere; the division alone would truncate to 1
+    int output_height () const { return height + 2 * padding < kernel_size ? 0 : (height + 2 * padding - kernel_size) / stride + 1; }
+    int output_width  () const { return width + 2 * padding < kernel_size ? 0 : (width + 2 * padding - kernel_size) / stride + 1; }
+    int positions     () const { return output_height() * output_width(); }
+    int patch_size    () const { return kernel_size * kernel_size * channels; }
+    int input_size    () const { return height * width * channels; }
+    int output_size   () const { return positions() * filters; }
+
+    bool valid () const {
+      return channels > 0 and height > 0 and width > 0 and filters > 0 and kernel_size > 0 and stride > 0
+         and padding >= 0 and height + 2 * padding >= kernel_size and width + 2 * padding >= kernel_size;
+    }
+  };
+
+  /**
+   * @brief Geometry of a 2D pooling over channels-last images (see conv2d_shape). Every channel
+   *        is pooled on its own over `window_size` squared pixels; there is no padding.
+   */
+  struct pool2d_shape {
+    int channels = 1;
+    int height = 0;
+    int width = 0;
+    int window_size = 2;
+    int stride = 2;
+
+    int output_height () const { return height < window_size ? 0 : (height - window_size) / stride + 1; }
+    int output_width  () const { return width < window_size ? 0 : (width - window_size) / stride + 1; }
+    int input_size    () const { return height * width * channels; }
+    int output_size   () const { return output_height() * output_width() * channels; }
+
+    bool valid () const {
+      return channels > 0 and height >= window_size and width >= window_size and window_size > 0
+         and window_size <= 16 and stride > 0;
+    }
+  };
+
+  namespace conv {
+
+    /**
+     * @brief Unrolls every receptive field of `rows` samples into one row of a
+     *        (rows * positions x patch_size) matrix, so that the convolution becomes a single
+     *        GEMM with the (patch_size x filters) weights. Padding reads as zero.
+     *
+     * A row holds the patch in (ky, kx, channel) order; with channels-last inputs every
+     * (ky, kx) step copies `channels` contiguous values.
+     *
+     * @tparam T type of the elements
+     * @param input rows x input_size() samples
+     * @param columns output; rows * positions() x patch_size() values
+     * @param rows number of samples
+     * @param shape geometry of the convolution
+     */
+    template <typename T>
+    void im2col (const T* __restrict input, T* __restrict columns, int rows, const conv2d_shape& shape) {
+      const int out_height = shape.output_height();
+      const int out_width = shape.output_width();
+      const int channels = shape.channels;
+      const int row_size = shape.width * channels;
+
+      for (int r = 0; r < rows; ++r) {
+        const T* image = input + (std::size_t)r * shape.input_size();
+
+        for (int oy = 0; oy < out_height; ++oy)
+          for (int ox = 0; ox < out_width; ++ox) {
+            for (int ky = 0; ky < shape.kernel_size; ++ky) {
+              const int y = oy * shape.stride - shape.padding + ky;
+
+              for (int kx = 0; kx < shape.kernel_size; ++kx) {
+                const int x = ox * shape.stride - shape.padding + kx;
+
+                if (y < 0 or y >= shape.height or x < 0 or x >= shape.width)
+                  std::fill(columns, columns + channels, T(0));
+                else {
+                  const T* pixel = image + (std::size_t)y * row_size + (std::size_t)x * channels;
+                  std::copy(pixel, pixel + channels, columns);
+                }
+                columns += channels;
+              }
+            }
+          }
+      }
+    }
+
+    /**
+     * @brief Adjoint of im2col: adds every value of the unrolled matrix back onto the input
+     *        element it was read from. Padding positions are dropped. `input` is accumulated
+     *        into, not overwritten.
+     */
+    template <typename T>
+    void col2im (const T* __restrict columns, T* __restrict input, int rows, const conv2d_shape& shape) {
+      const int out_height = shape.output_height();
+      const int out_width = shape.output_width();
+      const int channels = shape.channels;
+      const int row_size = shape.width * channels;
+
+      for (int r = 0; r < rows; ++r) {
+        T* image = input + (std::size_t)r * shape.input_size();
+
+        for (int oy = 0; oy < out_height; ++oy)
+          for (int ox = 0; ox < out_width; ++ox) {
+            for (int ky = 0; ky < shape.kernel_size; ++ky) {
+              const int y = oy * shape.stride - shape.padding + ky;
+
+              for (int kx = 0; kx < shape.kernel_size; ++kx) {
+                const int x = ox * shape.stride - shape.padding + kx;
+
+                if (y >= 0 and y < shape.height and x >= 0 and x < shape.width) {
+                  T* pixel = image + (std::size_t)y * row_size + (std::size_t)x * channels;
+                  for (int c = 0; c < channels; ++c)
+                    pixel[c] += columns[c];
+                }
+                columns += channels;
+              }
+            }
+          }
+      }
+    }
+
+  } // namespace conv
+
+  namespace pool {
+
+    /**
+     * @brief Max pooling of `rows` samples. When `argmax` is not null it receives, for every
+     *        output, the position of the maximum within its window (ky * window_size + kx), which
+     *        is all max_backward needs.
+     *
+     * Windows are visited one (ky, kx) offset at a time over a whole output row, so the
+     * comparisons run over contiguous outputs and vectorize; for a single channel the inputs
+     * are read with a constant stride.
+     *
+     * @tparam T type of the elements
+     * @param input rows x input_size() samples
+     * @param output rows x output_size() values
+     * @param argmax rows x output_size() window positions, or null
+     * @param rows number of samples
+     * @param shape geometry of the pooling
+     */
+    template <typename T>
+    void max_forward (const T* __restrict input, T* __restrict output, std::uint8_t* __restrict argmax, int rows,
+                      const pool2d_shape& shape) {
+      const int out_height = shape.output_height();
+      const int out_width = shape.output_width();
+      const int channels = shape.channels;
+      const int row_size = shape.width * channels;
+      const int out_row_size = out_width * channels;
+      const std::size_t step = (std::size_t)shape.stride * channels;
+
+      for (int r = 0; r < rows; ++r) {
+        const T* image = input + (std::size_t)r * shape.input_size();
+
+        for (int oy = 0; oy < out_height; ++oy) {
+          const std::size_t first = ((std::size_t)r * out_height + oy) * out_row_size;
+          T* out = output + first;
+          std::uint8_t* index = argmax == nullptr ? nullptr : argmax + first;
+
+          for (int k = 0; k < shape.window_size * shape.window_size; ++k) {
+            const int ky = k / shape.window_size;
+            const int kx = k % shape.window_size;
+            const T* in = image + (std::size_t)(oy * shape.stride + ky) * row_size + (std::size_t)kx * channels;
+
+            if (k == 0) {
+              for (int ox = 0; ox < out_width; ++ox)
+                std::copy(in + ox * step, in + ox * step + channels, out + ox * channels);
+              if (index != nullptr)
+                std::fill(index, index + out_row_size, 0);
+            }
+            else if (index == nullptr) {
+              if (channels == 1)
+                for (int ox = 0; ox < out_width; ++ox)
+                  out[ox] = std::max(out[ox], in[ox * step]);
+              else
+                for (int ox = 0; ox < out_width; ++ox)
+                  for (int c = 0; c < channels; ++c)
+                    out[ox * channels + c] = std::max(out[ox * channels + c], in[ox * step + c]);
+            }
+            else {
+              // branch-free so that the float comparison and the byte select vectorize together
+              const std::uint8_t position = k;
+              auto take = [&] (int i, T value) {
+                const std::uint8_t mask = -(std::uint8_t)(value > out[i]);
+                out[i] = std::max(out[i], value);
+                index[i] = (index[i] & ~mask) | (position & mask);
+              };
+
+              if (channels == 1)
+                for (int ox = 0; ox < out_width; ++ox)
+                  take(ox, in[ox * step]);
+              else
+                for (int ox = 0; ox < out_width; ++ox)
+                  for (int c = 0; c < channels; ++c)
+                    take(ox * channels + c, in[ox * step + c]);
+            }
+          }
+        }
+      }
+    }
+
+    /**
+     * @brief Routes the delta of every max pooling output to the input that won its window.
+     *        `input_delta` is accumulated into, not overwritten.
+     */
+    template <typename T>
+    void max_backward (const T* __restrict delta, const std::uint8_t* __restrict argmax, T* __restrict input_delta,
+                       int rows, const pool2d_shape& shape) {
+      const int out_height = shape.output_height();
+      const int out_width = shape.output_width();
+      const int channels = shape.channels;
+      const int row_size = shape.width * channels;
+
+      for (int r = 0; r < rows; ++r) {
+        T* image = input_delta + (std::size_t)r * shape.input_size();
+
+        for (int oy = 0; oy < out_height; ++oy)
+          for (int ox = 0; ox < out_width; ++ox)
+            for (int c = 0; c < channels; ++c, ++delta, ++argmax) {
+              const int y = oy * shape.stride + *argmax / shape.window_size;
+              const int x = ox * shape.stride + *argmax % shape.window_size;
+              image[(std::size_t)y * row_size + (std::size_t)x * channels + c] += *delta;
+            }
+      }
+    }
+
+    /**
+     * @brief Average pooling of `rows` samples, accumulated one (ky, kx) offset at a time like
+     *        max_forward
+     */
+    template <typename T>
+    void average_forward (const T* __restrict input, T* __restrict output, int rows, const pool2d_shape& shape) {
+      const int out_height = shape.output_height();
+      const int out_width = shape.output_width();
+      const int channels = shape.channels;
+      const int row_size = shape.width * channels;
+      const int out_row_size = out_width * channels;
+      const std::size_t step = (std::size_t)shape.stride * channels;
+      const T scale = T(1) / (shape.window_size * shape.window_size);
+
+      for (int r = 0; r < rows; ++r) {
+        const T* image = input + (std::size_t)r * shape.input_size();
+
+        for (int oy = 0; oy < out_height; ++oy) {
+          T* out = output + ((std::size_t)r * out_height + oy) * out_row_size;
+          std::fill(out, out + out_row_size, T(0));
+
+          for (int ky = 0; ky < shape.window_size; ++ky)
+            for (int kx = 0; kx < shape.window_size; ++kx) {
+              const T* in = image + (std::size_t)(oy * shape.stride + ky) * row_size + (std::size_t)kx * channels;
+
+              if (channels == 1)
+                for (int ox = 0; ox < out_width; ++ox)
+                  out[ox] += in[ox * step];
+              else
+                for (int ox = 0; ox < out_width; ++ox)
+                  for (int c = 0; c < channels; ++c)
+                    out[ox * channels + c] += in[ox * step + c];
+            }
+
+          for (int i = 0; i < out_row_size; ++i)
+            out[i] *= scale;
+        }
+      }
+    }
+
+    /**
+     * @brief Spreads the delta of every average pooling output evenly over its window.
+     *        `input_delta` is accumulated into, not overwritten.
+     */
+    template <typename T>
+    void average_backward (const T* __restrict delta, T* __restrict input_delta, int rows, const pool2d_shape& shape) {
+      const int out_height = shape.output_height();
+      const int out_width = shape.output_width();
+      const int channels = shape.channels;
+      const int row_size = shape.width * channels;
+      const int out_row_size = out_width * channels;
+      const std::size_t step = (std::size_t)shape.stride * channels;
+      const T scale = T(1) / (shape.window_size * shape.window_size);
+
+      for (int r = 0; r < rows; ++r) {
+        T* image = input_delta + (std::size_t)r * shape.input_size();
+
+        for (int oy = 0; oy < out_height; ++oy) {
+          const T* in = delta + ((std::size_t)r * out_height + oy) * out_row_size;
+
+          for (int ky = 0; ky < shape.window_size; ++ky)
+            for (int kx = 0; kx < shape.window_size; ++kx) {
+              T* out = image + (std::size_t)(oy * shape.stride + ky) * row_size + (std::size_t)kx * channels;
+              for (int ox = 0; ox < out_width; ++ox)
+                for (int c = 0; c < channels; ++c)
+                  out[ox * step + c] += scale * in[ox * channels + c];
+            }
+        }
+      }
+    }
+
+  } // namespace pool
+
+} // namespace fmc
+
+#endif // FMC_CONV_HPP
@@ -0,0 +1,426 @@
+// Arrow
+
+#ifndef FMC_CSV_HPP
+#define FMC_CSV_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache.hpp"
+#include "dataset.hpp"
+#include "mapped_file.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief summary of the rows of a CSV file read by csv::read_rows
+   */
+  struct csv_statistics {
+    std::size_t bytes = 0;
+    std::size_t rows = 0;
+    int thread_count = 0;
+    double elapsed_seconds = 0;
+    double throughput = 0;
+  };
+
+  /**
+   * @brief Operator << overload to insert a human readable summary of a CSV read into a
+   *        std::ostream object
+   */
+  inline std::ostream& operator << (std::ostream& stream, const csv_statistics& statistics) {
+    const auto flags = stream.flags();
+    const auto precision = stream.precision();
+
+    stream << statistics.rows << " rows, " << std::fixed << std::setprecision(1) << statistics.bytes / 1e6 << " MB in "
+           << statistics.elapsed_seconds * 1000 << " ms on " << statistics.thread_count << " threads ("
+           << std::setprecision(0) << statistics.throughput / 1e6 << " MB/s)";
+
+    stream.flags(flags);
+    stream.precision(precision);
+    return stream;
+  }
+
+  namespace csv {
+
+    /**
+     * @brief row of a CSV file that could not be parsed
+     */
+    struct malformed_row {
+      std::size_t line;
+      std::string reason;
+    };
+
+    /**
+     * @brief byte offsets of the rows of a CSV file, header excluded: row r spans
+     *        [offsets[r], offsets[r + 1]), so there is one more offset than there are rows
+     */
+    struct row_index {
+      std::vector <std::uint64_t> offsets;
+      std::size_t first_line = 1;
+
+      std::size_t rows () const;
+    };
+
+    inline std::size_t row_index::rows () const {
+      return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    /**
+     * @brief first bytes of a .fmci row index, followed by the rows + 1 64-bit offsets
+     *
+     * Like a .fmcd cache, an index records the size, modification time and hash of the file
+     * it was built from, to tell whether it still matches it.
+     */
+    struct index_header {
+      char magic[4];
+      std::uint32_t version;
+      std::uint64_t first_line;
+      std::uint64_t rows;
+      std::uint64_t source_size;
+      std::int64_t source_mtime;
+      std::uint64_t source_hash;
+    };
+
+    const char index_magic[4] = {'F', 'M', 'C', 'I'};
+    const std::uint32_t index_version = 1;
+
+    // Start of the rows of [begin, end): past the first line if it does not start with a digit,
+    // which is then taken for a header of column names
+    inline const char* skip_header (const char* begin, const char* end, std::size_t& first_line) {
+      first_line = 1;
+      if (begin == end or (*begin >= '0' and *begin <= '9'))
+        return begin;
+
+      const char* newline = (const char*)std::memchr(begin, '\n', end - begin);
+      first_line = 2;
+      return newline == nullptr ? end : newline + 1;
+    }
+
+    // Bounds of `thread_count` chunks of [body, end) of about the same size, that all start at
+    // the beginning of a line
+    inline std::vector <const char*> split_lines (const char* body, const char* end, int thread_count) {
+      std::vector <const char*> bounds (thread_count + 1, body);
+      bounds[thread_count] = end;
+      for (int t = 1; t < thread_count; ++t) {
+        const char* guess = std::max(bounds[t - 1], body + (end - body) * t / thread_count);
+        const char* newline = (const char*)std::memchr(guess, '\n', end - guess);
+        bounds[t] = newline == nullptr ? end : newline + 1;
+      }
+      return bounds;
+    }
+
+    // Runs work(t) for every t below `thread_count`, t = 0 on the calling thread
+    template <typename Work>
+    void in_parallel (int thread_count, Work&& work) {
+      std::vector <std::thread> threads;
+      for (int t = 1; t < thread_count; ++t)
+        threads.emplace_back(work, t);
+      work(0);
+      for (auto& thread : threads)
+        thread.join();
+    }
+
+    // Number of rows that start in [first, last), which holds whole lines only
+    inline std::size_t count_rows (const char* first, const char* last) {
+      if (first == last)
+        return 0;
+      return std::count(first, last, '\n') + (last[-1] != '\n');
+    }
+
+    /**
+     * @brief Reads an unsigned decimal field of at most `digits` digits at `cursor`, and moves
+     *        `cursor` past it
+     *
+     * @return whether there was such a field
+     */
+    inline bool parse_field (const char*& cursor, const char* end, int digits, int& value) {
+      const char* first = cursor;
+      value = 0;
+      while (cursor != end and *cursor >= '0' and *cursor <= '9' and cursor - first < digits) {
+        value = value * 10 + (*cursor - '0');
+        ++cursor;
+      }
+      return cursor != first and (cursor == end or *cursor < '0' or *cursor > '9');
+    }
+
+    /**
+     * @brief Reads a `,pixel` field at `cursor`, where `end` leaves room for the three digits a
+     *        pixel can have, and moves `cursor` past it. Pixels have one to three digits, so the
+     *        digits are tested all at once instead of one loop iteration at a time.
+     *
+     * @return whether there was such a field
+     */
+    inline bool parse_pixel (const char*& cursor, int& value) {
+      const unsigned first = cursor[1] - '0';
+      const unsigned second = cursor[2] - '0';
+      const unsigned third = cursor[3] - '0';
+
+      if (cursor[0] != ',' or first > 9)
+        return false;
+      if (second > 9) {
+        value = first;
+        cursor += 2;
+      }
+      else if (third > 9) {
+        value = first * 10 + second;
+        cursor += 3;
+      }
+      else {
+        value = first * 100 + second * 10 + third;
+        cursor += 4;
+      }
+      return value <= 255 and (unsigned)(*cursor - '0') > 9;
+    }
+
+    /**
+     * @brief Parses the rows of `chunk`, the first of which is row `row` of the data and line
+     *        `line` of the file, into `data`, until `count` rows of data have been read
+     */
+    inline void parse_chunk (const char* chunk, const char* chunk_end, std::size_t row, std::size_t line,
+                             dataset& data, std::size_t count, int classes, std::vector <malformed_row>& errors) {
+      const int sample_size = data.get_sample_size();
+
+      for (const char* cursor = chunk; cursor != chunk_end and row < count; ++row, ++line) {
+        const char* newline = (const char*)std::memchr(cursor, '\n', chunk_end - cursor);
+        const char* line_end = newline == nullptr ? chunk_end : newline;
+        const char* next = newline == nullptr ? chunk_end : newline + 1;
+        if (line_end != cursor and line_end[-1] == '\r')
+          --line_end;
+
+        std::uint8_t* pixels = data.sample(row).data();
+        std::string error;
+        int label = 0;
+        int value = 0;
+
+        if (not parse_field(cursor, line_end, 9, label))
+          error = "the label is not a number";
+        else if (label >= classes)
+          error = "label " + std::to_string(label) + " is not one of the " + std::to_string(classes) + " classes";
+        else {
+          for (int i = 0; i < sample_size and error.empty(); ++i) {
+            if (cursor == line_end)
+              error = "expected " + std::to_string(sample_size + 1) + " fields, found " + std::to_string(i + 1);
+            else if (chunk_end - cursor > 4 ? not parse_pixel(cursor, value)
+                                            : *cursor != ',' or not parse_field(++cursor, line_end, 3, value) or value > 255)
+              error = "field " + std::to_string(i + 2) + " is not a pixel value between 0 and 255";
+            else
+              pixels[i] = value;
+          }
+          if (error.empty() and cursor != line_end)
+            error = "expected " + std::to_string(sample_size + 1) + " fields, found more";
+        }
+
+        if (error.empty())
+          data.set_label(row, label);
+        else
+          errors.push_back({line, error});
+
+        cursor = next;
+      }
+    }
+
+    // Throws a std::runtime_error listing the first malformed rows of `path`, if there are any
+    inline void report_errors (const std::string& path, const std::vector <std::vector <malformed_row>>& errors) {
+      std::size_t error_count = 0;
+      std::string report;
+      for (const auto& chunk_errors : errors)
+        for (const malformed_row& error : chunk_errors)
+          if (++error_count <= 10)
+            report += "\n  line " + std::to_string(error.line) + ": " + error.reason;
+
+      if (error_count > 0)
+        throw std::runtime_error("\"" + path + "\" has " + std::to_string(error_count) + " malformed rows" + report
+                                 + (error_count > 10 ? "\n  ..." : ""));
+    }
+
+    /**
+     * @brief Finds where every row of a CSV file starts, counting the rows of `thread_count`
+     *        chunks in parallel and then recording their offsets in parallel
+     */
+    inline row_index index_rows (const std::string& path, int thread_count = 0) {
+      const mapped_file file (path);
+      const char* begin = (const char*)file.bytes().data();
+      const char* end = begin + file.bytes().size();
+      row_index index;
+      const char* body = skip_header(begin, end, index.first_line);
+
+      if (thread_count <= 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+      const std::vector <const char*> bounds = split_lines(body, end, thread_count);
+
+      std::vector <std::size_t> first_rows (thread_count + 1, 0);
+      in_parallel(thread_count, [&] (int t) { first_rows[t + 1] = count_rows(bounds[t], bounds[t + 1]); });
+      for (int t = 0; t < thread_count; ++t)
+        first_rows[t + 1] += first_rows[t];
+
+      index.offsets.resize(first_rows[thread_count] + 1);
+      index.offsets.back() = end - begin;
+
+      in_parallel(thread_count, [&] (int t) {
+        std::size_t row = first_rows[t];
+        for (const char* cursor = bounds[t]; cursor != bounds[t + 1]; ++row) {
+          index.offsets[row] = cursor - begin;
+          const char* newline = (const char*)std::memchr(cursor, '\n', bounds[t + 1] - cursor);
+          cursor = newline == nullptr ? bounds[t + 1] : newline + 1;
+        }
+      });
+
+      return index;
+    }
+
+    /**
+     * @brief Writes `index`, built from `source`, to the sidecar file at `path`, under a
+     *        temporary name renamed over `path` as caches are
+     */
+    inline void write_index (const std::string& path, const std::string& source, const row_index& index) {
+      index_header head {};
+      std::copy(index_magic, index_magic + 4, head.magic);
+      head.version = index_version;
+      head.first_line = index.first_line;
+      head.rows = index.rows();
+      head.source_size = std::filesystem::file_size(source);
+      head.source_mtime = cache::modification_time(source);
+      head.source_hash = cache::hash(mapped_file(source).bytes());
+
+      const std::string temporary = path + ".tmp";
+
+      {
+        std::ofstream file (temporary, std::ios::binary | std::ios::trunc);
+        if (not file.is_open())
+          throw std::runtime_error("unable to write row index to \"" + temporary + "\"");
+
+        file.write((const char*)&head, sizeof(index_header));
+        file.write((const char*)index.offsets.data(), index.offsets.size() * sizeof(std::uint64_t));
+
+        file.flush();
+        if (not file)
+          throw std::runtime_error("unable to write row index to \"" + temporary + "\"");
+      }
+
+      std::filesystem::rename(temporary, path);
+    }
+
+    /**
+     * @brief Fills `index` from the sidecar file at `path`, if it was built from `source` as it
+     *        is now; it matches as a cache does (see cache::read)
+     *
+     * @return whether the index was read; when it was not, `index` is left as it was
+     */
+    inline bool read_index (const std::string& path, const std::string& source, row_index& index) {
+      if (not std::filesystem::exists(path) or not std::filesystem::exists(source))
+        return false;
+
+      const mapped_file file (path);
+      const std::span <const std::uint8_t> bytes = file.bytes();
+      index_header head;
+
+      if (bytes.size() < sizeof(index_header))
+        return false;
+      std::memcpy(&head, bytes.data(), sizeof(index_header));
+
+      if (not std::equal(index_magic, index_magic + 4, head.magic) or head.version != index_version
+          or bytes.size() != sizeof(index_header) + (head.rows + 1) * sizeof(std::uint64_t))
+        return false;
+
+      const std::int64_t time = cache::modification_time(source);
+      const bool same_size = std::filesystem::file_size(source) == head.source_size;
+      const bool same_time = time == head.source_mtime;
+
+      if (not same_size or (not same_time and cache::hash(mapped_file(source).bytes()) != head.source_hash))
+        return false;
+
+      if (not same_time) {
+        std::fstream stamp (path, std::ios::binary | std::ios::in | std::ios::out);
+        stamp.seekp(offsetof(index_header, source_mtime));
+        stamp.write((const char*)&time, sizeof(time));
+      }
+
+      index.first_line = head.first_line;
+      index.offsets.resize(head.rows + 1);
+      std::memcpy(index.offsets.data(), bytes.data() + sizeof(index_header), index.offsets.size() * sizeof(std::uint64_t));
+
+      return true;
+    }
+
+    /**
+     * @brief Reads the rows `rows` of a CSV file of labelled images, one
+     *        `label,pixel,pixel,...` row per image, in that order, into the first rows.size()
+     *        samples of `data`, jumping to them through `index` (see index_rows)
+     *
+     * The file is memory-mapped and nothing but the requested rows is read from it, so a
+     * subset or a range far into the file costs what its rows do. The list of rows is split
+     * into `thread_count` parts (0 uses every hardware thread) that are parsed in parallel,
+     * each run of consecutive rows as a single chunk, straight from the mapping into the bytes
+     * of `data`: no line or field is ever copied into a string.
+     *
+     * Throws a std::runtime_error that lists the line numbers of the first malformed rows (a
+     * wrong number of fields, a pixel outside of 0-255, a label outside of `classes`), or when
+     * a row is past the end of the file.
+     */
+    inline csv_statistics read_rows (const std::string& path, const row_index& index,
+                                     std::span <const std::size_t> rows, dataset& data, int classes,
+                                     int thread_count = 0) {
+      const auto start = std::chrono::steady_clock::now();
+
+      for (std::size_t row : rows)
+        if (row >= index.rows())
+          throw std::runtime_error("\"" + path + "\" holds " + std::to_string(index.rows()) + " rows but row "
+                                   + std::to_string(row) + " was requested");
+
+      const mapped_file file (path);
+      const char* begin = (const char*)file.bytes().data();
+
+      if (file.bytes().size() != index.offsets.back())
+        throw std::runtime_error("the row index of \"" + path + "\" does not match it");
+
+      if (thread_count <= 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+      thread_count = std::max <std::size_t> (1, std::min <std::size_t> (thread_count, rows.size()));
+
+      std::vector <std::vector <malformed_row>> errors (thread_count);
+      std::vector <std::size_t> bytes (thread_count, 0);
+
+      in_parallel(thread_count, [&] (int t) {
+        const std::size_t part_end = rows.size() * (t + 1) / thread_count;
+
+        for (std::size_t first = rows.size() * t / thread_count, last; first < part_end; first = last) {
+          for (last = first + 1; last < part_end and rows[last] == rows[last - 1] + 1; ++last)
+            ;
+
+          const char* chunk = begin + index.offsets[rows[first]];
+          const char* chunk_end = begin + index.offsets[rows[last - 1] + 1];
+          parse_chunk(chunk, chunk_end, first, index.first_line + rows[first], data, last, classes, errors[t]);
+          bytes[t] += chunk_end - chunk;
+        }
+      });
+      report_errors(path, errors);
+
+      csv_statistics statistics;
+      statistics.rows = rows.size();
+      statistics.thread_count = thread_count;
+      for (std::size_t part_bytes : bytes)
+        statistics.bytes += part_bytes;
+      statistics.elapsed_seconds = std::chrono::duration <double> (std::chrono::steady_clock::now() - start).count();
+      statistics.throughput = statistics.elapsed_seconds > 0 ? statistics.bytes / statistics.elapsed_seconds : 0;
+
+      return statistics;
+    }
+
+  } // namespace csv
+
+} // namespace fmc
+
+#endif // FMC_CSV_HPP
@@ -0,0 +1,361 @@
+// Arrow
+
+#ifndef FMC_DATA_LOADER_HPP
+#define FMC_DATA_LOADER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "augment.hpp"
+#include "dataset.hpp"
+#include "shard_stream.hpp"
+#include "shuffle.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief assembles the batches of a dataset on background threads, ahead of the training
+   *        thread that consumes them
+   *
+   * Every epoch visits the samples in the order given by a sample_order, and the images are
+   * transformed by an augmenter on the producer threads, where augmenting costs the trainer
+   * nothing. Batches are numbered in the order they are trained on, across every epoch.
+   * Batch k is always assembled in slot k % slot_count of a ring of `prefetch` + 1 buffers:
+   * the one the trainer is reading, and up to `prefetch` that are filled ahead of it. With
+   * several producer threads, producer p assembles batches p, p + thread_count, ... so
+   * batches may complete out of order but are still handed out in order, and training does
+   * not depend on how many threads assembled its batches.
+   *
+   * A shard_stream is read in place of a dataset by a single producer, in the order its
+   * reader gives the mode and seed of the sample_order, with `prefetch` batches in memory
+   * besides the reader's window and buffer whatever the size of the stream.
+   *
+   * Every slot carries two sequence numbers, the batch it may be filled with next and the
+   * batch it holds, so neither side takes a lock: a producer waits for its slot to be
+   * released, the trainer for its batch to be ready, both on the atomic itself. next() only
+   * waits when the producers are behind, and that wait is counted as stall time.
+   *
+   * @tparam T type the samples are widened to
+   */
+  template <typename T>
+  class data_loader {
+    public:
+      // A batch handed out by next(), valid until the following call. `first` is the position
+      // of its first sample in the order of `epoch`.
+      struct batch {
+        int epoch;
+        int first;
+        int rows;
+        const T* values;
+        const int* labels;
+      };
+
+    private:
+      static const std::size_t alignment = 64;
+
+      struct aligned_delete {
+        void operator () (T* pointer) const { ::operator delete[](pointer, std::align_val_t(alignment)); }
+      };
+
+      struct alignas(alignment) slot {
+        std::atomic <long> writable;
+        std::atomic <long> ready;
+        std::unique_ptr <T[], aligned_delete> values;
+        std::vector <int> labels;
+        batch contents;
+        std::exception_ptr error;
+      };
+
+      const dataset* data;
+      const shard_stream* stream;
+      std::size_t size;
+      std::size_t sample_size;
+      sample_order order;
+      augmenter augmentations;
+      int batch_size;
+      int first_epoch;
+      int first_sample;
+      long first_batches;
+      long epoch_batches;
+      long batch_count;
+      std::unique_ptr <slot[]> slots;
+      int slot_count;
+      long consumed;
+      double stall_seconds;
+      std::atomic <bool> stopping;
+      std::vector <std::thread> producers;
+
+    public:
+      data_loader (const dataset&, const sample_order&, const augmenter&, int, int, int, int = 0, int = 2, int = 1);
+      data_loader (const shard_stream&, const sample_order&, const augmenter&, int, int, int, int = 0, int = 2);
+      ~data_loader ();
+
+      data_loader (const data_loader&) = delete;
+      data_loader& operator = (const data_loader&) = delete;
+
+      double get_stall_seconds () const;
+      bool   next              (batch&);
+
+    private:
+      // what a producer keeps from one batch to the next
+      struct producer_state {
+        augmenter augment;
+        std::vector <int> indices;
+        int epoch = -1;
+        std::unique_ptr <shard_stream::reader> reader;
+        dataset chunk;
+        std::vector <std::uint64_t> identities;
+
+        explicit producer_state (const augmenter& augment) : augment (augment) { }
+      };
+
+      void  assemble (producer_state&, slot&, batch&);
+      batch locate   (long) const;
+      void  produce  (int, int);
+      void  start    (int, int, int, int);
+      bool  wait_for (std::atomic <long>&, long) const;
+  };
+
+  /**
+   * @brief Starts assembling the batches of epochs `first_epoch` to `epochs` - 1 over `data`,
+   *        the first of which starts at position `first_sample` of its order (to resume an
+   *        interrupted epoch)
+   *
+   * @param prefetch number of batches assembled ahead of the one being trained on
+   * @param thread_count number of producer threads
+   */
+  template <typename T>
+  data_loader <T>::data_loader (const dataset& data, const sample_order& order, const augmenter& augmentations,
+                                int batch_size, int first_epoch, int epochs, int first_sample, int prefetch,
+                                int thread_count)
+    : data (&data),
+      stream (nullptr),
+      size (data.size()),
+      sample_size (data.get_sample_size()),
+      order (order),
+      augmentations (augmentations),
+      batch_size (batch_size),
+      first_epoch (first_epoch),
+      first_sample (first_sample),
+      slot_count (prefetch + 1),
+      consumed (-1),
+      stall_seconds (0),
+      stopping (false) {
+    start(epochs, first_sample, prefetch, thread_count);
+  }
+
+  /**
+   * @brief Same as above over the samples of `stream`, read by a single producer thread
+   */
+  template <typename T>
+  data_loader <T>::data_loader (const shard_stream& stream, const sample_order& order, const augmenter& augmentations,
+                                int batch_size, int first_epoch, int epochs, int first_sample, int prefetch)
+    : data (nullptr),
+      stream (&stream),
+      size (stream.size()),
+      sample_size (stream.get_sample_size()),
+      order (order),
+      augmentations (augmentations),
+      batch_size (batch_size),
+      first_epoch (first_epoch),
+      first_sample (first_sample),
+      slot_count (prefetch + 1),
+      consumed (-1),
+      stall_seconds (0),
+      stopping (false) {
+    start(epochs, first_sample, prefetch, 1);
+  }
+
+  template <typename T>
+  data_loader <T>::~data_loader () {
+    stopping.store(true);
+
+    // wakes every producer still waiting for a slot
+    for (int i = 0; i < slot_count; ++i) {
+      slots[i].writable.store(-1);
+      slots[i].writable.notify_all();
+    }
+    for (auto& producer : producers)
+      producer.join();
+  }
+
+  // Seconds next() has spent waiting for a batch the producers had not assembled yet
+  template <typename T>
+  double data_loader <T>::get_stall_seconds () const {
+    return stall_seconds;
+  }
+
+  /**
+   * @brief Releases the previous batch to the producers and waits for the next one. Rethrows
+   *        any error met while assembling it.
+   *
+   * @return false once every batch has been handed out
+   */
+  template <typename T>
+  bool data_loader <T>::next (batch& result) {
+    if (consumed >= 0) {
+      slot& previous = slots[consumed % slot_count];
+      previous.writable.store(consumed + slot_count, std::memory_order_release);
+      previous.writable.notify_all();
+    }
+
+    if (++consumed >= batch_count)
+      return false;
+
+    slot& current = slots[consumed % slot_count];
+
+    if (current.ready.load(std::memory_order_acquire) != consumed) {
+      const auto start = std::chrono::steady_clock::now();
+      wait_for(current.ready, consumed);
+      stall_seconds += std::chrono::duration <double> (std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (current.error)
+      std::rethrow_exception(current.error);
+
+    result = current.contents;
+    return true;
+  }
+
+  // Widens the samples of `contents` into `target`, from the dataset or the next ones of the stream
+  template <typename T>
+  void data_loader <T>::assemble (producer_state& state, slot& target, batch& contents) {
+    if (data) {
+      if (state.epoch != contents.epoch) {
+        order.fill(contents.epoch, state.indices);
+        state.epoch = contents.epoch;
+      }
+
+      const std::span <const int> samples (state.indices.data() + contents.first, contents.rows);
+      state.augment.widen(*data, samples, contents.epoch, target.values.get());
+      for (int r = 0; r < contents.rows; ++r)
+        target.labels[r] = data->get_label(samples[r]);
+      return;
+    }
+
+    if (not state.reader) {
+      state.reader = std::make_unique <shard_stream::reader> (*stream);
+      state.chunk = dataset(batch_size, stream->get_height(), stream->get_width());
+      state.chunk.set_scale(stream->get_scale());
+      state.identities.resize(batch_size);
+    }
+
+    // the batches of a stream come in order, so an epoch only starts elsewhere than at its
+    // first sample when a run resumes
+    if (state.epoch != contents.epoch) {
+      state.reader->start(contents.epoch, order.get_mode(), order.get_seed());
+      state.reader->skip(contents.first);
+      state.epoch = contents.epoch;
+    }
+
+    const std::span <std::uint64_t> identities (state.identities.data(), contents.rows);
+    if (state.reader->read(state.chunk, identities) != (std::size_t)contents.rows)
+      throw std::runtime_error("a shard changed while it was streamed");
+
+    state.augment.widen(state.chunk, std::span <const std::uint64_t> (identities), contents.epoch, target.values.get());
+    for (int r = 0; r < contents.rows; ++r)
+      target.labels[r] = state.chunk.get_label(r);
+  }
+
+  // Epoch and position in the order of that epoch of the `index`-th batch
+  template <typename T>
+  typename data_loader <T>::batch data_loader <T>::locate (long index) const {
+    batch result {};
+
+    if (index < first_batches) {
+      result.epoch = first_epoch;
+      result.first = first_sample + index * batch_size;
+    }
+    else {
+      result.epoch = first_epoch + 1 + (index - first_batches) / epoch_batches;
+      result.first = (index - first_batches) % epoch_batches * batch_size;
+    }
+    result.rows = std::min <long> (batch_size, (long)size - result.first);
+
+    return result;
+  }
+
+  template <typename T>
+  void data_loader <T>::produce (int producer, int thread_count) {
+    // every producer draws the order of the epochs it works on, rather than share them, and
+    // transforms images in a buffer of its own
+    producer_state state (augmentations);
+
+    for (long index = producer; index < batch_count; index += thread_count) {
+      slot& target = slots[index % slot_count];
+
+      if (not wait_for(target.writable, index))
+        return;
+
+      try {
+        batch contents = locate(index);
+        assemble(state, target, contents);
+
+        contents.values = target.values.get();
+        contents.labels = target.labels.data();
+        target.contents = contents;
+      }
+      catch (...) {
+        target.error = std::current_exception();
+      }
+
+      target.ready.store(index, std::memory_order_release);
+      target.ready.notify_one();
+    }
+  }
+
+  /**
+   * @brief Allocates the slots and starts the producers
+   */
+  template <typename T>
+  void data_loader <T>::start (int epochs, int first_sample, int prefetch, int thread_count) {
+    if (batch_size < 1)
+      throw std::runtime_error("batch size must be positive");
+    if (prefetch < 1 or thread_count < 1)
+      throw std::runtime_error("a data loader needs at least one batch of prefetch and one thread");
+
+    first_batches = first_sample < (long)size ? (size - first_sample + batch_size - 1) / batch_size : 0;
+    epoch_batches = (size + batch_size - 1) / batch_size;
+    batch_count = epochs > first_epoch and size > 0 ? first_batches + (epochs - first_epoch - 1) * epoch_batches : 0;
+
+    slots.reset(new slot [slot_count]);
+    for (int i = 0; i < slot_count; ++i) {
+      slots[i].writable.store(i, std::memory_order_relaxed);
+      slots[i].ready.store(-1, std::memory_order_relaxed);
+      slots[i].values.reset((T*)::operator new[]((std::size_t)batch_size * sample_size * sizeof(T),
+                                                 std::align_val_t(alignment)));
+      slots[i].labels.resize(batch_size);
+    }
+
+    for (int p = 0; p < std::min <long> (thread_count, batch_count); ++p)
+      producers.emplace_back(&data_loader::produce, this, p, thread_count);
+  }
+
+  /**
+   * @brief Blocks until `sequence` holds `value`
+   *
+   * @return false if the loader stopped first
+   */
+  template <typename T>
+  bool data_loader <T>::wait_for (std::atomic <long>& sequence, long value) const {
+    for (long current = sequence.load(std::memory_order_acquire); current != value;
+         current = sequence.load(std::memory_order_acquire)) {
+      if (stopping.load())
+        return false;
+      sequence.wait(current, std::memory_order_acquire);
+    }
+    return true;
+  }
+
+} // namespace fmc
+
+#endif // FMC_DATA_LOADER_HPP
@@ -0,0 +1,206 @@
+// Arrow
+
+#ifndef FMC_DATASET_HPP
+#define FMC_DATASET_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "kernel.hpp"
+#include "matrix.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief labelled 8-bit images, stored as one contiguous (count x height x width) buffer of
+   *        bytes
+   *
+   * A byte per pixel is all the images hold, so that is all they take: 60,000 Fashion-MNIST
+   * images fit in 47 MB. Samples are converted to the type a network computes in only when
+   * they are copied into a batch, by widen(), which multiplies them by `scale` on the way;
+   * normalizing a dataset is then a matter of setting the scale.
+   */
+  class dataset {
+    private:
+      int height;
+      int width;
+      double scale;
+      std::vector <std::uint8_t> values;
+      std::vector <int> labels;
+
+    public:
+      dataset ();
+      dataset (std::size_t, int, int);
+
+      std::uint8_t*                  data            ();
+      const std::uint8_t*            data            () const;
+      int                            get_height      () const;
+      int                            get_label       (std::size_t) const;
+      const std::vector <int>&       get_labels      () const;
+      std::size_t                    get_sample_size () const;
+      double                         get_scale       () const;
+      int                            get_width       () const;
+      std::span <std::uint8_t>       sample          (std::size_t);
+      std::span <const std::uint8_t> sample          (std::size_t) const;
+      void                           set_label       (std::size_t, int);
+      void                           set_scale       (double);
+      std::size_t                    size            () const;
+      dataset                        split           (std::size_t);
+
+      template <typename T> matrix <T> to_matrix (std::size_t) const;
+      template <typename T> void       widen     (std::size_t, int, T*) const;
+      template <typename T> void       widen     (std::span <const int>, T*) const;
+  };
+
+  inline dataset::dataset ()
+    : height (0),
+      width (0),
+      scale (1)
+  { }
+
+  /**
+   * @brief `count` black images of `height` x `width` pixels, all labelled 0
+   */
+  inline dataset::dataset (std::size_t count, int height, int width)
+    : height (height),
+      width (width),
+      scale (1),
+      values (count * height * width),
+      labels (count)
+  { }
+
+  inline std::uint8_t* dataset::data () {
+    return values.data();
+  }
+
+  inline const std::uint8_t* dataset::data () const {
+    return values.data();
+  }
+
+  inline int dataset::get_height () const {
+    return height;
+  }
+
+  inline int dataset::get_label (std::size_t index) const {
+    return labels[index];
+  }
+
+  inline const std::vector <int>& dataset::get_labels () const {
+    return labels;
+  }
+
+  inline std::size_t dataset::get_sample_size () const {
+    return (std::size_t)height * width;
+  }
+
+  inline double dataset::get_scale () const {
+    return scale;
+  }
+
+  inline int dataset::get_width () const {
+    return width;
+  }
+
+  inline std::span <std::uint8_t> dataset::sample (std::size_t index) {
+#ifdef DEBUG_MODE
+    if (index >= size())
+      throw std::runtime_error("out of bounds access will occur with provided index");
+#endif
+
+    return {values.data() + index * get_sample_size(), get_sample_size()};
+  }
+
+  inline std::span <const std::uint8_t> dataset::sample (std::size_t index) const {
+#ifdef DEBUG_MODE
+    if (index >= size())
+      throw std::runtime_error("out of bounds access will occur with provided index");
+#endif
+
+    return {values.data() + index * get_sample_size(), get_sample_size()};
+  }
+
+  inline void dataset::set_label (std::size_t index, int label) {
+    labels[index] = label;
+  }
+
+  /**
+   * @brief Sets the factor every pixel is multiplied by when it is widened, e.g. 1 / 255 to
+   *        train on values between 0 and 1
+   */
+  inline void dataset::set_scale (double scale) {
+    this->scale = scale;
+  }
+
+  inline std::size_t dataset::size () const {
+    return labels.size();
+  }
+
+  /**
+   * @brief Moves the samples from `first` on into a new dataset with the same shape and scale,
+   *        and keeps the ones before
+   */
+  inline dataset dataset::split (std::size_t first) {
+    if (first > size())
+      throw std::runtime_error("cannot split a dataset past its end");
+
+    dataset tail (size() - first, height, width);
+    tail.scale = scale;
+
+    std::copy(values.begin() + first * get_sample_size(), values.end(), tail.values.begin());
+    std::copy(labels.begin() + first, labels.end(), tail.labels.begin());
+    values.resize(first * get_sample_size());
+    labels.resize(first);
+
+    return tail;
+  }
+
+  /**
+   * @brief The `index`-th sample as a (1 x height * width) matrix, scaled
+   */
+  template <typename T>
+  matrix <T> dataset::to_matrix (std::size_t index) const {
+    matrix <T> result (1, get_sample_size());
+    widen(index, 1, result.data());
+    return result;
+  }
+
+  /**
+   * @brief Writes `rows` samples starting at `first`, scaled and converted to T, into the
+   *        contiguous (rows x height * width) buffer `out`
+   */
+  template <typename T>
+  void dataset::widen (std::size_t first, int rows, T* out) const {
+#ifdef DEBUG_MODE
+    if (first + rows > size())
+      throw std::runtime_error("out of bounds access will occur with provided index");
+#endif
+
+    // the samples are contiguous, so a batch converts as a single run
+    kernel::widen(values.data() + first * get_sample_size(), out, rows * get_sample_size(), (T)scale);
+  }
+
+  /**
+   * @brief Writes the samples at `indices`, scaled and converted to T, into the contiguous
+   *        (indices.size() x height * width) buffer `out`, e.g. a shuffled batch
+   */
+  template <typename T>
+  void dataset::widen (std::span <const int> indices, T* out) const {
+    const std::size_t sample_size = get_sample_size();
+
+    for (std::size_t r = 0; r < indices.size(); ++r) {
+#ifdef DEBUG_MODE
+      if (indices[r] < 0 or (std::size_t)indices[r] >= size())
+        throw std::runtime_error("out of bounds access will occur with provided index");
+#endif
+
+      kernel::widen(values.data() + indices[r] * sample_size, out + r * sample_size, sample_size, (T)scale);
+    }
+  }
+
+} // namespace fmc
+
+#endif // FMC_DATASET_HPP
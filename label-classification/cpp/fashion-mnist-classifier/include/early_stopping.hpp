@@ -0,0 +1,154 @@
+// Arrow
+
+#ifndef FMC_EARLY_STOPPING_HPP
+#define FMC_EARLY_STOPPING_HPP
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <utility>
+
+#include "checkpoint.hpp"
+#include "inference.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief validates a network at the end of every epoch without stopping training
+   *
+   * At the end of an epoch fit fills snapshot() with its training state and passes a frozen
+   * copy of the network to evaluate(), which measures its accuracy with `validate` on a
+   * background thread while the next epoch trains. poll() folds a finished evaluation in and
+   * reports when the accuracy has not improved by more than `min_delta` percentage points for
+   * `patience` epochs in a row; a patience of zero never stops. The training state of the best
+   * epoch is kept so that fit can put it back when it returns.
+   *
+   * @tparam T type of the weights and activations
+   */
+  template <typename T>
+  class early_stopping {
+    public:
+      using validator = std::function <evaluation_result (const inference_model <T>&)>;
+
+    private:
+      validator validate;
+      int patience;
+      double min_delta;
+
+      std::future <evaluation_result> pending;
+      int pending_epoch;
+      training_state <T> candidate;
+      training_state <T> best;
+      long double best_accuracy;
+      int best_epoch;
+      int epochs_without_improvement;
+
+    public:
+      early_stopping (const validator&, int, double);
+
+      const training_state <T>* best_state () const;
+      void                      evaluate   (inference_model <T>&&, int);
+      bool                      finish     ();
+      bool                      poll       ();
+      training_state <T>&       snapshot   ();
+
+    private:
+      void fold        ();
+      bool should_stop () const;
+  };
+
+  template <typename T>
+  early_stopping <T>::early_stopping (const validator& validate, int patience, double min_delta)
+    : validate (validate),
+      patience (patience),
+      min_delta (min_delta),
+      pending_epoch (0),
+      best_accuracy (-1),
+      best_epoch (0),
+      epochs_without_improvement (0)
+  { }
+
+  /**
+   * @brief Training state at the end of the most accurate epoch so far, or null before the
+   *        first evaluation has finished
+   */
+  template <typename T>
+  const training_state <T>* early_stopping <T>::best_state () const {
+    return best_epoch > 0 ? &best : nullptr;
+  }
+
+  /**
+   * @brief Starts validating `model`, frozen at the end of `epoch` (counted from one), on a
+   *        background thread. The state passed to snapshot() must belong to the same epoch.
+   */
+  template <typename T>
+  void early_stopping <T>::evaluate (inference_model <T>&& model, int epoch) {
+    pending_epoch = epoch;
+    pending = std::async(std::launch::async, [this, model = std::move(model)] () {
+      return validate(model);
+    });
+  }
+
+  /**
+   * @brief Waits for the last evaluation
+   *
+   * @return whether training should have stopped
+   */
+  template <typename T>
+  bool early_stopping <T>::finish () {
+    fold();
+    return should_stop();
+  }
+
+  /**
+   * @brief Takes in the last evaluation if it has finished; never blocks
+   *
+   * @return whether training should stop
+   */
+  template <typename T>
+  bool early_stopping <T>::poll () {
+    if (pending.valid() and pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+      fold();
+    return should_stop();
+  }
+
+  /**
+   * @brief Buffer for the training state of the epoch about to be evaluated. Waits for the
+   *        previous evaluation, which may still need its buffer.
+   */
+  template <typename T>
+  training_state <T>& early_stopping <T>::snapshot () {
+    fold();
+    return candidate;
+  }
+
+  template <typename T>
+  void early_stopping <T>::fold () {
+    if (not pending.valid())
+      return;
+
+    const evaluation_result result = pending.get();
+    const bool improved = result.accuracy > best_accuracy + min_delta;
+
+    std::cout << "[*] Validation accuracy after epoch " << pending_epoch << ": " << result.accuracy << '%'
+              << (improved ? " (best)" : "") << std::endl;
+
+    if (improved) {
+      std::swap(best, candidate);
+      best_accuracy = result.accuracy;
+      best_epoch = pending_epoch;
+      epochs_without_improvement = 0;
+    }
+    else
+      ++epochs_without_improvement;
+  }
+
+  template <typename T>
+  bool early_stopping <T>::should_stop () const {
+    return patience > 0 and epochs_without_improvement >= patience;
+  }
+
+} // namespace fmc
+
+#endif // FMC_EARLY_STOPPING_HPP
@@ -0,0 +1,110 @@
+// Arrow
+
+#ifndef FMC_IDX_HPP
+#define FMC_IDX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief memory-mapped IDX file of unsigned bytes, the format the original MNIST and
+   *        Fashion-MNIST archives ship in (once decompressed)
+   *
+   * The header is a big-endian magic number, 0x0000 0x08 followed by the number of
+   * dimensions, then one big-endian u32 per dimension. The values follow as raw bytes, so an
+   * item (an image, or a label) is a view straight into the mapping: nothing is parsed or
+   * copied. `train-images-idx3-ubyte` has dimensions {count, 28, 28} and
+   * `train-labels-idx1-ubyte` {count}.
+   */
+  class idx_file {
+    private:
+      static const std::uint8_t ubyte = 0x08;
+
+      mapped_file file;
+      std::vector <std::size_t> dimensions;
+      std::span <const std::uint8_t> values;
+      std::size_t item_size = 1;
+
+    public:
+      idx_file (const std::string&, int);
+
+      std::span <const std::uint8_t>   data           () const;
+      const std::vector <std::size_t>& get_dimensions () const;
+      std::size_t                      get_item_size  () const;
+      std::span <const std::uint8_t>   item           (std::size_t) const;
+      std::size_t                      item_count     () const;
+
+    private:
+      static std::uint32_t get_u32 (const std::uint8_t*);
+  };
+
+  /**
+   * @brief Maps `path` and checks that it is an IDX file of unsigned bytes with `rank`
+   *        dimensions whose size matches its header exactly
+   */
+  inline idx_file::idx_file (const std::string& path, int rank)
+    : file (path) {
+    const std::span <const std::uint8_t> bytes = file.bytes();
+    const std::size_t header_size = 4 + 4 * (std::size_t)rank;
+
+    if (bytes.size() < header_size or bytes[0] != 0 or bytes[1] != 0 or bytes[2] != ubyte or bytes[3] != rank)
+      throw std::runtime_error("\"" + path + "\" is not an IDX file of unsigned bytes with " + std::to_string(rank)
+                               + " dimensions");
+
+    std::size_t total = 1;
+    for (int i = 0; i < rank; ++i) {
+      dimensions.push_back(get_u32(bytes.data() + 4 + 4 * i));
+      total *= dimensions.back();
+      if (i > 0)
+        item_size *= dimensions.back();
+    }
+
+    if (bytes.size() != header_size + total)
+      throw std::runtime_error("\"" + path + "\" holds " + std::to_string(bytes.size() - header_size)
+                               + " values but its header describes " + std::to_string(total));
+
+    values = bytes.subspan(header_size);
+  }
+
+  // Every value of the file, items back to back
+  inline std::span <const std::uint8_t> idx_file::data () const {
+    return values;
+  }
+
+  inline const std::vector <std::size_t>& idx_file::get_dimensions () const {
+    return dimensions;
+  }
+
+  inline std::size_t idx_file::get_item_size () const {
+    return item_size;
+  }
+
+  inline std::size_t idx_file::item_count () const {
+    return dimensions.front();
+  }
+
+  // Values of the `index`-th item, e.g. the 784 pixels of an image
+  inline std::span <const std::uint8_t> idx_file::item (std::size_t index) const {
+#ifdef DEBUG_MODE
+    if (index >= item_count())
+      throw std::runtime_error("out of bounds access will occur with provided index");
+#endif
+
+    return values.subspan(index * item_size, item_size);
+  }
+
+  inline std::uint32_t idx_file::get_u32 (const std::uint8_t* data) {
+    return (std::uint32_t)data[0] << 24 | (std::uint32_t)data[1] << 16 | (std::uint32_t)data[2] << 8 | (std::uint32_t)data[3];
+  }
+
+} // namespace fmc
+
+#endif // FMC_IDX_HPP
@@ -0,0 +1,643 @@
+// Arrow
+
+#ifndef FMC_INFERENCE_HPP
+#define FMC_INFERENCE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "conv.hpp"
+#include "dataset.hpp"
+#include "kernel.hpp"
+#include "matrix.hpp"
+#include "utils.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief summary of a model evaluation over a labelled dataset
+   */
+  struct evaluation_result {
+    int total_count = 0;
+    int correct_count = 0;
+    long double accuracy = 0;
+    std::vector <int> class_total;
+    std::vector <int> class_correct;
+    double elapsed_seconds = 0;
+    double throughput = 0;
+  };
+
+  /**
+   * @brief immutable, inference-only form of a trained network
+   *
+   * Holds nothing but packed weights, biases and the activation of every layer. All
+   * member functions are const and every intermediate value lives in a caller-owned
+   * scratch buffer, so any number of threads can share one model without locking.
+   *
+   * @tparam T type of the weights and activations
+   */
+  template <typename T>
+  class inference_model {
+    public:
+      using ActivationFunc = T (*) (const T&);
+
+      static const int default_batch_size = 32;
+
+      /**
+       * @brief working memory for forward passes over up to `batch_size` inputs at once; one per thread
+       */
+      class scratch {
+        private:
+          int batch_size = 0;
+          std::vector <T> tile;
+          std::vector <T> front;
+          std::vector <T> back;
+          std::vector <T> columns;
+
+        public:
+          scratch () = default;
+          scratch (int, int, int = default_batch_size, int = 0);
+
+          void reserve (int, int, int = default_batch_size, int = 0);
+
+          friend class inference_model;
+      };
+
+    private:
+      struct stage {
+        int inputs;
+        int outputs;
+        std::size_t weight_offset;
+        std::size_t bias_offset;
+        activation::kind kind;
+        ActivationFunc function;
+        approximate::precision precision;
+        layer_type type;
+        conv2d_shape convolution;
+        pool2d_shape pooling;
+      };
+
+      int input_size;
+      int max_width;
+      int max_columns;
+      std::vector <T> weights;
+      std::vector <T> biases;
+      std::vector <stage> stages;
+
+    public:
+      inference_model ();
+
+      void add_stage (const matrix <T>&, const matrix <T>&, ActivationFunc);
+      void add_stage (const matrix <T>&, const matrix <T>&, activation::kind, ActivationFunc = nullptr,
+                      approximate::precision = approximate::precision::exact);
+      void add_stage (const matrix <T>&, const matrix <T>&, const conv2d_shape&, activation::kind,
+                      ActivationFunc = nullptr, approximate::precision = approximate::precision::exact);
+      void add_stage (layer_type, const pool2d_shape&);
+
+      int     get_input_size  () const;
+      int     get_output_size () const;
+      int     get_stage_count () const;
+      scratch make_scratch    (int = default_batch_size) const;
+
+      evaluation_result   evaluate            (const std::vector <matrix <T>>&, const std::vector <int>&, int = 0) const;
+      evaluation_result   evaluate            (const dataset&, int = 0) const;
+      int                 predict             (std::span <const T>, scratch&) const;
+      int                 predict             (const matrix <T>&, scratch&) const;
+      int                 predict             (const matrix <T>&) const;
+      void                predict_batch       (std::span <const matrix <T>>, std::span <int>, scratch&) const;
+      void                predict_batch       (std::span <const matrix <T>>, std::span <int>) const;
+      void                predict_batch       (const dataset&, std::size_t, std::span <int>, scratch&) const;
+      std::span <const T> predict_proba       (std::span <const T>, scratch&) const;
+      void                predict_proba_batch (std::span <const matrix <T>>, std::span <T>, scratch&) const;
+      void                predict_proba_batch (std::span <const matrix <T>>, std::span <T>) const;
+      void                predict_proba_batch (std::span <const T>, std::span <T>, scratch&) const;
+      void                save                (const std::string&) const;
+
+    private:
+      void     append        (stage, const matrix <T>&, const matrix <T>&);
+      const T* forward_tile  (const T*, int, scratch&) const;
+      void     forward       (const stage&, const T*, T*, T*, int) const;
+      scratch& local_scratch () const;
+
+      template <typename Predict>
+      evaluation_result score (const std::vector <int>&, int, Predict) const;
+  };
+
+  template <typename T>
+  inference_model <T>::scratch::scratch (int input_size, int width, int batch_size, int column_width) {
+    reserve(input_size, width, batch_size, column_width);
+  }
+
+  // `column_width` is the size of the largest unrolled convolution input of one sample
+  template <typename T>
+  void inference_model <T>::scratch::reserve (int input_size, int width, int batch_size_, int column_width) {
+    batch_size = std::max(batch_size, batch_size_);
+    if (tile.size() < (std::size_t)batch_size * input_size)
+      tile.resize((std::size_t)batch_size * input_size);
+    if (front.size() < (std::size_t)batch_size * width) {
+      front.resize((std::size_t)batch_size * width);
+      back.resize((std::size_t)batch_size * width);
+    }
+    if (columns.size() < (std::size_t)batch_size * column_width)
+      columns.resize((std::size_t)batch_size * column_width);
+  }
+
+  template <typename T>
+  inference_model <T>::inference_model ()
+    : input_size (0),
+      max_width (0),
+      max_columns (0)
+  { }
+
+  /**
+   * @brief Appends a layer to the model by packing its weights and bias
+   *
+   * @tparam T type of the weights and activations
+   * @param weight (inputs x outputs) weight matrix of the layer
+   * @param bias (1 x outputs) bias of the layer
+   * @param function activation function of the layer
+   */
+  template <typename T>
+  void inference_model <T>::add_stage (const matrix <T>& weight, const matrix <T>& bias, ActivationFunc function) {
+    add_stage(weight, bias, activation::kind_of(function), function);
+  }
+
+  /**
+   * @brief Appends a stage whose activation is identified by its kind; `function` is only
+   *        needed for activation::kind::custom
+   */
+  template <typename T>
+  void inference_model <T>::add_stage (const matrix <T>& weight, const matrix <T>& bias, activation::kind kind,
+                                       ActivationFunc function, approximate::precision precision) {
+    append({weight.get_rows(), weight.get_cols(), 0, 0, kind, function, precision, layer_type::dense, conv2d_shape {},
+            pool2d_shape {}}, weight, bias);
+  }
+
+  /**
+   * @brief Appends a convolution stage with (patch_size x filters) weights and (1 x filters)
+   *        bias; its inputs and outputs are whole channels-last images
+   */
+  template <typename T>
+  void inference_model <T>::add_stage (const matrix <T>& weight, const matrix <T>& bias, const conv2d_shape& shape,
+                                       activation::kind kind, ActivationFunc function,
+                                       approximate::precision precision) {
+    if (not shape.valid() or weight.get_rows() != shape.patch_size() or weight.get_cols() != shape.filters)
+      throw std::runtime_error("weight does not match the convolution shape");
+
+    append({shape.input_size(), shape.output_size(), 0, 0, kind, function, precision, layer_type::conv2d, shape,
+            pool2d_shape {}}, weight, bias);
+    max_columns = std::max(max_columns, shape.positions() * shape.patch_size());
+  }
+
+  /**
+   * @brief Appends a max or average pooling stage; it has no weights
+   */
+  template <typename T>
+  void inference_model <T>::add_stage (layer_type type, const pool2d_shape& shape) {
+    if (type != layer_type::maxpool2d and type != layer_type::avgpool2d)
+      throw std::runtime_error("pooling stage needs a pooling layer type");
+    if (not shape.valid())
+      throw std::runtime_error("invalid pooling shape");
+
+    append({shape.input_size(), shape.output_size(), 0, 0, activation::kind::identity, nullptr,
+            approximate::precision::exact, type, conv2d_shape {}, shape}, matrix <T> (0, 0), matrix <T> (1, 0));
+  }
+
+  template <typename T>
+  void inference_model <T>::append (stage s, const matrix <T>& weight, const matrix <T>& bias) {
+    const std::size_t weight_count = (std::size_t)weight.get_rows() * weight.get_cols();
+
+    if (not stages.empty() and stages.back().outputs != s.inputs)
+      throw std::runtime_error("stage inputs do not match the outputs of the previous stage");
+    if (bias.get_rows() != 1 or bias.get_cols() != weight.get_cols())
+      throw std::runtime_error("bias does not match the number of stage outputs");
+
+    if (stages.empty()) {
+      input_size = s.inputs;
+      max_width = s.inputs;
+    }
+
+    if (s.kind == activation::kind::custom and s.function == nullptr)
+      throw std::runtime_error("custom activation stage needs an activation function");
+
+    s.weight_offset = weights.size();
+    s.bias_offset = biases.size();
+
+    weights.insert(weights.end(), weight.data(), weight.data() + weight_count);
+    biases.insert(biases.end(), bias.data(), bias.data() + bias.get_cols());
+
+    stages.push_back(s);
+    max_width = std::max(max_width, s.outputs);
+  }
+
+  template <typename T>
+  int inference_model <T>::get_input_size () const {
+    return input_size;
+  }
+
+  template <typename T>
+  int inference_model <T>::get_output_size () const {
+    return stages.empty() ? input_size : stages.back().outputs;
+  }
+
+  template <typename T>
+  int inference_model <T>::get_stage_count () const {
+    return stages.size();
+  }
+
+  template <typename T>
+  typename inference_model <T>::scratch inference_model <T>::make_scratch (int batch_size) const {
+    return scratch (input_size, max_width, batch_size, max_columns);
+  }
+
+  /**
+   * @brief Scores a labelled dataset, sharding it across `thread_count` threads
+   *
+   * @tparam T type of the weights and activations
+   * @param data (1 x input_size) inputs
+   * @param labels expected label of every input
+   * @param thread_count number of threads to use; 0 uses every hardware thread
+   * @return evaluation_result accuracy, per-class counts, elapsed time and throughput
+   */
+  template <typename T>
+  evaluation_result inference_model <T>::evaluate (const std::vector <matrix <T>>& data, const std::vector <int>& labels,
+                                                   int thread_count) const {
+#ifdef DEBUG_MODE
+    if (data.size() != labels.size())
+      throw std::runtime_error("data and labels must have same size");
+#endif
+
+    return score(labels, thread_count, [&] (int first, std::span <int> predictions, scratch& buffer) {
+      predict_batch(std::span <const matrix <T>> (data.data() + first, predictions.size()), predictions, buffer);
+    });
+  }
+
+  /**
+   * @brief Same as evaluate but reads the samples and labels of a dataset, widened straight
+   *        into the scratch tiles
+   */
+  template <typename T>
+  evaluation_result inference_model <T>::evaluate (const dataset& data, int thread_count) const {
+    return score(data.get_labels(), thread_count, [&] (int first, std::span <int> predictions, scratch& buffer) {
+      predict_batch(data, first, predictions, buffer);
+    });
+  }
+
+  template <typename T>
+  int inference_model <T>::predict (std::span <const T> input, scratch& buffer) const {
+    std::span <const T> output = predict_proba(input, buffer);
+    return std::max_element(output.begin(), output.end()) - output.begin();
+  }
+
+  template <typename T>
+  int inference_model <T>::predict (const matrix <T>& input, scratch& buffer) const {
+    return predict(std::span <const T> (input[0]), buffer);
+  }
+
+  /**
+   * @brief Same as predict (input, scratch) but uses a scratch buffer owned by the calling
+   *        thread. The buffer is allocated on the first call of each thread only.
+   */
+  template <typename T>
+  int inference_model <T>::predict (const matrix <T>& input) const {
+    return predict(std::span <const T> (input[0]), local_scratch());
+  }
+
+  /**
+   * @brief Predicts the label of every input, packing them into tiles of up to the scratch
+   *        batch size so that each layer runs as one GEMM per tile instead of one GEMV per input
+   *
+   * @tparam T type of the weights and activations
+   * @param inputs (1 x input_size) inputs
+   * @param labels output; receives one label per input
+   * @param buffer scratch buffer, grown to fit this model if it is too small
+   */
+  template <typename T>
+  void inference_model <T>::predict_batch (std::span <const matrix <T>> inputs, std::span <int> labels,
+                                           scratch& buffer) const {
+#ifdef DEBUG_MODE
+    if (labels.size() < inputs.size())
+      throw std::runtime_error("labels must have room for every input");
+#endif
+
+    // a default or smaller scratch would leave no room for a tile of this model
+    buffer.reserve(input_size, max_width, 1, max_columns);
+
+    int output_size = get_output_size();
+
+    for (std::size_t first = 0; first < inputs.size(); first += buffer.batch_size) {
+      int rows = std::min <std::size_t> (buffer.batch_size, inputs.size() - first);
+
+      for (int r = 0; r < rows; ++r)
+        std::copy(inputs[first + r].data(), inputs[first + r].data() + input_size, buffer.tile.begin() + (std::size_t)r * input_size);
+
+      const T* output = forward_tile(buffer.tile.data(), rows, buffer);
+
+      for (int r = 0; r < rows; ++r) {
+        const T* row = output + (std::size_t)r * output_size;
+        labels[first + r] = std::max_element(row, row + output_size) - row;
+      }
+    }
+  }
+
+  template <typename T>
+  void inference_model <T>::predict_batch (std::span <const matrix <T>> inputs, std::span <int> labels) const {
+    predict_batch(inputs, labels, local_scratch());
+  }
+
+  /**
+   * @brief Same as predict_batch but reads `labels.size()` samples of a dataset from `first`
+   *        on, widening them from bytes straight into the scratch tile
+   */
+  template <typename T>
+  void inference_model <T>::predict_batch (const dataset& data, std::size_t first, std::span <int> labels,
+                                           scratch& buffer) const {
+#ifdef DEBUG_MODE
+    if ((int)data.get_sample_size() != input_size)
+      throw std::runtime_error("samples do not match the model input size");
+#endif
+
+    buffer.reserve(input_size, max_width, 1, max_columns);
+
+    int output_size = get_output_size();
+
+    for (std::size_t done = 0; done < labels.size(); done += buffer.batch_size) {
+      int rows = std::min <std::size_t> (buffer.batch_size, labels.size() - done);
+
+      data.widen(first + done, rows, buffer.tile.data());
+      const T* output = forward_tile(buffer.tile.data(), rows, buffer);
+
+      for (int r = 0; r < rows; ++r) {
+        const T* row = output + (std::size_t)r * output_size;
+        labels[done + r] = std::max_element(row, row + output_size) - row;
+      }
+    }
+  }
+
+  /**
+   * @brief Runs a forward pass and returns the activations of the output layer
+   *
+   * @tparam T type of the weights and activations
+   * @param input (1 x input_size) values fed to the first layer
+   * @param buffer scratch buffer, grown to fit this model if it is too small
+   * @return std::span <const T> output activations; valid until `buffer` is reused
+   */
+  template <typename T>
+  std::span <const T> inference_model <T>::predict_proba (std::span <const T> input, scratch& buffer) const {
+#ifdef DEBUG_MODE
+    if ((int)input.size() != input_size)
+      throw std::runtime_error("input size does not match the model input size");
+#endif
+
+    buffer.reserve(input_size, max_width, 1, max_columns);
+
+    return std::span <const T> (forward_tile(input.data(), 1, buffer), get_output_size());
+  }
+
+  /**
+   * @brief Same as predict_batch but writes the (inputs x output_size) output activations,
+   *        row after row, instead of the labels
+   */
+  template <typename T>
+  void inference_model <T>::predict_proba_batch (std::span <const matrix <T>> inputs, std::span <T> probabilities,
+                                                 scratch& buffer) const {
+    int output_size = get_output_size();
+
+#ifdef DEBUG_MODE
+    if (probabilities.size() < inputs.size() * output_size)
+      throw std::runtime_error("probabilities must have room for every output of every input");
+#endif
+
+    buffer.reserve(input_size, max_width, 1, max_columns);
+
+    for (std::size_t first = 0; first < inputs.size(); first += buffer.batch_size) {
+      int rows = std::min <std::size_t> (buffer.batch_size, inputs.size() - first);
+
+      for (int r = 0; r < rows; ++r)
+        std::copy(inputs[first + r].data(), inputs[first + r].data() + input_size, buffer.tile.begin() + (std::size_t)r * input_size);
+
+      const T* output = forward_tile(buffer.tile.data(), rows, buffer);
+      std::copy(output, output + (std::size_t)rows * output_size, probabilities.begin() + first * output_size);
+    }
+  }
+
+  template <typename T>
+  void inference_model <T>::predict_proba_batch (std::span <const matrix <T>> inputs, std::span <T> probabilities) const {
+    predict_proba_batch(inputs, probabilities, local_scratch());
+  }
+
+  /**
+   * @brief Same as predict_proba_batch but reads the inputs from one contiguous
+   *        (count x input_size) buffer, which saves packing them into the scratch tile
+   */
+  template <typename T>
+  void inference_model <T>::predict_proba_batch (std::span <const T> inputs, std::span <T> probabilities,
+                                                 scratch& buffer) const {
+    int output_size = get_output_size();
+    std::size_t count = inputs.size() / input_size;
+
+#ifdef DEBUG_MODE
+    if (inputs.size() % input_size != 0)
+      throw std::runtime_error("inputs must hold a whole number of rows");
+    if (probabilities.size() < count * output_size)
+      throw std::runtime_error("probabilities must have room for every output of every input");
+#endif
+
+    buffer.reserve(input_size, max_width, 1, max_columns);
+
+    for (std::size_t first = 0; first < count; first += buffer.batch_size) {
+      int rows = std::min <std::size_t> (buffer.batch_size, count - first);
+      const T* output = forward_tile(inputs.data() + first * input_size, rows, buffer);
+      std::copy(output, output + (std::size_t)rows * output_size, probabilities.begin() + first * output_size);
+    }
+  }
+
+  /**
+   * @brief Writes the weights and biases of every stage in the model file format of network::save,
+   *        numbering the stages from 1. Pooling stages have nothing to write; batch normalizations
+   *        were already folded by network::freeze, so the file loads into the same topology
+   *        without them.
+   */
+  template <typename T>
+  void inference_model <T>::save (const std::string& filepath) const {
+    std::cout << "[*] Saving inference model to \"" << filepath << "\"" << std::endl;
+
+    std::ofstream file (filepath);
+    file << std::fixed << std::setprecision(20);
+
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+      const stage& s = stages[i];
+      if (s.type == layer_type::maxpool2d or s.type == layer_type::avgpool2d)
+        continue;
+
+      const bool unrolled = s.type == layer_type::conv2d;
+      const int rows = unrolled ? s.convolution.patch_size() : s.inputs;
+      const int cols = unrolled ? s.convolution.filters : s.outputs;
+      matrix <T> weight (rows, cols);
+      matrix <T> bias (1, cols);
+
+      std::copy(weights.data() + s.weight_offset, weights.data() + s.weight_offset + (std::size_t)rows * cols, weight.data());
+      std::copy(biases.data() + s.bias_offset, biases.data() + s.bias_offset + cols, bias.data());
+
+      file << "[layer " << i + 1 << " bias]\n";
+      file << bias << '\n';
+      file << "[layer " << i + 1 << " weight]\n";
+      file << weight << '\n';
+    }
+
+    file.close();
+  }
+
+  template <typename T>
+  const T* inference_model <T>::forward_tile (const T* input, int rows, scratch& buffer) const {
+    const T* source = input;
+    T* destination = buffer.front.data();
+
+    for (const stage& s : stages) {
+      forward(s, source, destination, buffer.columns.data(), rows);
+      source = destination;
+      destination = destination == buffer.front.data() ? buffer.back.data() : buffer.front.data();
+    }
+
+    return source;
+  }
+
+  template <typename T>
+  void inference_model <T>::forward (const stage& s, const T* input, T* output, T* columns, int rows) const {
+    const T* weight = weights.data() + s.weight_offset;
+    const T* bias = biases.data() + s.bias_offset;
+
+    if (s.type == layer_type::maxpool2d) {
+      pool::max_forward(input, output, (std::uint8_t*)nullptr, rows, s.pooling);
+      return;
+    }
+    if (s.type == layer_type::avgpool2d) {
+      pool::average_forward(input, output, rows, s.pooling);
+      return;
+    }
+
+    if (s.type == layer_type::conv2d) {
+      const conv2d_shape& shape = s.convolution;
+      conv::im2col(input, columns, rows, shape);
+      kernel::gemm_bias(columns, weight, bias, output, rows * shape.positions(), shape.filters, shape.patch_size(),
+                        shape.patch_size(), shape.filters);
+    }
+    else
+      kernel::gemm_bias(input, weight, bias, output, rows, s.outputs, s.inputs, s.inputs, s.outputs);
+    activation::apply(s.kind, s.function, output, rows, s.outputs, s.precision);
+  }
+
+  /**
+   * @brief Scratch buffer owned by the calling thread; allocated on first use only
+   */
+  template <typename T>
+  typename inference_model <T>::scratch& inference_model <T>::local_scratch () const {
+    thread_local scratch buffer;
+    buffer.reserve(input_size, max_width, default_batch_size, max_columns);
+    return buffer;
+  }
+
+  /**
+   * @brief Shards `labels` across `thread_count` threads, each of which calls
+   *        predict (first, predictions, scratch) for its range, and counts the hits. Throws
+   *        a std::runtime_error for a label that is not one of the outputs.
+   */
+  template <typename T>
+  template <typename Predict>
+  evaluation_result inference_model <T>::score (const std::vector <int>& labels, int thread_count, Predict predict) const {
+    auto start = std::chrono::steady_clock::now();
+
+    int total_count = labels.size();
+    int class_count = get_output_size();
+
+    for (int label : labels)
+      if (label < 0 or label >= class_count)
+        throw std::runtime_error("label " + std::to_string(label) + " is not one of the " + std::to_string(class_count)
+                                 + " outputs of the model");
+
+    if (thread_count <= 0)
+      thread_count = std::max(1u, std::thread::hardware_concurrency());
+    thread_count = std::max(1, std::min(thread_count, total_count / default_batch_size));
+
+    std::vector <std::vector <int>> class_total (thread_count, std::vector <int> (class_count, 0));
+    std::vector <std::vector <int>> class_correct (thread_count, std::vector <int> (class_count, 0));
+
+    auto shard = [&] (int index) {
+      int first = (long long)total_count * index / thread_count;
+      int last = (long long)total_count * (index + 1) / thread_count;
+      std::vector <int> predictions (last - first);
+      scratch buffer = make_scratch();
+
+      predict(first, predictions, buffer);
+
+      for (int i = first; i < last; ++i) {
+        ++class_total[index][labels[i]];
+        if (predictions[i - first] == labels[i])
+          ++class_correct[index][labels[i]];
+      }
+    };
+
+    std::vector <std::thread> threads;
+    for (int i = 1; i < thread_count; ++i)
+      threads.emplace_back(shard, i);
+    shard(0);
+    for (auto& thread : threads)
+      thread.join();
+
+    evaluation_result result;
+    result.total_count = total_count;
+    result.class_total.assign(class_count, 0);
+    result.class_correct.assign(class_count, 0);
+
+    for (int i = 0; i < thread_count; ++i)
+      for (int j = 0; j < class_count; ++j) {
+        result.class_total[j] += class_total[i][j];
+        result.class_correct[j] += class_correct[i][j];
+      }
+    for (int j = 0; j < class_count; ++j)
+      result.correct_count += result.class_correct[j];
+
+    std::chrono::duration <double> elapsed = std::chrono::steady_clock::now() - start;
+
+    result.accuracy = total_count == 0 ? 0 : (long double)result.correct_count * 100 / (long double)total_count;
+    result.elapsed_seconds = elapsed.count();
+    result.throughput = result.elapsed_seconds > 0 ? total_count / result.elapsed_seconds : 0;
+
+    return result;
+  }
+
+  /**
+   * @brief Operator << overload to insert a human readable summary of an evaluation into
+   *        a std::ostream object
+   */
+  inline std::ostream& operator << (std::ostream& stream, const evaluation_result& result) {
+    const auto flags = stream.flags();
+    const auto precision = stream.precision();
+
+    stream << "Accuracy: " << std::fixed << std::setprecision(2) << result.accuracy << "% ("
+           << result.correct_count << '/' << result.total_count << ")\n";
+
+    for (int i = 0; i < (int)result.class_total.size(); ++i)
+      stream << "  class " << i << ": " << result.class_correct[i] << '/' << result.class_total[i] << '\n';
+
+    stream << "Elapsed: " << std::setprecision(3) << result.elapsed_seconds * 1000 << " ms ("
+           << std::setprecision(0) << result.throughput << " images/s)";
+
+    stream.flags(flags);
+    stream.precision(precision);
+    return stream;
+  }
+
+} // namespace fmc
+
+#endif // FMC_INFERENCE_HPP
@@ -0,0 +1,129 @@
+// Arrow
+
+#ifndef FMC_INITIALIZER_HPP
+#define FMC_INITIALIZER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace fmc {
+
+  namespace initializer {
+
+    /**
+     * @brief Schemes for the initial weights of a layer. All of them but `uniform` start the
+     *        biases at zero.
+     *
+     * uniform:    U(-1, 1) for weights and biases
+     * xavier:     U(-a, a), a = sqrt(6 / (fan_in + fan_out)) (Glorot)
+     * he:         N(0, 2 / fan_in)
+     * lecun:      N(0, 1 / fan_in)
+     * orthogonal: orthonormal rows or columns of a Gaussian matrix
+     */
+    enum class kind {
+      uniform,
+      xavier,
+      he,
+      lecun,
+      orthogonal
+    };
+
+    /**
+     * @brief Initializer suited to an activation: He for ReLU, Xavier for everything else
+     */
+    inline kind default_for (activation::kind activation_kind) {
+      return activation_kind == activation::kind::relu ? kind::he : kind::xavier;
+    }
+
+    /**
+     * @brief Fills a row-major (rows x cols) matrix with orthonormal rows if it is wide, or
+     *        orthonormal columns if it is tall, by modified Gram-Schmidt over Gaussian vectors
+     */
+    template <typename T>
+    void orthogonal (T* values, int rows, int cols) {
+      const int count = std::min(rows, cols);
+      const int length = std::max(rows, cols);
+      std::vector <T> basis ((std::size_t)count * length);
+
+      random::fill_normal(std::span <T> (basis), T(0), T(1));
+
+      for (int i = 0; i < count; ++i) {
+        T* v = basis.data() + (std::size_t)i * length;
+
+        for (int j = 0; j < i; ++j) {
+          const T* u = basis.data() + (std::size_t)j * length;
+          T dot = 0;
+          for (int k = 0; k < length; ++k)
+            dot += u[k] * v[k];
+          for (int k = 0; k < length; ++k)
+            v[k] -= dot * u[k];
+        }
+
+        T norm = 0;
+        for (int k = 0; k < length; ++k)
+          norm += v[k] * v[k];
+        norm = std::sqrt(norm);
+        for (int k = 0; k < length; ++k)
+          v[k] /= norm;
+      }
+
+      if (rows <= cols)
+        std::copy(basis.begin(), basis.end(), values);
+      else
+        for (int i = 0; i < cols; ++i)
+          for (int r = 0; r < rows; ++r)
+            values[(std::size_t)r * cols + i] = basis[(std::size_t)i * rows + r];
+    }
+
+    /**
+     * @brief Initializes the (fan_in x fan_out) weights and (1 x fan_out) bias of a layer
+     *
+     * @tparam T floating point type
+     * @param k initialization scheme
+     * @param weight fan_in * fan_out row-major weights
+     * @param bias fan_out biases
+     * @param fan_in number of inputs of the layer
+     * @param fan_out number of outputs of the layer
+     */
+    template <typename T>
+    void initialize (kind k, T* weight, T* bias, int fan_in, int fan_out) {
+      std::span <T> weights (weight, (std::size_t)fan_in * fan_out);
+      std::span <T> biases (bias, fan_out);
+
+      if (weights.empty())
+        return;
+
+      switch (k) {
+        case kind::uniform:
+          random::fill_uniform(weights, T(-1), T(1));
+          random::fill_uniform(biases, T(-1), T(1));
+          return;
+        case kind::xavier: {
+          const T limit = std::sqrt(T(6) / (fan_in + fan_out));
+          random::fill_uniform(weights, -limit, limit);
+          break;
+        }
+        case kind::he:
+          random::fill_normal(weights, T(0), std::sqrt(T(2) / fan_in));
+          break;
+        case kind::lecun:
+          random::fill_normal(weights, T(0), std::sqrt(T(1) / fan_in));
+          break;
+        case kind::orthogonal:
+          orthogonal(weight, fan_in, fan_out);
+          break;
+      }
+
+      std::fill(biases.begin(), biases.end(), T(0));
+    }
+
+  } // namespace initializer
+
+} // namespace fmc
+
+#endif // FMC_INITIALIZER_HPP
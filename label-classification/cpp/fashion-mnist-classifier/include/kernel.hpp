@@ -0,0 +1,273 @@
+// Arrow
+
+#ifndef FMC_KERNEL_HPP
+#define FMC_KERNEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// GCC vectorizes the k loop of the register-blocked GEMM (a gather over the rows of B) unless
+// the loop vectorizer is kept off it; the fixed-size block is then vectorized across columns
+#if defined(__GNUC__) and not defined(__clang__)
+#  define FMC_KERNEL_BLOCK __attribute__((optimize("no-tree-loop-vectorize")))
+#else
+#  define FMC_KERNEL_BLOCK
+#endif
+
+namespace fmc {
+
+  namespace kernel {
+
+    const int block_rows = 4;
+    const int block_cols = 8;
+
+    // bytes of output that comfortably stay in L1 next to the rows being streamed
+    const std::size_t small_output = 16 * 1024;
+
+    // shortest dot product gemm_nt computes directly
+    const int short_dot = 4 * block_cols;
+
+    /**
+     * @brief A dimension known at compile time. Every kernel takes its fixed dimensions (all but
+     *        the number of rows) either as an int or as a `fixed`, in which case the loops over
+     *        that dimension get constant trip counts and are unrolled and vectorized for that shape.
+     */
+    template <int N>
+    using fixed = std::integral_constant <int, N>;
+
+    /**
+     * @brief Computes one `block_rows` x `block_cols` block of C = A * B + bias, accumulated in
+     *        registers over the whole of k so that C is written exactly once
+     */
+    template <typename T, typename N, typename K>
+    FMC_KERNEL_BLOCK
+    void gemm_bias_block (const T* __restrict a, const T* __restrict b, const T* __restrict bias, T* __restrict c,
+                          N n, K k, std::size_t lda, std::size_t ldc) {
+      T accumulator [block_rows][block_cols];
+
+      for (int rr = 0; rr < block_rows; ++rr)
+        for (int jj = 0; jj < block_cols; ++jj)
+          accumulator[rr][jj] = bias == nullptr ? T(0) : bias[jj];
+
+      for (int i = 0; i < k; ++i) {
+        const T* row = b + (std::size_t)i * n;
+#pragma GCC unroll 4
+        for (int rr = 0; rr < block_rows; ++rr) {
+          const T x = a[rr * lda + i];
+#pragma GCC unroll 8
+          for (int jj = 0; jj < block_cols; ++jj)
+            accumulator[rr][jj] += x * row[jj];
+        }
+      }
+
+      for (int rr = 0; rr < block_rows; ++rr)
+        std::copy(accumulator[rr], accumulator[rr] + block_cols, c + rr * ldc);
+    }
+
+    /**
+     * @brief Row-major C (m x n) = A (m x k) * B (k x n) + bias (1 x n), bias broadcast over every row
+     *
+     * Full blocks of C go through gemm_bias_block, where each element of B loaded from cache feeds
+     * `block_rows` multiply-adds. Rows and columns that do not fill a whole block go through a plain
+     * loop whose innermost dimension runs over contiguous elements of B and C.
+     *
+     * @tparam T type of the elements
+     * @param a m x k input, row stride `lda`
+     * @param b k x n weights, row stride `n`
+     * @param bias n values added to every row of C, or null for none
+     * @param c m x n output, row stride `ldc`
+     */
+    template <typename T, typename N = int, typename K = int>
+    void gemm_bias (const T* __restrict a, const T* __restrict b, const T* __restrict bias, T* __restrict c,
+                    int m, N n, K k, std::size_t lda, std::size_t ldc) {
+      const int full_rows = m - m % block_rows;
+      const int full_cols = n - n % block_cols;
+
+      for (int r = 0; r < full_rows; r += block_rows)
+        for (int j = 0; j < full_cols; j += block_cols)
+          gemm_bias_block(a + r * lda, b + j, bias == nullptr ? bias : bias + j, c + r * ldc + j, n, k, lda, ldc);
+
+      // remaining columns of the full row blocks, then every column of the remaining rows
+      auto plain = [&] (int first_row, int last_row, int first_col) {
+        for (int r = first_row; r < last_row; ++r) {
+          T* out = c + r * ldc;
+          if (bias == nullptr)
+            std::fill(out + first_col, out + n, T(0));
+          else
+            std::copy(bias + first_col, bias + n, out + first_col);
+          for (int i = 0; i < k; ++i) {
+            const T x = a[r * lda + i];
+            const T* row = b + (std::size_t)i * n;
+            for (int j = first_col; j < n; ++j)
+              out[j] += x * row[j];
+          }
+        }
+      };
+
+      if (full_cols < n)
+        plain(0, full_rows, full_cols);
+      plain(full_rows, m, 0);
+    }
+
+    /**
+     * @brief Row-major C (m x n) = A (m x k) * B^T, where B is stored as (n x k)
+     *
+     * Every element of C is a dot product of two contiguous rows, split over `block_cols`
+     * independent partial sums so that it vectorizes without reassociating a single sum.
+     * Dot products shorter than `short_dot`, such as the deltas of the filters of a convolution,
+     * would be mostly reduction: B is transposed instead and the product goes through gemm_bias.
+     *
+     * @tparam T type of the elements
+     * @param a m x k input, row stride `k`
+     * @param b n x k weights, row stride `k`
+     * @param c m x n output, row stride `n`
+     */
+    template <typename T, typename N = int, typename K = int>
+    FMC_KERNEL_BLOCK
+    void gemm_nt (const T* __restrict a, const T* __restrict b, T* __restrict c, int m, N n, K k) {
+      if (k < short_dot) {
+        // kept per thread so that training does not allocate on every step
+        thread_local std::vector <T> transposed;
+        transposed.resize((std::size_t)k * n);
+        for (int i = 0; i < n; ++i)
+          for (int j = 0; j < k; ++j)
+            transposed[(std::size_t)j * n + i] = b[(std::size_t)i * k + j];
+        gemm_bias(a, transposed.data(), (const T*)nullptr, c, m, n, k, k, n);
+        return;
+      }
+
+      const int full = k - k % block_cols;
+
+      for (int r = 0; r < m; ++r) {
+        const T* x = a + (std::size_t)r * k;
+
+        for (int i = 0; i < n; ++i) {
+          const T* y = b + (std::size_t)i * k;
+          T lanes [block_cols] = {};
+
+          for (int j = 0; j < full; j += block_cols)
+#pragma GCC unroll 8
+            for (int jj = 0; jj < block_cols; ++jj)
+              lanes[jj] += x[j + jj] * y[j + jj];
+
+          T sum = 0;
+          for (int jj = 0; jj < block_cols; ++jj)
+            sum += lanes[jj];
+          for (int j = full; j < k; ++j)
+            sum += x[j] * y[j];
+
+          c[(std::size_t)r * n + i] = sum;
+        }
+      }
+    }
+
+    /**
+     * @brief Adds alpha times one `block_rows` x `block_cols` block of A^T * B to C, accumulated
+     *        in registers over the whole of k
+     */
+    template <typename T, typename M, typename N>
+    FMC_KERNEL_BLOCK
+    void gemm_tn_block (const T* __restrict a, const T* __restrict b, T* __restrict c, M m, N n, int k, T alpha) {
+      T accumulator [block_rows][block_cols] = {};
+
+      for (int r = 0; r < k; ++r) {
+        const T* x = a + (std::size_t)r * m;
+        const T* row = b + (std::size_t)r * n;
+#pragma GCC unroll 4
+        for (int rr = 0; rr < block_rows; ++rr)
+#pragma GCC unroll 8
+          for (int jj = 0; jj < block_cols; ++jj)
+            accumulator[rr][jj] += x[rr] * row[jj];
+      }
+
+      for (int rr = 0; rr < block_rows; ++rr)
+        for (int jj = 0; jj < block_cols; ++jj)
+          c[(std::size_t)rr * n + jj] += alpha * accumulator[rr][jj];
+    }
+
+    /**
+     * @brief Row-major C (m x n) += alpha * A^T * B, where A is stored as (k x m) and B as (k x n)
+     *
+     * Used for weight gradients, with k the batch size: every row of C is updated in place with
+     * k contiguous multiply-adds, so no (m x n) temporary is ever built. Zero inputs, common for
+     * blank pixels and inactive ReLUs, are skipped. A C small enough to stay in L1, as for the
+     * filters of a convolution where k is the batch size times the output positions, is
+     * computed in register blocks by gemm_tn_block instead, reading A and B once per block.
+     *
+     * @tparam T type of the elements
+     * @param a k x m input, row stride `m`
+     * @param b k x n input, row stride `n`
+     * @param c m x n output, row stride `n`
+     * @param alpha scale applied to the product
+     */
+    template <typename T, typename M = int, typename N = int>
+    void gemm_tn (const T* __restrict a, const T* __restrict b, T* __restrict c, M m, N n, int k, T alpha) {
+      if ((std::size_t)m * n * sizeof(T) <= small_output) {
+        const int full_rows = m - m % block_rows;
+        const int full_cols = n - n % block_cols;
+
+        for (int i = 0; i < full_rows; i += block_rows)
+          for (int j = 0; j < full_cols; j += block_cols)
+            gemm_tn_block(a + i, b + j, c + (std::size_t)i * n + j, m, n, k, alpha);
+
+        auto plain = [&] (int first_row, int last_row, int first_col) {
+          for (int r = 0; r < k; ++r) {
+            const T* row = b + (std::size_t)r * n;
+            for (int i = first_row; i < last_row; ++i) {
+              const T x = alpha * a[(std::size_t)r * m + i];
+              T* out = c + (std::size_t)i * n;
+              for (int j = first_col; j < n; ++j)
+                out[j] += x * row[j];
+            }
+          }
+        };
+
+        if (full_cols < n)
+          plain(0, full_rows, full_cols);
+        plain(full_rows, m, 0);
+        return;
+      }
+
+      for (int i = 0; i < m; ++i) {
+        T* out = c + (std::size_t)i * n;
+        for (int r = 0; r < k; ++r) {
+          const T x = alpha * a[(std::size_t)r * m + i];
+          const T* row = b + (std::size_t)r * n;
+          if (x == 0)
+            continue;
+          for (int j = 0; j < n; ++j)
+            out[j] += x * row[j];
+        }
+      }
+    }
+
+    /**
+     * @brief out (1 x n) += alpha * sum of the m rows of A (m x n)
+     */
+    template <typename T, typename N = int>
+    void column_sum (const T* __restrict a, T* __restrict out, int m, N n, T alpha) {
+      for (int r = 0; r < m; ++r) {
+        const T* row = a + (std::size_t)r * n;
+        for (int j = 0; j < n; ++j)
+          out[j] += alpha * row[j];
+      }
+    }
+
+    /**
+     * @brief out (1 x n) = alpha * in (1 x n), widening bytes to T. A plain loop, which GCC turns
+     *        into vector byte-to-float conversions for float and double; long double stays scalar.
+     */
+    template <typename T>
+    void widen (const std::uint8_t* __restrict in, T* __restrict out, std::size_t n, T alpha) {
+      for (std::size_t i = 0; i < n; ++i)
+        out[i] = alpha * (T)in[i];
+    }
+
+  } // namespace kernel
+
+} // namespace fmc
+
+#endif // FMC_KERNEL_HPP
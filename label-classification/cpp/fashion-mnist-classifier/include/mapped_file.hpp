@@ -0,0 +1,95 @@
+// Arrow
+
+#ifndef FMC_MAPPED_FILE_HPP
+#define FMC_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fmc {
+
+  /**
+   * @brief read-only memory mapping of a whole file
+   *
+   * Pages are only read from disk (or the page cache) when they are first touched, so opening
+   * a file costs the same whatever its size. Movable, not copyable.
+   */
+  class mapped_file {
+    private:
+      const std::uint8_t* address = nullptr;
+      std::size_t length = 0;
+
+    public:
+      mapped_file () = default;
+      explicit mapped_file (const std::string&);
+      mapped_file (mapped_file&&) noexcept;
+      mapped_file& operator = (mapped_file&&) noexcept;
+      ~mapped_file ();
+
+      mapped_file (const mapped_file&) = delete;
+      mapped_file& operator = (const mapped_file&) = delete;
+
+      std::span <const std::uint8_t> bytes () const;
+  };
+
+  inline mapped_file::mapped_file (const std::string& path) {
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+      throw std::runtime_error("unable to open \"" + path + "\"");
+
+    struct stat status;
+    if (::fstat(descriptor, &status) != 0) {
+      ::close(descriptor);
+      throw std::runtime_error("unable to read the size of \"" + path + "\"");
+    }
+
+    length = status.st_size;
+    if (length > 0) {
+      void* pointer = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+      if (pointer == MAP_FAILED) {
+        ::close(descriptor);
+        throw std::runtime_error("unable to map \"" + path + "\"");
+      }
+      address = (const std::uint8_t*)pointer;
+    }
+
+    // the mapping keeps the file alive on its own
+    ::close(descriptor);
+  }
+
+  inline mapped_file::mapped_file (mapped_file&& other) noexcept
+    : address (std::exchange(other.address, nullptr)),
+      length (std::exchange(other.length, 0))
+  { }
+
+  inline mapped_file& mapped_file::operator = (mapped_file&& other) noexcept {
+    if (this != &other) {
+      if (address != nullptr)
+        ::munmap((void*)address, length);
+      address = std::exchange(other.address, nullptr);
+      length = std::exchange(other.length, 0);
+    }
+    return *this;
+  }
+
+  inline mapped_file::~mapped_file () {
+    if (address != nullptr)
+      ::munmap((void*)address, length);
+  }
+
+  inline std::span <const std::uint8_t> mapped_file::bytes () const {
+    return {address, length};
+  }
+
+} // namespace fmc
+
+#endif // FMC_MAPPED_FILE_HPP
@@ -3,7 +3,9 @@
 #ifndef FMC_MATRIX_HPP
 #define FMC_MATRIX_HPP
 
+#include <algorithm>
 #include <iosfwd>
+#include <span>
 #include <stdexcept>
 #include <utility>
 #include <vector>
@@ -14,6 +16,9 @@ namespace fmc {
    * @brief implementation of a simple interface to use 2d matrices and
             perform operations on them
    * 
+   * Elements are stored contiguously in row-major order, so a matrix can be handed to the
+   * kernels in kernel.hpp through data () without copying.
+   * 
    * @tparam T type of the elements that the matrix holds
    */
   template <typename T>
@@ -27,7 +32,7 @@ namespace fmc {
     private:
       int rows;
       int cols;
-      vec2d values;
+      vec1d values;
     
     public:
       matrix (int = 0, int = 0, const T& = T());
@@ -51,17 +56,19 @@ namespace fmc {
       matrix& operator () (ApplyFuncConstParameter);
       matrix& operator () (ApplyFuncNonConstParameter);
 
-      vec1d&       operator [] (int);
-      const vec1d& operator [] (int) const;
+      std::span <T>       operator [] (int);
+      std::span <const T> operator [] (int) const;
 
+      T*       data                   ();
+      const T* data                   () const;
       int      get_rows               () const;
       int      get_cols               () const;
       const T& get_value              (int, int) const;
       T        get_value_copy         (int, int) const;
-      const T& get_values             () const;
       T&       get_value_reference    (int, int);
       vec2d    get_values_copy        () const;
-      vec2d&   get_values_reference   ();
+      vec1d&   get_values_reference   ();
+      void     reshape                (int, int);
       void     set_value              (int, int, const T&);
 
       matrix add       (const matrix&) const;
@@ -95,7 +102,7 @@ namespace fmc {
   matrix <T>::matrix (int rows, int cols, const T& default_value)
     : rows (rows),
       cols (cols),
-      values (matrix <T>::vec2d(rows, matrix <T>::vec1d(cols, default_value)))
+      values ((std::size_t)rows * cols, default_value)
   { }
 
   /**
@@ -109,8 +116,7 @@ namespace fmc {
   template <typename T>
   matrix <T>::matrix (int rows, int cols, const matrix <T>::vec2d& values)
     : rows (rows),
-      cols (cols),
-      values (values) {
+      cols (cols) {
 #ifdef DEBUG_MODE
     int r = values.size();
     int c = values.empty() ? 0 : values.front().size();
@@ -118,6 +124,10 @@ namespace fmc {
     if (rows != r or cols != c)
       throw std::runtime_error("number of rows and cols in vec2d does not match provided row and col size");
 #endif
+
+    this->values.reserve((std::size_t)rows * cols);
+    for (const auto& row : values)
+      this->values.insert(this->values.end(), row.begin(), row.end());
   }
 
   /**
@@ -194,9 +204,8 @@ namespace fmc {
       throw std::runtime_error("incompatible matrices for add operation");
 #endif
 
-    for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < cols; ++j)
-        values[i][j] += rhs.values[i][j];
+    for (std::size_t i = 0; i < values.size(); ++i)
+      values[i] += rhs.values[i];
     return *this;
   }
 
@@ -209,9 +218,8 @@ namespace fmc {
    */
   template <typename T>
   matrix <T>& matrix <T>::operator += (const T& value) {
-    for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < cols; ++j)
-        values[i][j] += value;
+    for (T& element : values)
+      element += value;
     return *this;
   }
 
@@ -229,9 +237,8 @@ namespace fmc {
       throw std::runtime_error("incompatible matrices for subtract operation");
 #endif
 
-    for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < cols; ++j)
-        values[i][j] -= rhs.values[i][j];
+    for (std::size_t i = 0; i < values.size(); ++i)
+      values[i] -= rhs.values[i];
     return *this;
   }
 
@@ -244,9 +251,8 @@ namespace fmc {
    */
   template <typename T>
   matrix <T>& matrix <T>::operator -= (const T& value) {
-    for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < cols; ++j)
-        values[i][j] -= value;
+    for (T& element : values)
+      element -= value;
     return *this;
   }
 
@@ -271,14 +277,15 @@ namespace fmc {
       throw std::runtime_error("incompatible matrices for product operation");
 #endif
 
-    matrix <T>::vec2d result (rows, matrix <T>::vec1d(rhs.cols, 0));
+    matrix <T>::vec1d result ((std::size_t)rows * rhs.cols, 0);
     
     for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < rhs.cols; ++j)
-        for (int k = 0; k < cols; ++k)
-          result[i][j] += values[i][k] * rhs.values[k][j];
+      for (int k = 0; k < cols; ++k) {
+        const T x = values[(std::size_t)i * cols + k];
+        for (int j = 0; j < rhs.cols; ++j)
+          result[(std::size_t)i * rhs.cols + j] += x * rhs.values[(std::size_t)k * rhs.cols + j];
+      }
     
-    rows = rows;
     cols = rhs.cols;
     values = std::move(result);
 
@@ -294,9 +301,8 @@ namespace fmc {
    */
   template <typename T>
   matrix <T>& matrix <T>::operator *= (const T& value) {
-    for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < cols; ++j)
-        values[i][j] *= value;
+    for (T& element : values)
+      element *= value;
     return *this;
   }
 
@@ -309,9 +315,8 @@ namespace fmc {
    */
   template <typename T>
   matrix <T>& matrix <T>::operator /= (const T& value) {
-    for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < cols; ++j)
-        values[i][j] /= value;
+    for (T& element : values)
+      element /= value;
     return *this;
   }
 
@@ -335,9 +340,8 @@ namespace fmc {
    */
   template <typename T>
   matrix <T>& matrix <T>::operator - () {
-    for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < cols; ++j)
-        values[i][j] = -values[i][j];
+    for (T& element : values)
+      element = -element;
     return *this;
   }
 
@@ -351,9 +355,8 @@ namespace fmc {
    */
   template <typename T>
   matrix <T>& matrix <T>::operator () (ApplyFuncConstParameter apply_function) {
-    for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < cols; ++j)
-        values[i][j] = apply_function(values[i][j]);
+    for (T& element : values)
+      element = apply_function(element);
     return *this;
   }
 
@@ -367,9 +370,8 @@ namespace fmc {
    */
   template <typename T>
   matrix <T>& matrix <T>::operator () (ApplyFuncNonConstParameter apply_function) {
-    for (int i = 0; i < rows; ++i)
-      for (int j = 0; j < cols; ++j)
-        values[i][j] = apply_function(values[i][j]);
+    for (T& element : values)
+      element = apply_function(element);
     return *this;
   }
 
@@ -378,15 +380,15 @@ namespace fmc {
    * 
    * @tparam T type of the elements that the matrix holds
    * @param index row index that is to be accessed
-   * @return matrix <T>::vec1d& reference to matrix row
+   * @return std::span <T> view of matrix row
    */
   template <typename T>
-  typename matrix <T>::vec1d& matrix <T>::operator [] (int index) {
+  std::span <T> matrix <T>::operator [] (int index) {
 #ifdef DEBUG_MODE
     if (index < 0 or index >= rows)
       throw std::runtime_error("out of bounds access will occur with the provided index");
 #endif
-    return values[index];
+    return std::span <T> (values.data() + (std::size_t)index * cols, cols);
   }
 
   /**
@@ -394,17 +396,37 @@ namespace fmc {
    * 
    * @tparam T type of the elements that the matrix holds
    * @param index row index that is to be accessed
-   * @return matrix <T>::vec1d& const reference to matrix row
+   * @return std::span <const T> const view of matrix row
    */
   template <typename T>
-  const typename matrix <T>::vec1d& matrix <T>::operator [] (int index) const {
+  std::span <const T> matrix <T>::operator [] (int index) const {
 #ifdef DEBUG_MODE
     if (index < 0 or index >= rows)
       throw std::runtime_error("out of bounds access will occur with the provided index");
 #endif
-    return values[index];
+    return std::span <const T> (values.data() + (std::size_t)index * cols, cols);
   }
 
+  /**
+   * @brief Pointer to the first element; elements are stored contiguously in row-major order
+   * 
+   * @tparam T type of the elements that the matrix holds
+   * @return T* pointer to the element at row 0 and col 0
+   */
+  template <typename T>
+  T* matrix <T>::data ()
+  { return values.data(); }
+
+  /**
+   * @brief Pointer to the first element; elements are stored contiguously in row-major order
+   * 
+   * @tparam T type of the elements that the matrix holds
+   * @return const T* const pointer to the element at row 0 and col 0
+   */
+  template <typename T>
+  const T* matrix <T>::data () const
+  { return values.data(); }
+
   /**
    * @brief Getter function for matrix <T>::rows
    * 
@@ -439,7 +461,7 @@ namespace fmc {
     if (i < 0 or i >= rows or j < 0 or j >= cols)
       throw std::runtime_error("out of bounds access will occur with the provided row and col values");
 #endif
-    return values[i][j];    
+    return values[(std::size_t)i * cols + j];    
   }
 
   /**
@@ -459,7 +481,7 @@ namespace fmc {
     if (i < 0 or i >= rows or j < 0 or j >= cols)
       throw std::runtime_error("out of bounds access will occur with the provided row and col values");
 #endif
-    return values[i][j];
+    return values[(std::size_t)i * cols + j];
   }
   
   /**
@@ -479,7 +501,7 @@ namespace fmc {
     if (i < 0 or i >= rows or j < 0 or j >= cols)
       throw std::runtime_error("out of bounds access will occur with the provided row and col values");
 #endif
-    return values[i][j];
+    return values[(std::size_t)i * cols + j];
   }
 
   /**
@@ -489,19 +511,40 @@ namespace fmc {
    * @return matrix <T>::vec2d copy of all matrix <T>::matrix elements
    */
   template <typename T>
-  typename matrix <T>::vec2d matrix <T>::get_values_copy () const
-  { return values; }
+  typename matrix <T>::vec2d matrix <T>::get_values_copy () const {
+    matrix <T>::vec2d result (rows);
+    for (int i = 0; i < rows; ++i)
+      result[i].assign(values.begin() + (std::size_t)i * cols, values.begin() + (std::size_t)(i + 1) * cols);
+    return result;
+  }
 
   /**
-   * @brief Getter function to return all matrix <T>::matrix elements by reference
+   * @brief Getter function to return all matrix <T>::matrix elements by reference, as one
+   *        row-major vector
    * 
    * @tparam T type of the elements that the matrix holds
-   * @return matrix <T>::vec2d& reference to all matrix <T>::matrix elements
+   * @return matrix <T>::vec1d& reference to all matrix <T>::matrix elements
    */
   template <typename T>
-  typename matrix <T>::vec2d& matrix <T>::get_values_reference ()
+  typename matrix <T>::vec1d& matrix <T>::get_values_reference ()
   { return values; }
 
+  /**
+   * @brief Changes the shape of the matrix. Existing storage is reused whenever it is large
+   *        enough, so reshaping back and forth between batch sizes does not allocate; element
+   *        values are unspecified afterwards.
+   * 
+   * @tparam T type of the elements that the matrix holds
+   * @param rows_ new number of rows
+   * @param cols_ new number of columns
+   */
+  template <typename T>
+  void matrix <T>::reshape (int rows_, int cols_) {
+    rows = rows_;
+    cols = cols_;
+    values.resize((std::size_t)rows * cols);
+  }
+
   /**
    * @brief Setter function to set the value of a particular matrix <T>::matrix element
    * 
@@ -519,7 +562,7 @@ namespace fmc {
     if (i < 0 or i >= rows or j < 0 or j >= cols)
       throw std::runtime_error("out of bounds access will occur with the provided row and col values");
 #endif
-    values[i][j] = value;
+    values[(std::size_t)i * cols + j] = value;
   }
 
   /**
@@ -581,7 +624,7 @@ namespace fmc {
     matrix <T> t (cols, rows);
     for (int i = 0; i < rows; ++i)
       for (int j = 0; j < cols; ++j)
-        t[j][i] = values[i][j];
+        t.values[(std::size_t)j * rows + i] = values[(std::size_t)i * cols + j];
     return t;
   }
 
@@ -626,7 +669,7 @@ namespace fmc {
   std::ostream& operator << (std::ostream& stream, const matrix <T>& m) {
     for (int i = 0; i < m.rows; ++i) {
       for (int j = 0; j < m.cols; ++j) {
-        stream << m.values[i][j];
+        stream << m.values[(std::size_t)i * m.cols + j];
         if (j != m.cols - 1)
           stream << ' ';
       }
@@ -649,7 +692,7 @@ namespace fmc {
   std::istream& operator >> (std::istream& stream, matrix <T>& m) {
     for (int i = 0; i < m.rows; ++i) {
       for (int j = 0; j < m.cols; ++j)
-        stream >> m.values[i][j];
+        stream >> m.values[(std::size_t)i * m.cols + j];
     }
     return stream;
   }
@@ -3,13 +3,20 @@
 #ifndef FMC_MNIST_HPP
 #define FMC_MNIST_HPP
 
+#include <algorithm>
+#include <cstdint>
 #include <iosfwd>
 #include <fstream>
-#include <sstream>
+#include <numeric>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
-#include "matrix.hpp"
+#include "cache.hpp"
+#include "csv.hpp"
+#include "dataset.hpp"
+#include "idx.hpp"
 
 namespace fmc {
 
@@ -18,13 +25,14 @@ namespace fmc {
     static const int mnist_col_size = 28;
     static const int mnist_img_size = 28 * 28;
 
+    public:
+      enum class split { training, testing };
+
     public:
       int training_size;
       int testing_size;
-      std::vector <fmc::matrix <long double>> training_dataset;
-      std::vector <fmc::matrix <long double>> testing_dataset;
-      std::vector <int> training_labels;
-      std::vector <int> testing_labels;
+      fmc::dataset training_dataset;
+      fmc::dataset testing_dataset;
     
     public:
       mnist (int, int);
@@ -34,21 +42,31 @@ namespace fmc {
 
       std::string get_named_label (int) const;
 
-      mnist& load      (std::string, std::string);
+      mnist& load      (std::string, std::string, bool = false);
+      mnist& load      (split, const std::string&, bool = false);
+      mnist& load_idx  (const std::string&, const std::string&, const std::string&, const std::string&);
+      mnist& load_idx  (split, const std::string&, const std::string&);
+      mnist& load_rows (split, const std::string&, std::span <const std::size_t>, bool = false);
       mnist& normalize ();
     
     private:
-      void display (const fmc::matrix <long double>&) const;
+      void                display     (std::span <const std::uint8_t>) const;
+      fmc::dataset&       get_dataset (split);
+      fmc::csv::row_index get_index   (const std::string&, bool) const;
+      const char*         get_name    (split) const;
+      int                 get_size    (split) const;
+      void                read_csv    (const std::string&, fmc::dataset&, int, bool) const;
+      void                read_idx    (const std::string&, const std::string&, fmc::dataset&, int) const;
   };
 
+  /**
+   * @brief Sets the number of samples of each split; a split's samples are only allocated when
+   *        it is loaded, so a split that is never loaded costs nothing
+   */
   mnist::mnist (int training_size, int testing_size)
     : training_size (training_size),
-      testing_size (testing_size) {
-    training_dataset.resize(training_size, fmc::matrix <long double> (1, mnist_img_size));
-    testing_dataset.resize(testing_size, fmc::matrix <long double> (1, mnist_img_size));
-    training_labels.resize(training_size);
-    testing_labels.resize(testing_size);
-  }
+      testing_size (testing_size)
+  { }
 
   void mnist::display_training (int index) const {
 #ifdef DEBUG_MODE
@@ -56,7 +74,7 @@ namespace fmc {
       throw std::runtime_error("out of bounds access will occur with provided index");
 #endif
 
-    display(training_dataset[index]);
+    display(training_dataset.sample(index));
   }
 
   void mnist::display_testing (int index) const {
@@ -65,7 +83,7 @@ namespace fmc {
       throw std::runtime_error("out of bounds access will occur with provided index");
 #endif
 
-    display(testing_dataset[index]);
+    display(testing_dataset.sample(index));
   }
 
   std::string mnist::get_named_label (int label) const {
@@ -85,94 +103,199 @@ namespace fmc {
     return names[label];
   }
 
-  mnist& mnist::load (std::string training_filepath, std::string testing_filepath) {
-    int value, index;
-    std::string line, pixel, label;
-
+  /**
+   * @brief Loads the dataset from the CSV files of the Kaggle distribution
+   *        (fashion-mnist_train.csv and fashion-mnist_test.csv)
+   *
+   * A file is parsed through the byte offsets of its rows, kept in an index next to it
+   * (fashion-mnist_train.csv.fmci) that is built by a single scan the first time, so the
+   * parsing splits across every hardware thread without scanning the file again, and only the
+   * first training_size or testing_size rows are read (see csv::read_rows).
+   *
+   * Every parsed file is cached in binary next to itself (fashion-mnist_train.csv.fmcd), and
+   * later loads read the cache instead for as long as the CSV does not change (see
+   * cache::read). `rebuild_cache` rebuilds the index and parses the CSV files whatever their
+   * caches hold.
+   */
+  mnist& mnist::load (std::string training_filepath, std::string testing_filepath, bool rebuild_cache) {
     std::cout << "[*] Initialising MNIST dataset\n";
 
-    {
-      std::ifstream training_file (training_filepath);
-      
-      if (!training_file)
-        throw std::runtime_error("training dataset does not exist at path: " + training_filepath);
-      
-      std::getline(training_file, line);
-      
-      for (int i = 0; i < training_size and training_file.is_open(); ++i) {
-        std::getline(training_file, line);
-        index = 0;
+    return load(split::training, training_filepath, rebuild_cache)
+          .load(split::testing, testing_filepath, rebuild_cache);
+  }
 
-        std::stringstream linestream (line);
+  /**
+   * @brief Loads a single split from its CSV file, e.g. only the testing set to evaluate a
+   *        trained model; see load
+   */
+  mnist& mnist::load (split part, const std::string& filepath, bool rebuild_cache) {
+    read_csv(filepath, get_dataset(part), get_size(part), rebuild_cache);
+    std::cout << "[*] MNIST " << get_name(part) << " dataset initialised\n";
 
-        std::getline(linestream, label, ',');
-        training_labels[i] = std::stoi(label);
+    return *this;
+  }
 
-        while (std::getline(linestream, pixel, ',')) {
-          value = std::stoi(pixel);
-          training_dataset[i].set_value(0, index, value);
-          ++index;
-        }
-      }
+  /**
+   * @brief Loads the dataset from the IDX files of the original Fashion-MNIST distribution
+   *        (train-images-idx3-ubyte, train-labels-idx1-ubyte, t10k-images-idx3-ubyte and
+   *        t10k-labels-idx1-ubyte, decompressed)
+   *
+   * The files are memory-mapped and their pixels read in place (see idx_file), so there is no
+   * text to parse; only the first training_size and testing_size images are touched.
+   */
+  mnist& mnist::load_idx (const std::string& training_images, const std::string& training_labels_path,
+                          const std::string& testing_images, const std::string& testing_labels_path) {
+    std::cout << "[*] Initialising MNIST dataset\n";
 
-      training_file.close();
-      
-      std::cout << "[*] MNIST training dataset initialised\n";
-    }
+    return load_idx(split::training, training_images, training_labels_path)
+          .load_idx(split::testing, testing_images, testing_labels_path);
+  }
 
-    {
-      std::ifstream testing_file (testing_filepath);
+  /**
+   * @brief Loads a single split from its pair of IDX files; see load_idx
+   */
+  mnist& mnist::load_idx (split part, const std::string& images, const std::string& labels_path) {
+    read_idx(images, labels_path, get_dataset(part), get_size(part));
+    std::cout << "[*] MNIST " << get_name(part) << " dataset initialised\n";
 
-      if (!testing_file)
-        throw std::runtime_error("training dataset does not exist at path: " + testing_filepath);
+    return *this;
+  }
 
-      std::getline(testing_file, line);
-      
-      for (int i = 0; i < testing_size and testing_file.is_open(); ++i) {
-        std::getline(testing_file, line);
-        index = 0;
+  /**
+   * @brief Loads the rows `rows` of a CSV file, in that order, as a split of as many samples,
+   *        e.g. a random subset of it or a range that starts far into it
+   *
+   * The rows are found through the row index of the file, which is built and written next to
+   * it on first use, or whenever `rebuild_index` is set, and the parsing is split across
+   * every hardware thread without scanning the file first (see csv::read_rows). Subsets are
+   * not cached.
+   */
+  mnist& mnist::load_rows (split part, const std::string& filepath, std::span <const std::size_t> rows,
+                           bool rebuild_index) {
+    fmc::dataset& dataset = get_dataset(part);
+    const fmc::csv::row_index index = get_index(filepath, rebuild_index);
+
+    (part == split::training ? training_size : testing_size) = rows.size();
+    dataset = fmc::dataset(rows.size(), mnist_row_size, mnist_col_size);
+
+    std::cout << "[*] Parsed \"" << filepath << "\": " << fmc::csv::read_rows(filepath, index, rows, dataset, 10) << '\n';
+    std::cout << "[*] MNIST " << get_name(part) << " dataset initialised\n";
 
-        std::stringstream linestream (line);
+    return *this;
+  }
 
-        std::getline(linestream, label, ',');
-        testing_labels[i] = std::stoi(label);
+  /**
+   * @brief Scales pixels to values between 0 and 1. The bytes are left as they are; the scale is
+   *        applied as they are widened into a batch.
+   */
+  mnist& mnist::normalize () {
+    const double factor = 1.0 / 255.0;
 
-        while (std::getline(linestream, pixel, ',')) {
-          value = std::stoi(pixel);
-          testing_dataset[i].set_value(0, index, value);
-          ++index;
-        }
-      }
+    training_dataset.set_scale(factor);
+    testing_dataset.set_scale(factor);
+
+    return *this;
+  }
+
+  void mnist::read_csv (const std::string& path, fmc::dataset& dataset, int size, bool rebuild_cache) const {
+    const std::string cache_path = path + ".fmcd";
 
-      testing_file.close();
+    dataset = fmc::dataset(size, mnist_row_size, mnist_col_size);
 
-      std::cout << "[*] MNIST testing dataset initialised\n";
+    if (not rebuild_cache and fmc::cache::read(cache_path, path, dataset)) {
+      std::cout << "[*] Read \"" << path << "\" from its cache \"" << cache_path << "\"\n";
+      return;
     }
 
-    return *this;
+    std::vector <std::size_t> rows (size);
+    std::iota(rows.begin(), rows.end(), 0);
+
+    const fmc::csv::row_index index = get_index(path, rebuild_cache);
+    if (index.rows() < (std::size_t)size)
+      throw std::runtime_error("\"" + path + "\" holds " + std::to_string(index.rows()) + " rows but "
+                               + std::to_string(size) + " were requested");
+
+    std::cout << "[*] Parsed \"" << path << "\": " << fmc::csv::read_rows(path, index, rows, dataset, 10) << '\n';
+
+    // a cache that cannot be written only costs the next load its speed
+    try {
+      fmc::cache::write(cache_path, path, dataset);
+    }
+    catch (const std::exception& error) {
+      std::cout << "[*] Not caching \"" << path << "\": " << error.what() << '\n';
+    }
   }
 
-  mnist& mnist::normalize () {
-    const long double factor = (long double)1.0 / 255.0;
+  void mnist::read_idx (const std::string& images_path, const std::string& labels_path,
+                        fmc::dataset& dataset, int size) const {
+    const fmc::idx_file images (images_path, 3);
+    const fmc::idx_file classes (labels_path, 1);
 
-    for (int i = 0; i < training_size; ++i)
-      training_dataset[i] *= factor;
-    for (int i = 0; i < testing_size; ++i)
-      testing_dataset[i] *= factor;
-    
-    return *this;
+    if (images.get_item_size() != mnist_img_size)
+      throw std::runtime_error("images in \"" + images_path + "\" are not 28x28");
+    if (images.item_count() != classes.item_count())
+      throw std::runtime_error("\"" + images_path + "\" and \"" + labels_path + "\" hold different numbers of samples");
+    if (images.item_count() < (std::size_t)size)
+      throw std::runtime_error("\"" + images_path + "\" holds fewer samples than requested");
+
+    dataset = fmc::dataset(size, mnist_row_size, mnist_col_size);
+
+    // both hold bytes, so the images are a single copy
+    std::copy(images.data().begin(), images.data().begin() + (std::size_t)size * mnist_img_size, dataset.data());
+
+    const std::span <const std::uint8_t> label_values = classes.data();
+
+    for (int i = 0; i < size; ++i) {
+      if (label_values[i] >= 10)
+        throw std::runtime_error("\"" + labels_path + "\" holds a label outside of the 10 classes");
+      dataset.set_label(i, label_values[i]);
+    }
   }
 
-  void mnist::display (const fmc::matrix <long double>& data) const {
+  void mnist::display (std::span <const std::uint8_t> data) const {
     for (int i = 0; i < mnist_row_size; ++i) {
       for (int j = 0; j < mnist_col_size; ++j) {
-        int value = data.get_value(0, i * mnist_col_size + j);
+        int value = data[i * mnist_col_size + j];
         std::cout << "\x1b[48;2;" << value << ';' << value << ';' << value << "m  \x1b[0m";
       }
       std::cout << '\n';
     }
   }
 
+  fmc::dataset& mnist::get_dataset (split part) {
+    return part == split::training ? training_dataset : testing_dataset;
+  }
+
+  // The row index of the CSV file at `path`, read from next to it or built and written there
+  fmc::csv::row_index mnist::get_index (const std::string& path, bool rebuild) const {
+    const std::string index_path = path + ".fmci";
+    fmc::csv::row_index index;
+
+    if (not rebuild and fmc::csv::read_index(index_path, path, index))
+      return index;
+
+    index = fmc::csv::index_rows(path);
+    std::cout << "[*] Indexed the " << index.rows() << " rows of \"" << path << "\"\n";
+
+    // an index that cannot be written only costs the next load a scan
+    try {
+      fmc::csv::write_index(index_path, path, index);
+    }
+    catch (const std::exception& error) {
+      std::cout << "[*] Not indexing \"" << path << "\": " << error.what() << '\n';
+    }
+
+    return index;
+  }
+
+  const char* mnist::get_name (split part) const {
+    return part == split::training ? "training" : "testing";
+  }
+
+  int mnist::get_size (split part) const {
+    return part == split::training ? training_size : testing_size;
+  }
+
 } // namespace fmc
 
 #endif // FMC_MNIST_HPP
@@ -4,12 +4,32 @@
 #define FMC_NN_HPP
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <iomanip>
 #include <iosfwd>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
+#include "augment.hpp"
+#include "checkpoint.hpp"
+#include "conv.hpp"
+#include "data_loader.hpp"
+#include "dataset.hpp"
+#include "early_stopping.hpp"
+#include "inference.hpp"
+#include "initializer.hpp"
+#include "kernel.hpp"
 #include "matrix.hpp"
+#include "optimizer.hpp"
+#include "shard_stream.hpp"
+#include "shuffle.hpp"
+#include "telemetry.hpp"
+#include "trainer.hpp"
 #include "utils.hpp"
 
 namespace fmc {
@@ -23,6 +43,9 @@ namespace fmc {
       using ActivationFunc = T (*) (const T&);
 
     public:
+      layer_type type;
+      conv2d_shape convolution;
+      pool2d_shape pooling;
       int neuron_count;
       matrix <T> z;
       matrix <T> activation;
@@ -31,11 +54,36 @@ namespace fmc {
       matrix <T> delta;
 
     public:
+      std::vector <T> weight_gradient;
+      std::vector <T> bias_gradient;
+      std::vector <T> weight_state;
+      std::vector <T> bias_state;
+      std::vector <T> columns;
+      std::vector <T> column_delta;
+      std::vector <std::uint8_t> argmax;
+      matrix <T> normalized;
+      std::vector <T> batch_mean;
+      std::vector <T> batch_inverse_deviation;
+      std::vector <T> running_mean;
+      std::vector <T> running_variance;
+
+    public:
+      activation::kind activation_kind;
       ActivationFunc activation_function;
       ActivationFunc activation_function_derivative;
+      initializer::kind initialization;
+      approximate::precision activation_precision;
+      T batchnorm_momentum;
+      T batchnorm_epsilon;
     
     public:
       layer (int, ActivationFunc, ActivationFunc);
+      layer (int, activation::kind);
+      layer (int, activation::kind, initializer::kind);
+      layer (const conv2d_shape&, activation::kind);
+      layer (const conv2d_shape&, activation::kind, initializer::kind);
+      layer (layer_type, const pool2d_shape&);
+      layer (layer_type, int, activation::kind = activation::kind::identity);
 
       const matrix <T>& get_z            () const;
       const matrix <T>& get_activation   () const;
@@ -43,14 +91,23 @@ namespace fmc {
       const matrix <T>& get_bias         () const;
       const matrix <T>& get_delta        () const;
       int               get_neuron_count () const;
+      bool              has_parameters   () const;
 
-      void backward_propagate (layer&, const T&);
-      void calculate_delta    (const layer&);
-      void forward_propagate  (layer&);
+      void backward_propagate (layer&, const optimizer <T>&);
+      void calculate_delta    (layer&);
+      void fold               (matrix <T>&, matrix <T>&) const;
+      void forward_propagate  (layer&, bool = false);
       void join_layer         (const layer&);
       void randomize          ();
+      void resize_batch       (int);
       void set_activation     (const matrix <T>&);
       void set_delta          (const matrix <T>&);
+
+    private:
+      bool keeps_z   () const;
+      void normalize (const T*, int, bool);
+
+    public:
       
       template <typename E>
       friend void network <E>::join_layers ();
@@ -69,38 +126,165 @@ namespace fmc {
       T cost;
       T learning_rate;
       std::vector <layer <T>> layers;
+      optimizer <T> update_rule;
     
     public:
       LossFunction loss_function;
       LossFunction loss_function_derivative;
+
+    private:
+      training_telemetry telemetry;
     
     public:
       network (const T&, LossFunction, LossFunction);
       
-      network& add                (const layer <T>&);
-      network& add                (layer <T>&&);
-      void     backward_propagate ();
-      void     calculate_delta    ();
-      void     calculate_loss     (int);
-      network& compile            ();
-      network& evaluate           (const std::vector <matrix <T>>&, const std::vector <int>&);
-      network& fit                (const std::vector <matrix <T>>&, const std::vector <int>&, int);
-      void     forward_propagate  (const matrix <T>&);
-      void     join_layers        ();
-      network& load               (const std::string&);
-      int      predict            (const matrix <T>&);
-      void     randomize          ();
-      network& save               (const std::string&);
+      network&            add                (const layer <T>&);
+      network&            add                (layer <T>&&);
+      void                backward_propagate ();
+      void                calculate_delta    ();
+      void                calculate_loss     (int);
+      void                calculate_loss     (std::span <const int>);
+      network&            compile            (bool = true);
+      evaluation_result   evaluate           (const std::vector <matrix <T>>&, const std::vector <int>&, int = 0) const;
+      evaluation_result   evaluate           (const dataset&, int = 0) const;
+      network&            fit                (const std::vector <matrix <T>>&, const std::vector <int>&, int);
+      network&            fit                (const std::vector <matrix <T>>&, const std::vector <int>&, const fit_options&);
+      network&            fit                (const std::vector <matrix <T>>&, const std::vector <int>&,
+                                              const std::vector <matrix <T>>&, const std::vector <int>&, const fit_options&);
+      network&            fit                (const dataset&, const fit_options&);
+      network&            fit                (const dataset&, const dataset&, const fit_options&);
+      network&            fit                (const shard_stream&, const fit_options&);
+      network&            fit                (const shard_stream&, const dataset&, const fit_options&);
+      void                forward_propagate  (const matrix <T>&);
+      inference_model <T> freeze             () const;
+      void                join_layers        ();
+      network&            load               (const std::string&);
+      int                 predict            (const matrix <T>&);
+      void                randomize          ();
+      network&            save               (const std::string&);
+      network&            set_optimizer      (const optimizer <T>&);
+
+    private:
+      void   capture        (training_state <T>&, int, int) const;
+      bool   fused_output   () const;
+      void   gather         (const std::vector <matrix <T>>&, std::span <const int>);
+      void   gather         (const dataset&, std::span <const int>, int, augmenter&);
+      void   gather         (const typename data_loader <T>::batch&);
+      void   propagate      ();
+      void   restore        (const training_state <T>&);
+      double training_flops () const;
+
+      friend class trainer <T, network>;
   };
 
   template <typename T>
   layer <T>::layer (int neuron_count, ActivationFunc activation_function,
                     ActivationFunc activation_function_derivative)
-    : neuron_count (neuron_count),
+    : type (layer_type::dense),
+      neuron_count (neuron_count),
+      activation_kind (activation::kind_of(activation_function)),
       activation_function (activation_function),
-      activation_function_derivative (activation_function_derivative)
+      activation_function_derivative (activation_function_derivative),
+      initialization (initializer::default_for(activation_kind)),
+      activation_precision (approximate::precision::exact),
+      batchnorm_momentum (0.9),
+      batchnorm_epsilon (1e-5)
+  { }
+
+  template <typename T>
+  layer <T>::layer (int neuron_count, activation::kind activation_kind)
+    : layer (neuron_count, activation_kind, initializer::default_for(activation_kind))
   { }
 
+  template <typename T>
+  layer <T>::layer (int neuron_count, activation::kind activation_kind, initializer::kind initialization)
+    : type (layer_type::dense),
+      neuron_count (neuron_count),
+      activation_kind (activation_kind),
+      activation_function (nullptr),
+      activation_function_derivative (nullptr),
+      initialization (initialization),
+      activation_precision (approximate::precision::exact),
+      batchnorm_momentum (0.9),
+      batchnorm_epsilon (1e-5) {
+    switch (activation_kind) {
+      case activation::kind::sigmoid:
+        activation_function = activation::sigmoid <T>;
+        activation_function_derivative = activation::sigmoid_derivative <T>;
+        break;
+      case activation::kind::relu:
+        activation_function = activation::relu <T>;
+        activation_function_derivative = activation::relu_derivative <T>;
+        break;
+      case activation::kind::tanh:
+        activation_function = activation::tanh <T>;
+        activation_function_derivative = activation::tanh_derivative <T>;
+        break;
+      case activation::kind::identity:
+        activation_function = activation::identity <T>;
+        activation_function_derivative = activation::identity_derivative <T>;
+        break;
+      case activation::kind::softmax:
+        break;
+      case activation::kind::custom:
+        throw std::runtime_error("custom activations must be given as function pointers");
+    }
+  }
+
+  template <typename T>
+  layer <T>::layer (const conv2d_shape& shape, activation::kind activation_kind)
+    : layer (shape, activation_kind, initializer::default_for(activation_kind))
+  { }
+
+  /**
+   * @brief Convolution layer: `shape.filters` kernels of `shape.kernel_size` squared pixels slid
+   *        over the (height x width x channels) output of the previous layer, which must hold
+   *        exactly `shape.input_size()` neurons. Its own output is channels-last as well, so
+   *        convolutions stack and a dense layer can follow directly.
+   */
+  template <typename T>
+  layer <T>::layer (const conv2d_shape& shape, activation::kind activation_kind, initializer::kind initialization)
+    : layer (shape.valid() ? shape.output_size() : 0, activation_kind, initialization) {
+    if (not shape.valid())
+      throw std::runtime_error("invalid convolution shape");
+    type = layer_type::conv2d;
+    convolution = shape;
+  }
+
+  /**
+   * @brief Max or average pooling layer over the (height x width x channels) output of the
+   *        previous layer, which must hold exactly `shape.input_size()` neurons. It has no
+   *        weights and no activation of its own. A max pooling layer remembers which input
+   *        won every window during the forward pass and routes the delta straight back to it.
+   */
+  template <typename T>
+  layer <T>::layer (layer_type type, const pool2d_shape& shape)
+    : layer (shape.valid() ? shape.output_size() : 0, activation::kind::identity) {
+    if (type != layer_type::maxpool2d and type != layer_type::avgpool2d)
+      throw std::runtime_error("pooling layer needs a pooling layer type");
+    if (not shape.valid())
+      throw std::runtime_error("invalid pooling shape");
+    this->type = type;
+    pooling = shape;
+  }
+
+  /**
+   * @brief Layer defined by its width alone: `dense` is the same as layer (neuron_count,
+   *        activation_kind), and `batchnorm` normalizes each of the `neuron_count` outputs of
+   *        the previous layer over the batch, scales and shifts it by a learned gamma and beta
+   *        (kept in `weight` and `bias`), then applies its own activation.
+   *
+   * A batch normalization must follow a dense layer without activation (activation::kind::identity)
+   * so that freeze () can fold it into that layer's weights.
+   */
+  template <typename T>
+  layer <T>::layer (layer_type type, int neuron_count, activation::kind activation_kind)
+    : layer (neuron_count, activation_kind) {
+    if (type != layer_type::dense and type != layer_type::batchnorm)
+      throw std::runtime_error("layer type needs a convolution or pooling shape");
+    this->type = type;
+  }
+
   template <typename T>
   const matrix <T>& layer <T>::get_z () const {
     return z;
@@ -131,37 +315,261 @@ namespace fmc {
     return neuron_count;
   }
 
+  // Pooling layers have no weights or biases to train, save or load; a batch normalization
+  // keeps its gamma and beta in them
+  template <typename T>
+  bool layer <T>::has_parameters () const {
+    return type == layer_type::dense or type == layer_type::conv2d or type == layer_type::batchnorm;
+  }
+
+  // Gradients are averaged over the rows of the batch: dW = a^T delta / B, db = sum(delta) / B.
+  // A convolution is the same product over its unrolled patches, one row per output position,
+  // with delta viewed as (B * positions x filters). A batch normalization has
+  // dgamma = sum(delta * x_hat) / B and dbeta = sum(delta) / B.
+  // Plain SGD folds the step into the product and updates the weights in place; every other
+  // rule needs the gradient on its own and keeps its state in weight_state / bias_state.
   template <typename T>
-  void layer <T>::backward_propagate (layer <T>& layer, const T& learning_rate) {
-    weight -= layer.activation.transpose() * delta * learning_rate;
-    bias -= delta * learning_rate;
+  void layer <T>::backward_propagate (layer <T>& layer, const optimizer <T>& rule) {
+    if (not has_parameters())
+      return;
+
+    const int rows = delta.get_rows();
+    const int fan_in = weight.get_rows();
+    const int fan_out = weight.get_cols();
+    const std::size_t weight_count = (std::size_t)fan_in * fan_out;
+    const T scale = T(1) / rows;
+
+    const bool unrolled = type == layer_type::conv2d;
+    const T* inputs = unrolled ? columns.data() : layer.activation.data();
+    const int count = unrolled ? rows * convolution.positions() : rows;
+
+    if (rule.type == optimizer <T>::kind::sgd and type != layer_type::batchnorm) {
+      const T step = -rule.learning_rate * scale;
+      kernel::gemm_tn(inputs, delta.data(), weight.data(), fan_in, fan_out, count, step);
+      kernel::column_sum(delta.data(), bias.data(), count, fan_out, step);
+      return;
+    }
+
+    const std::size_t state_size = rule.state_size();
+
+    weight_gradient.assign(weight_count, 0);
+    bias_gradient.assign(fan_out, 0);
+    if (weight_state.size() != state_size * weight_count) {
+      weight_state.assign(state_size * weight_count, 0);
+      bias_state.assign(state_size * fan_out, 0);
+    }
+
+    if (type == layer_type::batchnorm) {
+      for (int r = 0; r < rows; ++r) {
+        const T* d = delta.data() + (std::size_t)r * fan_out;
+        const T* x = normalized.data() + (std::size_t)r * fan_out;
+        for (int j = 0; j < fan_out; ++j)
+          weight_gradient[j] += scale * d[j] * x[j];
+      }
+    }
+    else
+      kernel::gemm_tn(inputs, delta.data(), weight_gradient.data(), fan_in, fan_out, count, scale);
+    kernel::column_sum(delta.data(), bias_gradient.data(), count, fan_out, scale);
+
+    const bool decay = type != layer_type::batchnorm;
+    rule.update(weight.data(), weight_gradient.data(), weight_state.data(), weight_count, decay);
+    rule.update(bias.data(), bias_gradient.data(), bias_state.data(), fan_out, false);
   }
 
+  // delta = (next delta * next weight^T) * f'(z), with f'(z) taken from the activation output
+  // whenever the activation allows it. Below a convolution the product is taken per patch and
+  // folded back onto the pixels it came from by col2im; below a pooling layer the delta is
+  // scattered back over the windows. Below a batch normalization, with dy its delta,
+  // delta = gamma / (B * sigma) * (B * dy - sum(dy) - x_hat * sum(dy * x_hat)).
   template <typename T>
-  void layer <T>::calculate_delta (const layer <T>& layer) {
-    delta = layer.delta * layer.weight.transpose();
+  void layer <T>::calculate_delta (layer <T>& layer) {
+    const int rows = layer.delta.get_rows();
+
+#ifdef DEBUG_MODE
+    if (activation_kind == activation::kind::softmax)
+      throw std::runtime_error("softmax can only be used by the output layer");
+#endif
+
+    if (layer.type == layer_type::conv2d) {
+      const conv2d_shape& shape = layer.convolution;
+      kernel::gemm_nt(layer.delta.data(), layer.weight.data(), layer.column_delta.data(), rows * shape.positions(),
+                      shape.patch_size(), shape.filters);
+      std::fill(delta.data(), delta.data() + (std::size_t)rows * neuron_count, T(0));
+      conv::col2im(layer.column_delta.data(), delta.data(), rows, shape);
+    }
+    else if (layer.type == layer_type::maxpool2d) {
+      std::fill(delta.data(), delta.data() + (std::size_t)rows * neuron_count, T(0));
+      pool::max_backward(layer.delta.data(), layer.argmax.data(), delta.data(), rows, layer.pooling);
+    }
+    else if (layer.type == layer_type::avgpool2d) {
+      std::fill(delta.data(), delta.data() + (std::size_t)rows * neuron_count, T(0));
+      pool::average_backward(layer.delta.data(), delta.data(), rows, layer.pooling);
+    }
+    else if (layer.type == layer_type::batchnorm) {
+      const int n = neuron_count;
+
+      // the sums are the unscaled gradients of beta and gamma, which backward_propagate computes
+      // again once the deltas are done; their buffers already have the right size
+      layer.bias_gradient.assign(n, 0);
+      layer.weight_gradient.assign(n, 0);
+      T* delta_sum = layer.bias_gradient.data();
+      T* product_sum = layer.weight_gradient.data();
+
+      for (int r = 0; r < rows; ++r) {
+        const T* dy = layer.delta.data() + (std::size_t)r * n;
+        const T* x = layer.normalized.data() + (std::size_t)r * n;
+        for (int j = 0; j < n; ++j) {
+          delta_sum[j] += dy[j];
+          product_sum[j] += dy[j] * x[j];
+        }
+      }
+
+      for (int r = 0; r < rows; ++r) {
+        const T* dy = layer.delta.data() + (std::size_t)r * n;
+        const T* x = layer.normalized.data() + (std::size_t)r * n;
+        T* out = delta.data() + (std::size_t)r * n;
+        for (int j = 0; j < n; ++j)
+          out[j] = layer.weight.data()[j] * layer.batch_inverse_deviation[j] / rows
+                 * (rows * dy[j] - delta_sum[j] - x[j] * product_sum[j]);
+      }
+    }
+    else
+      kernel::gemm_nt(layer.delta.data(), layer.weight.data(), delta.data(), rows, neuron_count, layer.neuron_count);
+
+    activation::apply_derivative(activation_kind, activation_function_derivative, z.data(), activation.data(),
+                                 delta.data(), (std::size_t)rows * neuron_count);
+  }
+
+  /**
+   * @brief Folds this batch normalization, with its running statistics, into the (inputs x n)
+   *        weight and (1 x n) bias of the dense layer before it:
+   *        W' = W * s, b' = (b - mean) * s + beta, with s = gamma / sqrt(variance + epsilon)
+   */
+  template <typename T>
+  void layer <T>::fold (matrix <T>& weight_, matrix <T>& bias_) const {
+    const int n = neuron_count;
+
+    if (type != layer_type::batchnorm or weight_.get_cols() != n or bias_.get_cols() != n)
+      throw std::runtime_error("only a batch normalization can be folded into the layer before it");
+
+    for (int j = 0; j < n; ++j) {
+      const T scale = weight.data()[j] / std::sqrt(running_variance[j] + batchnorm_epsilon);
+      bias_.data()[j] = (bias_.data()[j] - running_mean[j]) * scale + bias.data()[j];
+      for (int i = 0; i < weight_.get_rows(); ++i)
+        weight_.data()[(std::size_t)i * n + j] *= scale;
+    }
   }
 
+  // Layers whose derivative comes from their output never store z; the product goes straight
+  // into the activation and is transformed in place. `training` only matters to batch
+  // normalization, which uses the statistics of the batch instead of the running ones.
   template <typename T>
-  void layer <T>::forward_propagate (layer <T>& layer) {
-    layer.z = activation * layer.weight + layer.bias;
-    layer.activation = layer.z;
-    layer.activation(layer.activation_function);
+  void layer <T>::forward_propagate (layer <T>& layer, bool training) {
+    const int rows = activation.get_rows();
+    T* output = layer.activation.data();
+    T* product = layer.keeps_z() ? layer.z.data() : output;
+
+    if (layer.type == layer_type::maxpool2d) {
+      pool::max_forward(activation.data(), output, layer.argmax.data(), rows, layer.pooling);
+      return;
+    }
+    if (layer.type == layer_type::avgpool2d) {
+      pool::average_forward(activation.data(), output, rows, layer.pooling);
+      return;
+    }
+    if (layer.type == layer_type::batchnorm) {
+      layer.normalize(activation.data(), rows, training);
+      activation::apply(layer.activation_kind, layer.activation_function, output, rows, layer.neuron_count,
+                        layer.activation_precision);
+      return;
+    }
+
+    if (layer.type == layer_type::conv2d) {
+      const conv2d_shape& shape = layer.convolution;
+      conv::im2col(activation.data(), layer.columns.data(), rows, shape);
+      kernel::gemm_bias(layer.columns.data(), layer.weight.data(), layer.bias.data(), product, rows * shape.positions(),
+                        shape.filters, shape.patch_size(), shape.patch_size(), shape.filters);
+    }
+    else
+      kernel::gemm_bias(activation.data(), layer.weight.data(), layer.bias.data(), product,
+                        rows, layer.neuron_count, neuron_count, neuron_count, layer.neuron_count);
+
+    if (layer.keeps_z())
+      std::copy(layer.z.data(), layer.z.data() + (std::size_t)rows * layer.neuron_count, output);
+
+    activation::apply(layer.activation_kind, layer.activation_function, output, rows, layer.neuron_count,
+                      layer.activation_precision);
   }
 
   template <typename T>
   void layer <T>::join_layer (const layer <T>& layer) {
-    z          = matrix <T> (1, neuron_count);
+    z          = matrix <T> (keeps_z() ? 1 : 0, neuron_count);
     activation = matrix <T> (1, neuron_count);
     weight     = matrix <T> (layer.neuron_count, neuron_count);
     bias       = matrix <T> (1, neuron_count);
     delta      = matrix <T> (1, neuron_count);
+
+    if (type == layer_type::conv2d) {
+      if (layer.neuron_count != convolution.input_size())
+        throw std::runtime_error("convolution input shape does not match the previous layer");
+
+      weight = matrix <T> (convolution.patch_size(), convolution.filters);
+      bias   = matrix <T> (1, convolution.filters);
+      columns.assign((std::size_t)convolution.positions() * convolution.patch_size(), 0);
+      column_delta.assign(columns.size(), 0);
+    }
+    else if (not has_parameters()) {
+      if (layer.neuron_count != pooling.input_size())
+        throw std::runtime_error("pooling input shape does not match the previous layer");
+
+      weight = matrix <T> (0, 0);
+      bias   = matrix <T> (1, 0);
+      argmax.assign(type == layer_type::maxpool2d ? neuron_count : 0, 0);
+    }
+    else if (type == layer_type::batchnorm) {
+      if (layer.neuron_count != neuron_count)
+        throw std::runtime_error("batch normalization must have as many neurons as the previous layer");
+
+      weight     = matrix <T> (1, neuron_count);
+      normalized = matrix <T> (1, neuron_count);
+      batch_mean.assign(neuron_count, 0);
+      batch_inverse_deviation.assign(neuron_count, 0);
+    }
   }
   
+  // A batch normalization starts as the identity: gamma = 1, beta = 0 and unit running variance
   template <typename T>
   void layer <T>::randomize () {
-    bias([] ([[maybe_unused]] const T& _) { return random::random <T> (-1, 1); });
-    weight([] ([[maybe_unused]] const T& _) { return random::random <T> (-1, 1); });
+    if (type == layer_type::batchnorm) {
+      std::fill(weight.data(), weight.data() + neuron_count, T(1));
+      std::fill(bias.data(), bias.data() + neuron_count, T(0));
+      running_mean.assign(neuron_count, 0);
+      running_variance.assign(neuron_count, 1);
+      return;
+    }
+
+    initializer::initialize(initialization, weight.data(), bias.data(), weight.get_rows(), weight.get_cols());
+  }
+
+  // Reshapes the per-sample matrices to hold `rows` samples; storage is kept between calls
+  template <typename T>
+  void layer <T>::resize_batch (int rows) {
+    if (activation.get_rows() == rows)
+      return;
+
+    if (keeps_z())
+      z.reshape(rows, neuron_count);
+    activation.reshape(rows, neuron_count);
+    delta.reshape(rows, neuron_count);
+
+    if (type == layer_type::conv2d) {
+      columns.resize((std::size_t)rows * convolution.positions() * convolution.patch_size());
+      column_delta.resize(columns.size());
+    }
+    if (type == layer_type::maxpool2d)
+      argmax.resize((std::size_t)rows * neuron_count);
+    if (type == layer_type::batchnorm)
+      normalized.reshape(rows, neuron_count);
   }
 
   template <typename T>
@@ -182,6 +590,74 @@ namespace fmc {
     delta = delta_;
   }
 
+  // Only custom activations need their pre-activation values for the derivative
+  template <typename T>
+  bool layer <T>::keeps_z () const {
+    return activation_kind == activation::kind::custom;
+  }
+
+  /**
+   * @brief Batch normalization of the `rows` x neuron_count inputs into the activation, before
+   *        the activation function. In training the batch statistics are used and folded into
+   *        the running ones (momentum `batchnorm_momentum`, unbiased variance); otherwise the
+   *        running statistics are.
+   */
+  template <typename T>
+  void layer <T>::normalize (const T* input, int rows, bool training) {
+    const int n = neuron_count;
+    const T* gamma = weight.data();
+    const T* beta = bias.data();
+    T* output = activation.data();
+
+    if (not training) {
+      for (int r = 0; r < rows; ++r) {
+        const T* x = input + (std::size_t)r * n;
+        T* y = output + (std::size_t)r * n;
+        for (int j = 0; j < n; ++j)
+          y[j] = gamma[j] * (x[j] - running_mean[j]) / std::sqrt(running_variance[j] + batchnorm_epsilon) + beta[j];
+      }
+      return;
+    }
+
+    std::fill(batch_mean.begin(), batch_mean.end(), T(0));
+    std::fill(batch_inverse_deviation.begin(), batch_inverse_deviation.end(), T(0));
+    T* mean = batch_mean.data();
+    T* deviation = batch_inverse_deviation.data();
+
+    for (int r = 0; r < rows; ++r) {
+      const T* x = input + (std::size_t)r * n;
+      for (int j = 0; j < n; ++j)
+        mean[j] += x[j];
+    }
+    for (int j = 0; j < n; ++j)
+      mean[j] /= rows;
+
+    for (int r = 0; r < rows; ++r) {
+      const T* x = input + (std::size_t)r * n;
+      for (int j = 0; j < n; ++j)
+        deviation[j] += (x[j] - mean[j]) * (x[j] - mean[j]);
+    }
+
+    const T m = batchnorm_momentum;
+    const T correction = rows > 1 ? T(rows) / (rows - 1) : T(1);
+    for (int j = 0; j < n; ++j) {
+      const T variance = deviation[j] / rows;
+      running_mean[j] = m * running_mean[j] + (1 - m) * mean[j];
+      running_variance[j] = m * running_variance[j] + (1 - m) * variance * correction;
+      deviation[j] = T(1) / std::sqrt(variance + batchnorm_epsilon);
+    }
+
+    for (int r = 0; r < rows; ++r) {
+      const T* x = input + (std::size_t)r * n;
+      T* x_hat = normalized.data() + (std::size_t)r * n;
+      T* y = output + (std::size_t)r * n;
+      for (int j = 0; j < n; ++j) {
+        x_hat[j] = (x[j] - mean[j]) * deviation[j];
+        y[j] = gamma[j] * x_hat[j] + beta[j];
+      }
+    }
+  }
+
   template <typename T>
   std::ostream& operator << (std::ostream& stream, const layer <T>& layer) {
     stream << "<layer object @" << &layer << ">: {\n"
@@ -201,6 +677,7 @@ namespace fmc {
     : layer_count (0),
       cost (T()),
       learning_rate (learning_rate),
+      update_rule (optimizer <T>::sgd(learning_rate)),
       loss_function (loss_function),
       loss_function_derivative (loss_function_derivative)
   { }
@@ -221,108 +698,362 @@ namespace fmc {
 
   template <typename T>
   void network <T>::backward_propagate () {
-    for (int i = layer_count - 1; i > 1; --i)
-      layers[i].backward_propagate(layers[i - 1], learning_rate);
+    auto time = telemetry.now();
+
+    update_rule.begin_step();
+    for (int i = layer_count - 1; i > 0; --i) {
+      layers[i].backward_propagate(layers[i - 1], update_rule);
+      time = telemetry.record(training_telemetry::phase::backward, i, time);
+    }
   }
 
   template <typename T>
   void network <T>::calculate_delta () {
-    for (int i = layer_count - 1; i > 1; --i)
+    auto time = telemetry.now();
+
+    for (int i = layer_count - 1; i > 1; --i) {
       layers[i - 1].calculate_delta(layers[i]);
+      time = telemetry.record(training_telemetry::phase::delta, i - 1, time);
+    }
   }
 
   template <typename T>
   void network <T>::calculate_loss (int label) {
-    int output_neuron_count = layers.back().get_neuron_count();
+    calculate_loss(std::span <const int> (&label, 1));
+  }
+
+  /**
+   * @brief Computes the mean cost of the current batch and the delta of the output layer,
+   *        one label per row of the batch
+   *
+   * A softmax output trained with cross-entropy takes the fused path: the delta is simply
+   * p - onehot(label) and the cost only needs log(p[label]), so neither the one-hot vector
+   * nor the per-element derivatives are ever evaluated.
+   */
+  template <typename T>
+  void network <T>::calculate_loss (std::span <const int> labels) {
+    layer <T>& output = layers.back();
+    const int output_neuron_count = output.get_neuron_count();
+    const int rows = labels.size();
 
 #ifdef DEBUG_MODE
-    if (label < 0 or label >= output_neuron_count)
-      throw std::runtime_error("label does not lie in the range of number of neurons in output layer");
+    if (rows != output.activation.get_rows())
+      throw std::runtime_error("number of labels does not match the batch size");
+    for (int label : labels)
+      if (label < 0 or label >= output_neuron_count)
+        throw std::runtime_error("label does not lie in the range of number of neurons in output layer");
 #endif
-    
-    const matrix <T>& z = layers.back().get_z();
-    const matrix <T>& predictions = layers.back().get_activation();
-    matrix <T> new_delta (1, output_neuron_count);
-    std::vector <T> expected (output_neuron_count, 0);
-    
-    expected[label] = 1;
+
+    const T* predictions = output.activation.data();
+    T* delta = output.delta.data();
+
     cost = 0;
 
-    for (int i = 0; i < output_neuron_count; ++i) {
-      T error = loss_function(predictions[0][i], expected[i]);
-      
-      T activation_z_derivative    = layers.back().activation_function_derivative(z.get_value(0, i));
-      T cost_activation_derivative = loss_function_derivative(predictions.get_value(0, i), expected[i]);
-      
-      cost += error;
-      new_delta.set_value(0, i, activation_z_derivative * cost_activation_derivative);
+    if (fused_output()) {
+      const T epsilon = std::numeric_limits <T>::min();
+
+      std::copy(predictions, predictions + (std::size_t)rows * output_neuron_count, delta);
+      for (int r = 0; r < rows; ++r) {
+        const std::size_t index = (std::size_t)r * output_neuron_count + labels[r];
+        cost -= std::log(std::max(predictions[index], epsilon));
+        delta[index] -= 1;
+      }
+
+      cost /= rows;
+      return;
     }
 
-    layers.back().set_delta(new_delta);
-    cost /= output_neuron_count;
+    for (int r = 0; r < rows; ++r) {
+      for (int i = 0; i < output_neuron_count; ++i) {
+        const std::size_t index = (std::size_t)r * output_neuron_count + i;
+        const T expected = i == labels[r] ? 1 : 0;
+
+        cost += loss_function(predictions[index], expected);
+        delta[index] = loss_function_derivative(predictions[index], expected);
+      }
+    }
+
+    activation::apply_derivative(output.activation_kind, output.activation_function_derivative, output.z.data(),
+                                 predictions, delta, (std::size_t)rows * output_neuron_count);
+    cost /= (T)rows * output_neuron_count;
+  }
+
+  /**
+   * @brief Snapshots everything fit needs to continue from sample `position` of `epoch`: the
+   *        parameters and optimizer state of every layer, batch normalization statistics, the
+   *        optimizer step count and the random generator
+   */
+  template <typename T>
+  void network <T>::capture (training_state <T>& state, int epoch, int position) const {
+    state.clear();
+    state.epoch = epoch;
+    state.position = position;
+    state.step_count = update_rule.step_count;
+    state.optimizer_kind = (int)update_rule.type;
+    state.save_generator();
+
+    for (int i = 1; i < layer_count; ++i) {
+      const auto& layer = layers[i];
+      if (not layer.has_parameters())
+        continue;
+
+      state.append(layer.weight.data(), (std::size_t)layer.weight.get_rows() * layer.weight.get_cols());
+      state.append(layer.bias.data(), (std::size_t)layer.bias.get_rows() * layer.bias.get_cols());
+      state.append(layer.weight_state.data(), layer.weight_state.size());
+      state.append(layer.bias_state.data(), layer.bias_state.size());
+
+      if (layer.type == layer_type::batchnorm) {
+        state.append(layer.running_mean.data(), layer.running_mean.size());
+        state.append(layer.running_variance.data(), layer.running_variance.size());
+      }
+    }
   }
 
+  /**
+   * @brief Checks the layers fit together and joins them. Their weights are then drawn by their
+   *        initializers, unless `initialize` is false because they are about to be loaded from
+   *        a model or a checkpoint anyway.
+   */
   template <typename T>
-  network <T>& network <T>::compile () {
+  network <T>& network <T>::compile (bool initialize) {
+    if (layers.front().type != layer_type::dense)
+      throw std::runtime_error("the input layer must be a dense layer");
+    for (int i = 1; i < layer_count; ++i)
+      if (layers[i].type == layer_type::batchnorm
+          and (i == 1 or layers[i - 1].type != layer_type::dense or layers[i - 1].activation_kind != activation::kind::identity))
+        throw std::runtime_error("batch normalization must follow a dense layer without activation");
+    for (int i = 0; i < layer_count - 1; ++i)
+      if (layers[i].activation_kind == activation::kind::softmax)
+        throw std::runtime_error("softmax can only be used by the output layer");
+    if (layers.back().activation_kind == activation::kind::softmax and not fused_output())
+      throw std::runtime_error("a softmax output layer must be trained with error::cross_entropy");
+
     join_layers();
-    randomize();
+    if (initialize)
+      randomize();
     return *this;
   }
 
+  /**
+   * @brief Scores the network on a labelled dataset through a frozen copy of its weights,
+   *        sharded across `thread_count` threads (0 uses every hardware thread)
+   */
   template <typename T>
-  network <T>& network <T>::evaluate (const std::vector <matrix <T>>& data, const std::vector <int>& labels) {
-#ifdef DEBUG_MODE
-    if (data.size() != labels.size())
-      throw std::runtime_error("data and labels must have same size");
-#endif
-
+  evaluation_result network <T>::evaluate (const std::vector <matrix <T>>& data, const std::vector <int>& labels,
+                                           int thread_count) const {
     std::cout << "[*] Testing model" << std::endl;
 
-    int correct_count = 0;
-    int total_count = data.size();
-
-    for (int i = 0; i < total_count; ++i) {
-      if (predict(data[i]) == labels[i])
-        ++correct_count;
-    }
+    return freeze().evaluate(data, labels, thread_count);
+  }
 
-    long double accuracy = (long double)correct_count * 100 / (long double)total_count;
-    
-    std::cout << "Accuracy: " << std::fixed << accuracy << '%' << std::endl;
+  template <typename T>
+  evaluation_result network <T>::evaluate (const dataset& data, int thread_count) const {
+    std::cout << "[*] Testing model" << std::endl;
 
-    return *this;
+    return freeze().evaluate(data, thread_count);
   }
 
   template <typename T>
   network <T>& network <T>::fit (const std::vector <matrix <T>>& data, const std::vector <int>& labels, int epochs) {
+    return fit(data, labels, fit_options {.epochs = epochs});
+  }
+
+  template <typename T>
+  network <T>& network <T>::fit (const std::vector <matrix <T>>& data, const std::vector <int>& labels,
+                                 const fit_options& options) {
+    return fit(data, labels, {}, {}, options);
+  }
+
+  /**
+   * @brief Trains the network with mini-batch gradient descent
+   *
+   * Every step propagates `batch_size` samples together as one (batch_size x neuron_count)
+   * matrix per layer, and the weights are updated once with the gradient averaged over the
+   * batch. The last batch of an epoch holds whatever samples are left.
+   *
+   * With a `checkpoint_path`, a snapshot of the parameters, the optimizer state, the random
+   * generator and the position in the data is taken every `checkpoint_steps` steps and / or
+   * `checkpoint_seconds` seconds and written by a background thread (see checkpoint_writer);
+   * fit returns once the last one is on disk. `resume_from` restores such a checkpoint, into
+   * a network with the same layers and optimizer, and continues from the next batch it would
+   * have trained on, giving the same result as if training had never stopped.
+   *
+   * `shuffle` sets the order every epoch visits the samples in (see sample_order), and
+   * `augmentation` the random transformations of the images of a dataset (see augmenter).
+   * Both are drawn from `data_seed`, or from random::generator when it is 0, so that seeding
+   * the generator fixes the whole run. The seed is part of checkpoints. Samples are gathered
+   * by index into the contiguous batch of the input layer, so the data itself is never
+   * reordered or modified.
+   *
+   * With a validation set, the network is frozen at the end of every epoch and validated on a
+   * background thread while the next epoch trains (see early_stopping). Training stops once
+   * the validation accuracy has not improved by more than `min_delta` percentage points for
+   * `patience` epochs, and the network is put back to the end of its most accurate epoch,
+   * optimizer state included. Early stopping is not part of checkpoints and starts over on
+   * resume.
+   *
+   * With a `telemetry_path` or `telemetry_callback`, the time spent in every phase of every
+   * layer, throughput, GFLOP/s and the mean loss are reported every `telemetry_steps` steps as
+   * training_metrics, written as JSON lines (see training_telemetry).
+   */
+  template <typename T>
+  network <T>& network <T>::fit (const std::vector <matrix <T>>& data, const std::vector <int>& labels,
+                                 const std::vector <matrix <T>>& validation_data,
+                                 const std::vector <int>& validation_labels, const fit_options& options) {
 #ifdef DEBUG_MODE
-    if (data.size() != labels.size())
+    if (data.size() != labels.size() or validation_data.size() != validation_labels.size())
       throw std::runtime_error("data and labels must have same size");
 #endif
 
-    std::cout << "[*] Training model" << std::endl;
+    typename early_stopping <T>::validator validate = nullptr;
+    if (not validation_data.empty())
+      validate = [&] (const inference_model <T>& model) { return model.evaluate(validation_data, validation_labels, 1); };
 
-    for (int epoch = 0; epoch < epochs; ++epoch) {
-      std::cout << "[*] Epoch: " << epoch + 1 << '/' << epochs << std::endl;
+    return trainer <T, network>::train(*this, data, labels, validate, options);
+  }
 
-      for (int i = 0; i < (int)data.size(); ++i) {
-        forward_propagate(data[i]);
-        calculate_loss(labels[i]);
-        calculate_delta();
-        backward_propagate();
-      }
-    }
+  /**
+   * @brief Same as fit (data, labels, options) on a dataset of bytes, which are widened into
+   *        the input layer one batch at a time
+   */
+  template <typename T>
+  network <T>& network <T>::fit (const dataset& data, const fit_options& options) {
+    return trainer <T, network>::train(*this, data, data.get_labels(), nullptr, options);
+  }
 
-    return *this;
+  /**
+   * @brief Same as fit (data, labels, validation_data, validation_labels, options) on datasets
+   *        of bytes
+   */
+  template <typename T>
+  network <T>& network <T>::fit (const dataset& data, const dataset& validation, const fit_options& options) {
+    typename early_stopping <T>::validator validate = nullptr;
+    if (validation.size() > 0)
+      validate = [&] (const inference_model <T>& model) { return model.evaluate(validation, 1); };
+
+    return trainer <T, network>::train(*this, data, data.get_labels(), validate, options);
+  }
+
+  /**
+   * @brief Same as fit (data, options) on a set streamed from its shards, for sets that do not
+   *        fit in memory
+   *
+   * The stream is read ahead by a single data_loader thread, so `prefetch` must be positive
+   * and `loader_threads` is ignored. A shuffle visits the shards in a random order and
+   * shuffles the samples within the window of the stream (see shard_stream::reader), whatever
+   * its mode. The I/O throughput of the stream is logged at the end.
+   */
+  template <typename T>
+  network <T>& network <T>::fit (const shard_stream& data, const fit_options& options) {
+    return trainer <T, network>::train(*this, data, {}, nullptr, options);
+  }
+
+  /**
+   * @brief Same as fit (data, options) on a streamed set, validated on a dataset held in memory
+   */
+  template <typename T>
+  network <T>& network <T>::fit (const shard_stream& data, const dataset& validation, const fit_options& options) {
+    typename early_stopping <T>::validator validate = nullptr;
+    if (validation.size() > 0)
+      validate = [&] (const inference_model <T>& model) { return model.evaluate(validation, 1); };
+
+    return trainer <T, network>::train(*this, data, {}, validate, options);
   }
 
   template <typename T>
   void network <T>::forward_propagate (const matrix <T>& data) {
+    for (auto& layer : layers)
+      layer.resize_batch(data.get_rows());
+
     layers.front().set_activation(data);
     for (int i = 0; i < layer_count - 1; ++i)
       layers[i].forward_propagate(layers[i + 1]);
   }
 
+  /**
+   * @brief Packs the current weights, biases and activations into an immutable model
+   *        that can be shared by any number of threads for prediction. Batch normalizations
+   *        are folded into the dense layer before them and cost nothing at inference.
+   */
+  template <typename T>
+  inference_model <T> network <T>::freeze () const {
+    inference_model <T> model;
+    for (int i = 1; i < layer_count; ++i)
+      if (i + 1 < layer_count and layers[i + 1].type == layer_type::batchnorm) {
+        const layer <T>& normalization = layers[i + 1];
+        matrix <T> weight = layers[i].get_weight();
+        matrix <T> bias = layers[i].get_bias();
+
+        normalization.fold(weight, bias);
+        model.add_stage(weight, bias, normalization.activation_kind, normalization.activation_function,
+                        normalization.activation_precision);
+        ++i;
+      }
+      else if (not layers[i].has_parameters())
+        model.add_stage(layers[i].type, layers[i].pooling);
+      else if (layers[i].type == layer_type::conv2d)
+        model.add_stage(layers[i].get_weight(), layers[i].get_bias(), layers[i].convolution, layers[i].activation_kind,
+                        layers[i].activation_function, layers[i].activation_precision);
+      else
+        model.add_stage(layers[i].get_weight(), layers[i].get_bias(), layers[i].activation_kind,
+                        layers[i].activation_function, layers[i].activation_precision);
+    return model;
+  }
+
+  template <typename T>
+  bool network <T>::fused_output () const {
+    return layers.back().activation_kind == activation::kind::softmax
+       and loss_function == &error::cross_entropy <T>;
+  }
+
+  // Copies the samples at `indices` into the rows of the input layer
+  template <typename T>
+  void network <T>::gather (const std::vector <matrix <T>>& data, std::span <const int> indices) {
+    for (auto& layer : layers)
+      layer.resize_batch(indices.size());
+
+    const int input_size = layers.front().get_neuron_count();
+    T* values = layers.front().activation.data();
+
+    for (std::size_t r = 0; r < indices.size(); ++r)
+      std::copy(data[indices[r]].data(), data[indices[r]].data() + input_size, values + r * input_size);
+  }
+
+  // Widens the samples at `indices`, augmented as drawn for `epoch`, into the input layer
+  template <typename T>
+  void network <T>::gather (const dataset& data, std::span <const int> indices, int epoch, augmenter& augment) {
+#ifdef DEBUG_MODE
+    if ((int)data.get_sample_size() != layers.front().get_neuron_count())
+      throw std::runtime_error("samples do not match the size of the input layer");
+#endif
+
+    for (auto& layer : layers)
+      layer.resize_batch(indices.size());
+
+    augment.widen(data, indices, epoch, layers.front().activation.data());
+  }
+
+  // Copies a batch assembled by a data_loader into the input layer
+  template <typename T>
+  void network <T>::gather (const typename data_loader <T>::batch& batch) {
+    for (auto& layer : layers)
+      layer.resize_batch(batch.rows);
+
+    std::copy(batch.values, batch.values + (std::size_t)batch.rows * layers.front().get_neuron_count(),
+              layers.front().activation.data());
+  }
+
+  // Forward pass of the batch gathered into the input layer, in training mode
+  template <typename T>
+  void network <T>::propagate () {
+    auto time = telemetry.now();
+
+    for (int i = 0; i < layer_count - 1; ++i) {
+      layers[i].forward_propagate(layers[i + 1], true);
+      time = telemetry.record(training_telemetry::phase::forward, i + 1, time);
+    }
+  }
+
   template <typename T>
   void network <T>::join_layers () {
     layer <T> dummy (0, activation::sigmoid, activation::sigmoid_derivative);
@@ -344,6 +1075,9 @@ namespace fmc {
       throw std::runtime_error("unable to load model from provided file path");
     
     for (int i = 1; i < layer_count; ++i) {
+      if (not layers[i].has_parameters())
+        continue;
+
       std::getline(file, header);
       std::cout << "[*] Reading " << header << std::endl;
       file >> layers[i].bias;
@@ -353,6 +1087,15 @@ namespace fmc {
       std::cout << "[*] Reading " << header << std::endl;
       file >> layers[i].weight;
       file.get(newline);
+
+      if (layers[i].type == layer_type::batchnorm)
+        for (std::vector <T>* statistic : {&layers[i].running_mean, &layers[i].running_variance}) {
+          std::getline(file, header);
+          std::cout << "[*] Reading " << header << std::endl;
+          for (T& value : *statistic)
+            file >> value;
+          file.get(newline);
+        }
     }
 
     file.close();
@@ -380,6 +1123,50 @@ namespace fmc {
     std::for_each(layers.begin(), layers.end(), [] (layer <T>& layer) { layer.randomize(); });
   }
 
+  /**
+   * @brief Puts back the state taken by capture(). The network must have the same layers and
+   *        optimizer as the one that was captured.
+   */
+  template <typename T>
+  void network <T>::restore (const training_state <T>& state) {
+    if (state.optimizer_kind != (int)update_rule.type)
+      throw std::runtime_error("checkpoint was written with a different optimizer");
+
+    const std::size_t state_size = update_rule.state_size();
+    std::size_t index = 0;
+
+    // optimizer state is empty until the first step
+    auto restore_state = [&] (std::vector <T>& values, std::size_t count) {
+      values.resize(index < state.sizes.size() and state.sizes[index] == 0 ? 0 : state_size * count);
+      state.extract(index++, values.data(), values.size());
+    };
+
+    for (int i = 1; i < layer_count; ++i) {
+      auto& layer = layers[i];
+      if (not layer.has_parameters())
+        continue;
+
+      const std::size_t weight_count = (std::size_t)layer.weight.get_rows() * layer.weight.get_cols();
+      const std::size_t bias_count = (std::size_t)layer.bias.get_rows() * layer.bias.get_cols();
+
+      state.extract(index++, layer.weight.data(), weight_count);
+      state.extract(index++, layer.bias.data(), bias_count);
+      restore_state(layer.weight_state, weight_count);
+      restore_state(layer.bias_state, bias_count);
+
+      if (layer.type == layer_type::batchnorm) {
+        state.extract(index++, layer.running_mean.data(), layer.running_mean.size());
+        state.extract(index++, layer.running_variance.data(), layer.running_variance.size());
+      }
+    }
+
+    if (index != state.sizes.size())
+      throw std::runtime_error("checkpoint does not match the shape of the network");
+
+    update_rule.step_count = state.step_count;
+    state.restore_generator();
+  }
+
   template <typename T>
   network <T>& network <T>::save (const std::string& filepath) {
     std::cout << "[*] Saving neural network model to \"" << filepath << "\"" << std::endl;
@@ -388,10 +1175,20 @@ namespace fmc {
     file << std::fixed << std::setprecision(20);
 
     for (int i = 1; i < layer_count; ++i) {
+      if (not layers[i].has_parameters())
+        continue;
+
       file << "[layer " << i << " bias]\n";
       file << layers[i].get_bias() << '\n';
       file << "[layer " << i << " weight]\n";
       file << layers[i].get_weight() << '\n';
+
+      if (layers[i].type == layer_type::batchnorm) {
+        file << "[layer " << i << " running mean]\n";
+        file << matrix <T> (1, layers[i].neuron_count, std::vector <std::vector <T>> {layers[i].running_mean}) << '\n';
+        file << "[layer " << i << " running variance]\n";
+        file << matrix <T> (1, layers[i].neuron_count, std::vector <std::vector <T>> {layers[i].running_variance}) << '\n';
+      }
     }
 
     file.close();
@@ -399,6 +1196,45 @@ namespace fmc {
     return *this;
   }
 
+  /**
+   * @brief Replaces the update rule (plain SGD with the constructor's learning rate by default).
+   *        The state of the previous rule is discarded.
+   */
+  template <typename T>
+  network <T>& network <T>::set_optimizer (const optimizer <T>& rule) {
+    update_rule = rule;
+    learning_rate = rule.learning_rate;
+
+    for (auto& layer : layers) {
+      layer.weight_state.clear();
+      layer.bias_state.clear();
+    }
+
+    return *this;
+  }
+
+  /**
+   * @brief Floating point operations of the matrix products of one training step, per sample:
+   *        the forward pass, the weight gradient and, above the first layer, the delta of the
+   *        layer below, each two operations per multiply-add
+   */
+  template <typename T>
+  double network <T>::training_flops () const {
+    double flops = 0;
+
+    for (int i = 1; i < layer_count; ++i) {
+      const auto& layer = layers[i];
+      if (layer.type != layer_type::dense and layer.type != layer_type::conv2d)
+        continue;
+
+      const int positions = layer.type == layer_type::conv2d ? layer.convolution.positions() : 1;
+      const double products = (double)layer.weight.get_rows() * layer.weight.get_cols() * positions;
+      flops += 2 * products * (i > 1 ? 3 : 2);
+    }
+
+    return flops;
+  }
+
 } // namespace fmc
 
 #endif // FMC_NN_HPP
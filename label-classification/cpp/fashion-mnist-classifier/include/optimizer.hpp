@@ -0,0 +1,218 @@
+// Arrow
+
+#ifndef FMC_OPTIMIZER_HPP
+#define FMC_OPTIMIZER_HPP
+
+#include <cmath>
+#include <cstddef>
+
+namespace fmc {
+
+  /**
+   * @brief update rule applied to the parameters of a network after every batch
+   *
+   * Holds only hyperparameters and the step count; the per-parameter state (velocity, first
+   * and second moments) lives next to the weights and biases of every layer, `state_size()`
+   * values per parameter. Every rule updates a whole parameter array in one fused pass.
+   *
+   * @tparam T type of the parameters
+   */
+  template <typename T>
+  class optimizer {
+    public:
+      enum class kind {
+        sgd,
+        momentum,
+        nesterov,
+        adam,
+        adamw
+      };
+
+    public:
+      kind type;
+      T learning_rate;
+      T momentum;
+      T beta1;
+      T beta2;
+      T epsilon;
+      T weight_decay;
+      long step_count;
+
+    private:
+      T first_correction;
+      T second_correction;
+
+    public:
+      optimizer (kind, const T&);
+
+      static optimizer sgd          (const T&);
+      static optimizer momentum_sgd (const T&, const T& = 0.9);
+      static optimizer nesterov     (const T&, const T& = 0.9);
+      static optimizer adam         (const T&, const T& = 0.9, const T& = 0.999, const T& = 1e-8);
+      static optimizer adamw        (const T&, const T& = 0.01, const T& = 0.9, const T& = 0.999, const T& = 1e-8);
+
+      void begin_step ();
+      int  state_size () const;
+      void update     (T*, const T*, T*, std::size_t, bool) const;
+  };
+
+  template <typename T>
+  optimizer <T>::optimizer (kind type, const T& learning_rate)
+    : type (type),
+      learning_rate (learning_rate),
+      momentum (0.9),
+      beta1 (0.9),
+      beta2 (0.999),
+      epsilon (1e-8),
+      weight_decay (0),
+      step_count (0),
+      first_correction (1),
+      second_correction (1)
+  { }
+
+  /**
+   * @brief Plain gradient descent: p -= lr * g
+   */
+  template <typename T>
+  optimizer <T> optimizer <T>::sgd (const T& learning_rate) {
+    return optimizer (kind::sgd, learning_rate);
+  }
+
+  /**
+   * @brief Heavy-ball momentum: v = mu * v + g, p -= lr * v
+   */
+  template <typename T>
+  optimizer <T> optimizer <T>::momentum_sgd (const T& learning_rate, const T& momentum) {
+    optimizer result (kind::momentum, learning_rate);
+    result.momentum = momentum;
+    return result;
+  }
+
+  /**
+   * @brief Nesterov momentum: v = mu * v + g, p -= lr * (g + mu * v)
+   */
+  template <typename T>
+  optimizer <T> optimizer <T>::nesterov (const T& learning_rate, const T& momentum) {
+    optimizer result (kind::nesterov, learning_rate);
+    result.momentum = momentum;
+    return result;
+  }
+
+  /**
+   * @brief Adam with bias-corrected first and second moment estimates
+   */
+  template <typename T>
+  optimizer <T> optimizer <T>::adam (const T& learning_rate, const T& beta1, const T& beta2, const T& epsilon) {
+    optimizer result (kind::adam, learning_rate);
+    result.beta1 = beta1;
+    result.beta2 = beta2;
+    result.epsilon = epsilon;
+    return result;
+  }
+
+  /**
+   * @brief Adam with weight decay decoupled from the gradient: p -= lr * decay * p before the
+   *        Adam step. Biases are not decayed.
+   */
+  template <typename T>
+  optimizer <T> optimizer <T>::adamw (const T& learning_rate, const T& weight_decay, const T& beta1,
+                                      const T& beta2, const T& epsilon) {
+    optimizer result (kind::adamw, learning_rate);
+    result.weight_decay = weight_decay;
+    result.beta1 = beta1;
+    result.beta2 = beta2;
+    result.epsilon = epsilon;
+    return result;
+  }
+
+  /**
+   * @brief Advances the step count; called once per batch before any parameter is updated
+   */
+  template <typename T>
+  void optimizer <T>::begin_step () {
+    ++step_count;
+    if (type == kind::adam or type == kind::adamw) {
+      first_correction = T(1) / (1 - std::pow(beta1, (T)step_count));
+      second_correction = T(1) / (1 - std::pow(beta2, (T)step_count));
+    }
+  }
+
+  /**
+   * @brief Number of state values the rule keeps per parameter
+   */
+  template <typename T>
+  int optimizer <T>::state_size () const {
+    switch (type) {
+      case kind::sgd:
+        return 0;
+      case kind::momentum:
+      case kind::nesterov:
+        return 1;
+      case kind::adam:
+      case kind::adamw:
+        return 2;
+    }
+    return 0;
+  }
+
+  /**
+   * @brief Applies one step of the rule to `size` parameters in a single pass
+   *
+   * @tparam T type of the parameters
+   * @param parameters values to update in place
+   * @param gradient gradient of the loss w.r.t. every parameter
+   * @param state `state_size()` consecutive arrays of `size` values each, zero before the first step
+   * @param size number of parameters
+   * @param decay whether the parameters are subject to weight decay (weights are, biases are not)
+   */
+  template <typename T>
+  void optimizer <T>::update (T* __restrict parameters, const T* __restrict gradient, T* __restrict state,
+                              std::size_t size, bool decay) const {
+    const T lr = learning_rate;
+
+    switch (type) {
+      case kind::sgd:
+        for (std::size_t i = 0; i < size; ++i)
+          parameters[i] -= lr * gradient[i];
+        break;
+
+      case kind::momentum: {
+        const T mu = momentum;
+        for (std::size_t i = 0; i < size; ++i) {
+          state[i] = mu * state[i] + gradient[i];
+          parameters[i] -= lr * state[i];
+        }
+        break;
+      }
+
+      case kind::nesterov: {
+        const T mu = momentum;
+        for (std::size_t i = 0; i < size; ++i) {
+          state[i] = mu * state[i] + gradient[i];
+          parameters[i] -= lr * (gradient[i] + mu * state[i]);
+        }
+        break;
+      }
+
+      case kind::adam:
+      case kind::adamw: {
+        T* __restrict first = state;
+        T* __restrict second = state + size;
+        const T b1 = beta1, b2 = beta2, eps = epsilon;
+        const T c1 = first_correction, c2 = second_correction;
+        const T shrink = type == kind::adamw and decay ? 1 - lr * weight_decay : 1;
+
+        for (std::size_t i = 0; i < size; ++i) {
+          const T g = gradient[i];
+          first[i] = b1 * first[i] + (1 - b1) * g;
+          second[i] = b2 * second[i] + (1 - b2) * g * g;
+          parameters[i] = shrink * parameters[i] - lr * (first[i] * c1) / (std::sqrt(second[i] * c2) + eps);
+        }
+        break;
+      }
+    }
+  }
+
+} // namespace fmc
+
+#endif // FMC_OPTIMIZER_HPP
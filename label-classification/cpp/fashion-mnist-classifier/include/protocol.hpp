@@ -0,0 +1,169 @@
+// Arrow
+
+#ifndef FMC_PROTOCOL_HPP
+#define FMC_PROTOCOL_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace fmc {
+
+  /**
+   * Length-prefixed binary protocol spoken by fmc-serve. Every integer is little-endian.
+   *
+   * request:  u32 length | u32 count | count * image_size u8 pixels
+   * response: u32 length | u32 status | u32 count | u32 classes | count * (u32 label | classes * f32 probability)
+   *
+   * `length` counts the bytes that follow it. Several requests may be pipelined on one
+   * connection; responses come back in the same order.
+   */
+  namespace protocol {
+
+    const int image_size = 28 * 28;
+    const int max_count = 4096;
+    const std::size_t header_size = 4;
+
+    enum status_code : std::uint32_t {
+      ok = 0,
+      bad_request = 1
+    };
+
+    inline void put_u32 (std::vector <std::uint8_t>& buffer, std::uint32_t value) {
+      for (int i = 0; i < 4; ++i)
+        buffer.push_back((value >> (8 * i)) & 0xff);
+    }
+
+    inline std::uint32_t get_u32 (const std::uint8_t* data) {
+      return (std::uint32_t)data[0] | (std::uint32_t)data[1] << 8 | (std::uint32_t)data[2] << 16 | (std::uint32_t)data[3] << 24;
+    }
+
+    inline void put_f32 (std::vector <std::uint8_t>& buffer, float value) {
+      std::uint32_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      put_u32(buffer, bits);
+    }
+
+    inline float get_f32 (const std::uint8_t* data) {
+      std::uint32_t bits = get_u32(data);
+      float value;
+      std::memcpy(&value, &bits, sizeof(value));
+      return value;
+    }
+
+    /**
+     * @brief Returns the total size (prefix included) of the frame at the start of `buffer`,
+     *        or 0 if not even the length prefix has arrived yet
+     */
+    inline std::size_t frame_size (std::span <const std::uint8_t> buffer) {
+      return buffer.size() < header_size ? 0 : header_size + get_u32(buffer.data());
+    }
+
+    /**
+     * @brief Appends a request frame for `count` images of `image_size` pixels each
+     */
+    inline void encode_request (std::vector <std::uint8_t>& buffer, std::span <const std::uint8_t> pixels) {
+      if (pixels.size() % image_size != 0)
+        throw std::runtime_error("request pixels must hold a whole number of images");
+
+      std::uint32_t count = pixels.size() / image_size;
+
+      put_u32(buffer, 4 + pixels.size());
+      put_u32(buffer, count);
+      buffer.insert(buffer.end(), pixels.begin(), pixels.end());
+    }
+
+    /**
+     * @brief Validates a whole request frame and returns a view of its pixels; empty if the
+     *        frame is malformed
+     */
+    inline std::span <const std::uint8_t> decode_request (std::span <const std::uint8_t> frame) {
+      if (frame.size() < 2 * header_size)
+        return {};
+
+      std::uint32_t count = get_u32(frame.data() + header_size);
+
+      if (count == 0 or count > (std::uint32_t)max_count or frame.size() != 2 * header_size + (std::size_t)count * image_size)
+        return {};
+      return frame.subspan(2 * header_size);
+    }
+
+    /**
+     * @brief Appends a response frame holding the label and the `classes` probabilities of every image
+     */
+    template <typename T>
+    void encode_response (std::vector <std::uint8_t>& buffer, std::span <const T> probabilities, int classes) {
+      std::uint32_t count = classes == 0 ? 0 : probabilities.size() / classes;
+
+      put_u32(buffer, 12 + (std::size_t)count * (4 + 4 * classes));
+      put_u32(buffer, status_code::ok);
+      put_u32(buffer, count);
+      put_u32(buffer, classes);
+
+      for (std::uint32_t i = 0; i < count; ++i) {
+        const T* row = probabilities.data() + (std::size_t)i * classes;
+        int label = 0;
+
+        for (int j = 1; j < classes; ++j)
+          if (row[j] > row[label])
+            label = j;
+
+        put_u32(buffer, label);
+        for (int j = 0; j < classes; ++j)
+          put_f32(buffer, row[j]);
+      }
+    }
+
+    inline void encode_error (std::vector <std::uint8_t>& buffer, status_code code) {
+      put_u32(buffer, 12);
+      put_u32(buffer, code);
+      put_u32(buffer, 0);
+      put_u32(buffer, 0);
+    }
+
+    /**
+     * @brief decoded response frame
+     */
+    struct response {
+      std::uint32_t status = status_code::bad_request;
+      std::uint32_t classes = 0;
+      std::vector <int> labels;
+      std::vector <float> probabilities;
+    };
+
+    /**
+     * @brief Decodes a whole response frame
+     */
+    inline response decode_response (std::span <const std::uint8_t> frame) {
+      response result;
+
+      if (frame.size() < header_size + 12)
+        throw std::runtime_error("response frame is too short");
+
+      const std::uint8_t* data = frame.data() + header_size;
+      std::uint32_t count = get_u32(data + 4);
+
+      result.status = get_u32(data);
+      result.classes = get_u32(data + 8);
+
+      if (frame.size() != header_size + 12 + (std::size_t)count * (4 + 4 * result.classes))
+        throw std::runtime_error("response frame size does not match its header");
+
+      data += 12;
+      for (std::uint32_t i = 0; i < count; ++i) {
+        result.labels.push_back(get_u32(data));
+        data += 4;
+        for (std::uint32_t j = 0; j < result.classes; ++j, data += 4)
+          result.probabilities.push_back(get_f32(data));
+      }
+
+      return result;
+    }
+
+  } // namespace protocol
+
+} // namespace fmc
+
+#endif // FMC_PROTOCOL_HPP
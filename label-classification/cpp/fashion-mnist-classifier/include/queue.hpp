@@ -0,0 +1,144 @@
+// Arrow
+
+#ifndef FMC_QUEUE_HPP
+#define FMC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace fmc {
+
+  /**
+   * @brief bounded lock-free multi-producer multi-consumer queue
+   *
+   * Every cell carries a sequence number that tells producers and consumers whether it is
+   * free or full for the current lap, so pushing and popping is a single compare-and-swap
+   * on the head or tail index in the common case. Capacity must be a power of two.
+   *
+   * @tparam T type of the elements; must be default constructible and movable
+   */
+  template <typename T>
+  class mpmc_queue {
+    private:
+      struct cell {
+        std::atomic <std::size_t> sequence;
+        T value;
+      };
+
+      static const std::size_t cache_line_size = 64;
+
+      std::size_t mask;
+      std::unique_ptr <cell[]> cells;
+      alignas(cache_line_size) std::atomic <std::size_t> enqueue_position;
+      alignas(cache_line_size) std::atomic <std::size_t> dequeue_position;
+
+    public:
+      explicit mpmc_queue (std::size_t);
+
+      mpmc_queue (const mpmc_queue&) = delete;
+      mpmc_queue& operator = (const mpmc_queue&) = delete;
+
+      std::size_t capacity () const;
+      std::size_t size     () const;
+      bool        try_pop  (T&);
+      bool        try_push (T&&);
+  };
+
+  template <typename T>
+  mpmc_queue <T>::mpmc_queue (std::size_t capacity)
+    : mask (capacity - 1),
+      cells (new cell [capacity]),
+      enqueue_position (0),
+      dequeue_position (0) {
+    if (capacity < 2 or (capacity & (capacity - 1)) != 0)
+      throw std::runtime_error("queue capacity must be a power of two");
+
+    for (std::size_t i = 0; i < capacity; ++i)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  template <typename T>
+  std::size_t mpmc_queue <T>::capacity () const {
+    return mask + 1;
+  }
+
+  /**
+   * @brief Approximate number of elements in the queue; exact only when no other thread is
+   *        pushing or popping
+   */
+  template <typename T>
+  std::size_t mpmc_queue <T>::size () const {
+    std::size_t tail = enqueue_position.load(std::memory_order_relaxed);
+    std::size_t head = dequeue_position.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  /**
+   * @brief Moves the oldest element into `value`
+   *
+   * @return true if an element was popped
+   * @return false if the queue was empty
+   */
+  template <typename T>
+  bool mpmc_queue <T>::try_pop (T& value) {
+    std::size_t position = dequeue_position.load(std::memory_order_relaxed);
+    cell* c;
+
+    for (;;) {
+      c = &cells[position & mask];
+      std::size_t sequence = c->sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)(position + 1);
+
+      if (difference == 0) {
+        if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (difference < 0)
+        return false;
+      else
+        position = dequeue_position.load(std::memory_order_relaxed);
+    }
+
+    value = std::move(c->value);
+    c->sequence.store(position + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Moves `value` to the back of the queue
+   *
+   * @return true if the element was pushed
+   * @return false if the queue was full; `value` is left untouched
+   */
+  template <typename T>
+  bool mpmc_queue <T>::try_push (T&& value) {
+    std::size_t position = enqueue_position.load(std::memory_order_relaxed);
+    cell* c;
+
+    for (;;) {
+      c = &cells[position & mask];
+      std::size_t sequence = c->sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)position;
+
+      if (difference == 0) {
+        if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (difference < 0)
+        return false;
+      else
+        position = enqueue_position.load(std::memory_order_relaxed);
+    }
+
+    c->value = std::move(value);
+    c->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+} // namespace fmc
+
+#endif // FMC_QUEUE_HPP
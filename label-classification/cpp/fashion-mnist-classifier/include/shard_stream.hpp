@@ -0,0 +1,518 @@
+// Arrow
+
+#ifndef FMC_SHARD_STREAM_HPP
+#define FMC_SHARD_STREAM_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dataset.hpp"
+#include "shuffle.hpp"
+#include "utils.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief bytes read by the readers of a shard_stream, and the time spent in the read calls
+   */
+  struct stream_statistics {
+    std::uint64_t bytes = 0;
+    std::uint64_t reads = 0;
+    double elapsed_seconds = 0;
+    double throughput = 0;
+  };
+
+  /**
+   * @brief Operator << overload to insert a human readable summary of the reads of a stream
+   *        into a std::ostream object
+   */
+  inline std::ostream& operator << (std::ostream& stream, const stream_statistics& statistics) {
+    const auto flags = stream.flags();
+    const auto precision = stream.precision();
+
+    stream << std::fixed << std::setprecision(1) << statistics.bytes / 1e6 << " MB in " << statistics.reads
+           << " reads taking " << statistics.elapsed_seconds * 1000 << " ms (" << std::setprecision(0)
+           << statistics.throughput / 1e6 << " MB/s)";
+
+    stream.flags(flags);
+    stream.precision(precision);
+    return stream;
+  }
+
+  namespace shard {
+
+    /**
+     * @brief first bytes of a .fmcs shard, followed by `count` records of a 32-bit label and
+     *        the height x width pixels of its image
+     *
+     * Labels and pixels are interleaved so that a shard is read front to back, in a single
+     * pass, whatever the number of samples taken from it.
+     */
+    struct header {
+      char magic[4];
+      std::uint32_t version;
+      std::uint32_t height;
+      std::uint32_t width;
+      std::uint64_t count;
+      double scale;
+    };
+
+    const char magic[4] = {'F', 'M', 'C', 'S'};
+    const std::uint32_t version = 1;
+
+    /**
+     * @brief Writes `data` as shards of `samples_per_shard` samples each (the last one holds
+     *        the rest), named `prefix`.00000.fmcs, `prefix`.00001.fmcs, ...
+     *
+     * Every shard is written under a temporary name and renamed, so a reader never sees half
+     * of one.
+     *
+     * @return the paths of the shards, in order
+     */
+    inline std::vector <std::string> write (const dataset& data, const std::string& prefix,
+                                            std::size_t samples_per_shard) {
+      if (samples_per_shard < 1)
+        throw std::runtime_error("shards must hold at least one sample");
+
+      std::vector <std::string> paths;
+
+      for (std::size_t first = 0; first < data.size(); first += samples_per_shard) {
+        char number[16];
+        std::snprintf(number, sizeof(number), ".%05zu", paths.size());
+
+        const std::string path = prefix + number + ".fmcs";
+        const std::string temporary = path + ".tmp";
+
+        header head {};
+        std::copy(magic, magic + 4, head.magic);
+        head.version = version;
+        head.height = data.get_height();
+        head.width = data.get_width();
+        head.count = std::min(samples_per_shard, data.size() - first);
+        head.scale = data.get_scale();
+
+        {
+          std::ofstream file (temporary, std::ios::binary | std::ios::trunc);
+          if (not file.is_open())
+            throw std::runtime_error("unable to write shard to \"" + temporary + "\"");
+
+          file.write((const char*)&head, sizeof(header));
+          for (std::size_t i = first; i < first + head.count; ++i) {
+            const std::int32_t label = data.get_label(i);
+            file.write((const char*)&label, sizeof(std::int32_t));
+            file.write((const char*)data.sample(i).data(), data.get_sample_size());
+          }
+
+          file.flush();
+          if (not file)
+            throw std::runtime_error("unable to write shard to \"" + temporary + "\"");
+        }
+
+        std::filesystem::rename(temporary, path);
+        paths.push_back(path);
+      }
+
+      return paths;
+    }
+
+  } // namespace shard
+
+  /**
+   * @brief a training set kept on disk as shards (see shard::write) and streamed through
+   *        memory, for sets too large to load as a dataset
+   *
+   * The stream itself only holds the shape of the samples and where every shard starts; the
+   * samples are read by a reader, which goes through the shards front to back with large
+   * sequential reads, so memory use is the same whatever the size of the set. network::fit
+   * takes a stream in place of a dataset and reads it on a data_loader thread.
+   *
+   * Every reader adds the bytes it reads and the time it spends reading them to the
+   * statistics of its stream, which are safe to query while readers run.
+   */
+  class shard_stream {
+    public:
+      class reader;
+
+    private:
+      std::vector <std::string> paths;
+      std::vector <std::uint64_t> firsts;
+      int height;
+      int width;
+      double scale;
+      std::size_t window;
+      std::size_t read_ahead;
+      mutable std::atomic <std::uint64_t> read_bytes {0};
+      mutable std::atomic <std::uint64_t> read_calls {0};
+      mutable std::atomic <std::uint64_t> read_nanoseconds {0};
+
+    public:
+      shard_stream (const std::vector <std::string>&, std::size_t = 4096, std::size_t = 8 << 20);
+
+      shard_stream (const shard_stream&) = delete;
+      shard_stream& operator = (const shard_stream&) = delete;
+
+      int               get_height      () const;
+      std::size_t       get_sample_size () const;
+      double            get_scale       () const;
+      stream_statistics get_statistics  () const;
+      int               get_width       () const;
+      std::size_t       get_window      () const;
+      void              set_scale       (double);
+      std::size_t       size            () const;
+  };
+
+  /**
+   * @brief Opens the shards at `paths`, which must all hold samples of the same shape, and
+   *        reads their headers alone
+   *
+   * @param window number of samples a shuffled epoch draws from at random (see reader)
+   * @param read_ahead bytes asked of the file system at once
+   */
+  inline shard_stream::shard_stream (const std::vector <std::string>& paths, std::size_t window, std::size_t read_ahead)
+    : paths (paths),
+      firsts {0},
+      height (0),
+      width (0),
+      scale (1),
+      window (std::max <std::size_t> (window, 1)),
+      read_ahead (read_ahead) {
+    if (paths.empty())
+      throw std::runtime_error("a shard stream needs at least one shard");
+
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      const int descriptor = ::open(paths[i].c_str(), O_RDONLY);
+      if (descriptor < 0)
+        throw std::runtime_error("unable to open \"" + paths[i] + "\"");
+
+      shard::header head;
+      struct stat status;
+      const bool complete = ::pread(descriptor, &head, sizeof(head), 0) == (ssize_t)sizeof(head)
+                        and ::fstat(descriptor, &status) == 0;
+      ::close(descriptor);
+
+      if (not complete or not std::equal(shard::magic, shard::magic + 4, head.magic) or head.version != shard::version)
+        throw std::runtime_error("\"" + paths[i] + "\" is not a shard");
+      if (i > 0 and (head.height != (std::uint32_t)height or head.width != (std::uint32_t)width))
+        throw std::runtime_error("\"" + paths[i] + "\" holds samples of another shape than \"" + paths[0] + "\"");
+
+      height = head.height;
+      width = head.width;
+      if (i == 0)
+        scale = head.scale;
+
+      const std::uint64_t record_size = sizeof(std::int32_t) + get_sample_size();
+      if ((std::uint64_t)status.st_size != sizeof(shard::header) + head.count * record_size)
+        throw std::runtime_error("\"" + paths[i] + "\" does not hold as many samples as its header says");
+
+      firsts.push_back(firsts.back() + head.count);
+    }
+
+    this->read_ahead = std::max <std::size_t> (read_ahead, sizeof(std::int32_t) + get_sample_size());
+  }
+
+  inline int shard_stream::get_height () const {
+    return height;
+  }
+
+  inline std::size_t shard_stream::get_sample_size () const {
+    return (std::size_t)height * width;
+  }
+
+  // Factor the pixels are multiplied by when they are widened, that of the first shard unless set
+  inline double shard_stream::get_scale () const {
+    return scale;
+  }
+
+  inline stream_statistics shard_stream::get_statistics () const {
+    stream_statistics statistics;
+
+    statistics.bytes = read_bytes.load(std::memory_order_relaxed);
+    statistics.reads = read_calls.load(std::memory_order_relaxed);
+    statistics.elapsed_seconds = read_nanoseconds.load(std::memory_order_relaxed) * 1e-9;
+    statistics.throughput = statistics.elapsed_seconds > 0 ? statistics.bytes / statistics.elapsed_seconds : 0;
+
+    return statistics;
+  }
+
+  inline int shard_stream::get_width () const {
+    return width;
+  }
+
+  inline std::size_t shard_stream::get_window () const {
+    return window;
+  }
+
+  inline void shard_stream::set_scale (double scale) {
+    this->scale = scale;
+  }
+
+  inline std::size_t shard_stream::size () const {
+    return firsts.back();
+  }
+
+  /**
+   * @brief reads the samples of a shard_stream in the order of an epoch
+   *
+   * A shard is read in blocks of `read_ahead` bytes, and after every block the file system is
+   * told to fetch the next one (posix_fadvise), so the disk works while the samples of the
+   * current block are consumed.
+   *
+   * A stream cannot be permuted as a whole without reading all of it, so a shuffled epoch
+   * visits the shards in a random order and shuffles the samples through a window: the
+   * window is filled with the first `window` samples, and every sample read is drawn at
+   * random from it and replaced by the next one. A sample then comes out at most `window`
+   * places before its position in the shards, anywhere after it. As with sample_order, the
+   * order only depends on the seed and the epoch.
+   *
+   * Every sample comes with its index in the whole stream (shards in the order given to the
+   * stream), by which augmentations are drawn. Not copyable; one reader per thread.
+   */
+  class shard_stream::reader {
+    private:
+      const shard_stream& stream;
+      std::size_t record_size;
+      std::mt19937_64 generator;
+      bool shuffled = false;
+      std::vector <int> shard_order;
+      std::size_t next_shard = 0;
+
+      int descriptor = -1;
+      std::string path;
+      std::uint64_t offset = 0;
+      std::uint64_t end = 0;
+      std::uint64_t next_index = 0;
+      std::vector <std::uint8_t> buffer;
+      std::size_t buffer_first = 0;
+      std::size_t buffer_last = 0;
+
+      std::vector <std::uint8_t> window_pixels;
+      std::vector <int> window_labels;
+      std::vector <std::uint64_t> window_indices;
+      std::size_t window_fill = 0;
+
+    public:
+      explicit reader (const shard_stream&);
+      ~reader ();
+
+      reader (const reader&) = delete;
+      reader& operator = (const reader&) = delete;
+
+      std::size_t read  (dataset&, std::span <std::uint64_t>);
+      void        skip  (std::size_t);
+      void        start (int, shuffle, std::uint64_t);
+
+    private:
+      void close  ();
+      bool fetch  ();
+      bool open   ();
+      bool pull   (std::uint8_t*, int&, std::uint64_t&);
+      bool take   (std::uint8_t*, int&, std::uint64_t&);
+  };
+
+  inline shard_stream::reader::reader (const shard_stream& stream)
+    : stream (stream),
+      record_size (sizeof(std::int32_t) + stream.get_sample_size()),
+      buffer (stream.read_ahead)
+  { }
+
+  inline shard_stream::reader::~reader () {
+    close();
+  }
+
+  /**
+   * @brief Reads the next `indices.size()` samples of the epoch into the first samples of
+   *        `out`, which must hold at least as many, and their indices in the stream into
+   *        `indices`
+   *
+   * @return the number of samples read, fewer than asked for at the end of the epoch
+   */
+  inline std::size_t shard_stream::reader::read (dataset& out, std::span <std::uint64_t> indices) {
+#ifdef DEBUG_MODE
+    if (indices.size() > out.size() or out.get_sample_size() != stream.get_sample_size())
+      throw std::runtime_error("out of bounds access will occur with provided index");
+#endif
+
+    for (std::size_t r = 0; r < indices.size(); ++r) {
+      int label;
+      if (not take(out.sample(r).data(), label, indices[r]))
+        return r;
+      out.set_label(r, label);
+    }
+
+    return indices.size();
+  }
+
+  /**
+   * @brief Reads past the next `count` samples of the epoch, e.g. to resume it
+   */
+  inline void shard_stream::reader::skip (std::size_t count) {
+    int label;
+    std::uint64_t index;
+
+    for (std::size_t i = 0; i < count and take(nullptr, label, index); ++i)
+      ;
+  }
+
+  /**
+   * @brief Starts reading `epoch` from its first sample, in the order `mode` and `seed` give
+   *        it; any shuffle other than shuffle::none shuffles the shards and the window
+   */
+  inline void shard_stream::reader::start (int epoch, shuffle mode, std::uint64_t seed) {
+    close();
+
+    shuffled = mode != shuffle::none;
+    generator.seed(random::splitmix::mix(seed ^ random::splitmix::mix(epoch)));
+
+    shard_order.resize(stream.paths.size());
+    for (std::size_t i = 0; i < shard_order.size(); ++i)
+      shard_order[i] = i;
+    if (shuffled)
+      for (std::size_t i = shard_order.size(); i > 1; --i)
+        std::swap(shard_order[i - 1], shard_order[generator() % i]);
+    next_shard = 0;
+
+    window_fill = 0;
+    if (not shuffled)
+      return;
+
+    const std::size_t window = std::min(stream.window, stream.size());
+    window_pixels.resize(window * stream.get_sample_size());
+    window_labels.resize(window);
+    window_indices.resize(window);
+
+    while (window_fill < window and pull(window_pixels.data() + window_fill * stream.get_sample_size(),
+                                         window_labels[window_fill], window_indices[window_fill]))
+      ++window_fill;
+  }
+
+  inline void shard_stream::reader::close () {
+    if (descriptor >= 0)
+      ::close(descriptor);
+    descriptor = -1;
+    buffer_first = buffer_last = 0;
+  }
+
+  /**
+   * @brief Moves what is left of the buffer to its front and reads the rest of it from the
+   *        current shard, then asks for the block after that to be read ahead
+   *
+   * @return false if the shard has no whole record left
+   */
+  inline bool shard_stream::reader::fetch () {
+    const std::size_t left = buffer_last - buffer_first;
+    std::memmove(buffer.data(), buffer.data() + buffer_first, left);
+    buffer_first = 0;
+    buffer_last = left;
+
+    while (buffer_last < record_size and offset < end) {
+      const std::size_t wanted = std::min <std::uint64_t> (buffer.size() - buffer_last, end - offset);
+
+      const auto started = std::chrono::steady_clock::now();
+      const ssize_t count = ::pread(descriptor, buffer.data() + buffer_last, wanted, offset);
+      const auto elapsed = std::chrono::steady_clock::now() - started;
+
+      if (count <= 0)
+        throw std::runtime_error("unable to read \"" + path + "\"");
+
+      stream.read_bytes.fetch_add(count, std::memory_order_relaxed);
+      stream.read_calls.fetch_add(1, std::memory_order_relaxed);
+      stream.read_nanoseconds.fetch_add(std::chrono::duration_cast <std::chrono::nanoseconds> (elapsed).count(),
+                                        std::memory_order_relaxed);
+
+      buffer_last += count;
+      offset += count;
+    }
+
+    if (offset < end)
+      ::posix_fadvise(descriptor, offset, std::min <std::uint64_t> (buffer.size(), end - offset), POSIX_FADV_WILLNEED);
+
+    return buffer_last >= record_size;
+  }
+
+  // Opens the next shard of the epoch, if any is left
+  inline bool shard_stream::reader::open () {
+    close();
+    if (next_shard == shard_order.size())
+      return false;
+
+    const int shard = shard_order[next_shard++];
+    path = stream.paths[shard];
+    descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+      throw std::runtime_error("unable to open \"" + path + "\"");
+
+    offset = sizeof(shard::header);
+    end = offset + (stream.firsts[shard + 1] - stream.firsts[shard]) * record_size;
+    next_index = stream.firsts[shard];
+
+    // doubles the read-ahead of the kernel for this file, on top of the blocks asked for
+    ::posix_fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+  }
+
+  // Reads the next sample of the shards into `pixels`, unless null
+  inline bool shard_stream::reader::pull (std::uint8_t* pixels, int& label, std::uint64_t& index) {
+    while (buffer_last - buffer_first < record_size)
+      if ((descriptor < 0 or not fetch()) and not open())
+        return false;
+
+    std::int32_t value;
+    std::memcpy(&value, buffer.data() + buffer_first, sizeof(std::int32_t));
+    if (pixels != nullptr)
+      std::memcpy(pixels, buffer.data() + buffer_first + sizeof(std::int32_t), stream.get_sample_size());
+
+    label = value;
+    index = next_index++;
+    buffer_first += record_size;
+    return true;
+  }
+
+  // Reads the next sample of the epoch: the next one of the shards, or one drawn from the window
+  inline bool shard_stream::reader::take (std::uint8_t* pixels, int& label, std::uint64_t& index) {
+    if (not shuffled)
+      return pull(pixels, label, index);
+
+    if (window_fill == 0)
+      return false;
+
+    const std::size_t sample_size = stream.get_sample_size();
+    const std::size_t drawn = generator() % window_fill;
+    std::uint8_t* slot = window_pixels.data() + drawn * sample_size;
+
+    if (pixels != nullptr)
+      std::memcpy(pixels, slot, sample_size);
+    label = window_labels[drawn];
+    index = window_indices[drawn];
+
+    // once the shards run out, the window shrinks instead, its last sample taking the free slot
+    if (not pull(slot, window_labels[drawn], window_indices[drawn]) and drawn != --window_fill) {
+      std::memcpy(slot, window_pixels.data() + window_fill * sample_size, sample_size);
+      window_labels[drawn] = window_labels[window_fill];
+      window_indices[drawn] = window_indices[window_fill];
+    }
+
+    return true;
+  }
+
+} // namespace fmc
+
+#endif // FMC_SHARD_STREAM_HPP
@@ -0,0 +1,130 @@
+// Arrow
+
+#ifndef FMC_SHUFFLE_HPP
+#define FMC_SHUFFLE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief order in which fit visits the samples of every epoch
+   */
+  enum class shuffle {
+    none,    // the order of the data, every epoch
+    samples, // a permutation of every sample
+    blocks   // a permutation of blocks of consecutive samples, each shuffled within itself
+  };
+
+  /**
+   * @brief the permutation of sample indices of every epoch, drawn from a seed
+   *
+   * The permutation of an epoch only depends on the seed and the epoch number, so the same
+   * seed replays the same order whichever thread computes it and however often, and a run
+   * resumed from a checkpoint continues the order it was interrupted in. The generator
+   * (std::mt19937_64) and the shuffle itself are fully specified, so the order is also the
+   * same across standard libraries, which std::shuffle does not guarantee.
+   *
+   * Shuffling blocks of `block_size` consecutive samples rather than single samples keeps
+   * reads sequential: a batch draws from one or two blocks, so a memory-mapped or
+   * out-of-core dataset is read a block at a time instead of a page per sample.
+   */
+  class sample_order {
+    private:
+      shuffle mode;
+      std::size_t size;
+      std::size_t block_size;
+      std::uint64_t seed;
+
+    public:
+      sample_order (std::size_t, shuffle, std::uint64_t, std::size_t = 1024);
+
+      void          fill     (int, std::vector <int>&) const;
+      shuffle       get_mode () const;
+      std::uint64_t get_seed () const;
+
+    private:
+      static void permute (int*, std::size_t, std::mt19937_64&);
+  };
+
+  inline sample_order::sample_order (std::size_t size, shuffle mode, std::uint64_t seed, std::size_t block_size)
+    : mode (mode),
+      size (size),
+      block_size (block_size),
+      seed (seed) {
+    if (mode == shuffle::blocks and block_size < 1)
+      throw std::runtime_error("shuffle blocks must hold at least one sample");
+  }
+
+  /**
+   * @brief Writes the order of `epoch` into `order`. Once `order` holds as many indices as
+   *        there are samples, this allocates nothing.
+   */
+  inline void sample_order::fill (int epoch, std::vector <int>& order) const {
+    order.resize(size);
+
+    if (mode == shuffle::none or size == 0) {
+      std::iota(order.begin(), order.end(), 0);
+      return;
+    }
+
+    std::mt19937_64 generator (random::splitmix::mix(seed ^ random::splitmix::mix(epoch)));
+
+    if (mode == shuffle::samples) {
+      std::iota(order.begin(), order.end(), 0);
+      permute(order.data(), size, generator);
+      return;
+    }
+
+    const std::size_t block_count = (size + block_size - 1) / block_size;
+
+    std::iota(order.begin(), order.begin() + block_count, 0);
+    permute(order.data(), block_count, generator);
+
+    // Blocks are expanded in place from the back: every block still to expand holds at least
+    // one sample, so the output never reaches the block numbers that are yet to be read
+    std::size_t end = size;
+    for (std::size_t b = block_count; b-- > 0; ) {
+      const std::size_t block = order[b];
+      const std::size_t first = block * block_size;
+      const std::size_t length = std::min(block_size, size - first);
+
+      end -= length;
+      std::iota(order.begin() + end, order.begin() + end + length, (int)first);
+    }
+
+    for (std::size_t first = 0; first < size; ) {
+      const std::size_t block = order[first] / block_size;
+      const std::size_t length = std::min(block_size, size - block * block_size);
+
+      permute(order.data() + first, length, generator);
+      first += length;
+    }
+  }
+
+  inline shuffle sample_order::get_mode () const {
+    return mode;
+  }
+
+  inline std::uint64_t sample_order::get_seed () const {
+    return seed;
+  }
+
+  // Fisher-Yates; the modulo bias is below count / 2^64
+  inline void sample_order::permute (int* values, std::size_t count, std::mt19937_64& generator) {
+    for (std::size_t i = count; i > 1; --i)
+      std::swap(values[i - 1], values[generator() % i]);
+  }
+
+} // namespace fmc
+
+#endif // FMC_SHUFFLE_HPP
@@ -0,0 +1,623 @@
+// Arrow
+
+#ifndef FMC_STATIC_NETWORK_HPP
+#define FMC_STATIC_NETWORK_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "augment.hpp"
+#include "checkpoint.hpp"
+#include "data_loader.hpp"
+#include "dataset.hpp"
+#include "early_stopping.hpp"
+#include "inference.hpp"
+#include "initializer.hpp"
+#include "kernel.hpp"
+#include "matrix.hpp"
+#include "nn.hpp"
+#include "optimizer.hpp"
+#include "shard_stream.hpp"
+#include "shuffle.hpp"
+#include "telemetry.hpp"
+#include "trainer.hpp"
+#include "utils.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief dense network whose topology is fixed at compile time
+   *
+   * `Sizes` lists the neuron count of every layer, input layer first. Every hidden layer uses
+   * the `Hidden` activation and the output layer uses `Output`. All shapes are template
+   * constants, so every GEMM and activation loop is instantiated for its exact dimensions
+   * through kernel::fixed, and the loops over layers are unrolled. Weights and biases are
+   * packed into one buffer each, which lets the optimizer update all of them in a single pass.
+   *
+   * Offers the same fit / predict / evaluate / freeze / save / load surface as network, and
+   * reads and writes the same model files.
+   *
+   * @tparam T type of the weights and activations
+   * @tparam Hidden activation of the hidden layers
+   * @tparam Output activation of the output layer
+   * @tparam Sizes neuron count of every layer
+   */
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  class static_network {
+    public:
+      using LossFunction = T (*) (const T&, const T&);
+
+      static constexpr int layer_count = sizeof...(Sizes);
+      static constexpr std::array <int, layer_count> sizes {Sizes...};
+
+      static_assert(layer_count >= 2, "a network needs an input and an output layer");
+      static_assert(((Sizes > 0) and ...), "every layer needs at least one neuron");
+      static_assert(Hidden != activation::kind::softmax, "softmax can only be used by the output layer");
+      static_assert(Hidden != activation::kind::custom and Output != activation::kind::custom,
+                    "custom activations need a runtime network");
+
+    private:
+      static constexpr std::size_t weight_offset (int layer) {
+        std::size_t offset = 0;
+        for (int i = 1; i < layer; ++i)
+          offset += (std::size_t)sizes[i - 1] * sizes[i];
+        return offset;
+      }
+
+      static constexpr std::size_t bias_offset (int layer) {
+        std::size_t offset = 0;
+        for (int i = 1; i < layer; ++i)
+          offset += sizes[i];
+        return offset;
+      }
+
+      static constexpr activation::kind kind_of_layer (int layer) {
+        return layer == layer_count - 1 ? Output : Hidden;
+      }
+
+      // Floating point operations of the matrix products of one training step, per sample; see
+      // network::training_flops
+      static constexpr double training_flops () {
+        double flops = 0;
+        for (int i = 1; i < layer_count; ++i)
+          flops += 2.0 * sizes[i - 1] * sizes[i] * (i > 1 ? 3 : 2);
+        return flops;
+      }
+
+      static constexpr std::size_t weight_count = weight_offset(layer_count);
+      static constexpr std::size_t bias_count = bias_offset(layer_count);
+
+    public:
+      T cost;
+      T learning_rate;
+      optimizer <T> update_rule;
+      approximate::precision activation_precision;
+
+    public:
+      LossFunction loss_function;
+      LossFunction loss_function_derivative;
+
+    private:
+      std::vector <T> weights;
+      std::vector <T> biases;
+      std::vector <T> weight_gradient;
+      std::vector <T> bias_gradient;
+      std::vector <T> weight_state;
+      std::vector <T> bias_state;
+      std::array <std::vector <T>, layer_count> activations;
+      std::array <std::vector <T>, layer_count> deltas;
+      int batch_rows;
+      training_telemetry telemetry;
+
+    public:
+      static_network (const T&, LossFunction, LossFunction);
+
+      void                calculate_loss     (std::span <const int>);
+      static_network&     compile            (bool = true);
+      evaluation_result   evaluate           (const std::vector <matrix <T>>&, const std::vector <int>&, int = 0) const;
+      evaluation_result   evaluate           (const dataset&, int = 0) const;
+      static_network&     fit                (const std::vector <matrix <T>>&, const std::vector <int>&, int);
+      static_network&     fit                (const std::vector <matrix <T>>&, const std::vector <int>&, const fit_options&);
+      static_network&     fit                (const std::vector <matrix <T>>&, const std::vector <int>&,
+                                              const std::vector <matrix <T>>&, const std::vector <int>&, const fit_options&);
+      static_network&     fit                (const dataset&, const fit_options&);
+      static_network&     fit                (const dataset&, const dataset&, const fit_options&);
+      static_network&     fit                (const shard_stream&, const fit_options&);
+      static_network&     fit                (const shard_stream&, const dataset&, const fit_options&);
+      void                forward_propagate  (const matrix <T>&);
+      inference_model <T> freeze             () const;
+      static_network&     load               (const std::string&);
+      int                 predict            (const matrix <T>&);
+      static_network&     save               (const std::string&);
+      static_network&     set_optimizer      (const optimizer <T>&);
+
+    private:
+      template <int I> void backward_layer (int);
+      template <int I> void delta_layer    (int);
+      template <int I> void forward_layer  (int);
+
+      void backward_propagate ();
+      void calculate_delta    ();
+      void capture            (training_state <T>&, int, int) const;
+      bool fused_output       () const;
+      void gather             (const std::vector <matrix <T>>&, std::span <const int>);
+      void gather             (const dataset&, std::span <const int>, int, augmenter&);
+      void gather             (const typename data_loader <T>::batch&);
+      void propagate          ();
+      void resize_batch       (int);
+      void restore            (const training_state <T>&);
+
+      friend class trainer <T, static_network>;
+  };
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>::static_network (const T& learning_rate, LossFunction loss_function,
+                                                                LossFunction loss_function_derivative)
+    : cost (T()),
+      learning_rate (learning_rate),
+      update_rule (optimizer <T>::sgd(learning_rate)),
+      activation_precision (approximate::precision::exact),
+      loss_function (loss_function),
+      loss_function_derivative (loss_function_derivative),
+      weights (weight_count),
+      biases (bias_count),
+      batch_rows (0)
+  { }
+
+  /**
+   * @brief Mean cost of the current batch and delta of the output layer; see network::calculate_loss
+   */
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::calculate_loss (std::span <const int> labels) {
+    constexpr int outputs = sizes[layer_count - 1];
+    const int rows = labels.size();
+
+#ifdef DEBUG_MODE
+    if (rows != batch_rows)
+      throw std::runtime_error("number of labels does not match the batch size");
+    for (int label : labels)
+      if (label < 0 or label >= outputs)
+        throw std::runtime_error("label does not lie in the range of number of neurons in output layer");
+#endif
+
+    const T* predictions = activations.back().data();
+    T* delta = deltas.back().data();
+
+    cost = 0;
+
+    if (fused_output()) {
+      const T epsilon = std::numeric_limits <T>::min();
+
+      std::copy(predictions, predictions + (std::size_t)rows * outputs, delta);
+      for (int r = 0; r < rows; ++r) {
+        const std::size_t index = (std::size_t)r * outputs + labels[r];
+        cost -= std::log(std::max(predictions[index], epsilon));
+        delta[index] -= 1;
+      }
+
+      cost /= rows;
+      return;
+    }
+
+    for (int r = 0; r < rows; ++r) {
+      for (int i = 0; i < outputs; ++i) {
+        const std::size_t index = (std::size_t)r * outputs + i;
+        const T expected = i == labels[r] ? 1 : 0;
+
+        cost += loss_function(predictions[index], expected);
+        delta[index] = loss_function_derivative(predictions[index], expected);
+      }
+    }
+
+    activation::apply_derivative <T> (Output, nullptr, nullptr, predictions, delta, (std::size_t)rows * outputs);
+    cost /= (T)rows * outputs;
+  }
+
+  /**
+   * @brief Checks the loss suits the output layer and, if `initialize`, draws the weights from
+   *        their initializers; see network::compile
+   */
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>& static_network <T, Hidden, Output, Sizes...>::compile (bool initialize) {
+    if (Output == activation::kind::softmax and not fused_output())
+      throw std::runtime_error("a softmax output layer must be trained with error::cross_entropy");
+
+    if (not initialize)
+      return *this;
+
+    for (int i = 1; i < layer_count; ++i)
+      initializer::initialize(initializer::default_for(kind_of_layer(i)), weights.data() + weight_offset(i),
+                              biases.data() + bias_offset(i), sizes[i - 1], sizes[i]);
+
+    return *this;
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  evaluation_result static_network <T, Hidden, Output, Sizes...>::evaluate (const std::vector <matrix <T>>& data,
+                                                                            const std::vector <int>& labels,
+                                                                            int thread_count) const {
+    std::cout << "[*] Testing model" << std::endl;
+
+    return freeze().evaluate(data, labels, thread_count);
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  evaluation_result static_network <T, Hidden, Output, Sizes...>::evaluate (const dataset& data, int thread_count) const {
+    std::cout << "[*] Testing model" << std::endl;
+
+    return freeze().evaluate(data, thread_count);
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>&
+  static_network <T, Hidden, Output, Sizes...>::fit (const std::vector <matrix <T>>& data, const std::vector <int>& labels,
+                                                     int epochs) {
+    return fit(data, labels, fit_options {.epochs = epochs});
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>&
+  static_network <T, Hidden, Output, Sizes...>::fit (const std::vector <matrix <T>>& data, const std::vector <int>& labels,
+                                                     const fit_options& options) {
+    return fit(data, labels, {}, {}, options);
+  }
+
+  /**
+   * @brief Trains the network with mini-batch gradient descent, with checkpoints and early
+   *        stopping on a validation set; see network::fit
+   */
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>&
+  static_network <T, Hidden, Output, Sizes...>::fit (const std::vector <matrix <T>>& data, const std::vector <int>& labels,
+                                                     const std::vector <matrix <T>>& validation_data,
+                                                     const std::vector <int>& validation_labels,
+                                                     const fit_options& options) {
+#ifdef DEBUG_MODE
+    if (data.size() != labels.size() or validation_data.size() != validation_labels.size())
+      throw std::runtime_error("data and labels must have same size");
+#endif
+
+    typename early_stopping <T>::validator validate = nullptr;
+    if (not validation_data.empty())
+      validate = [&] (const inference_model <T>& model) { return model.evaluate(validation_data, validation_labels, 1); };
+
+    return trainer <T, static_network>::train(*this, data, labels, validate, options);
+  }
+
+  // Same as fit (data, labels, options) on a dataset of bytes; see network::fit
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>&
+  static_network <T, Hidden, Output, Sizes...>::fit (const dataset& data, const fit_options& options) {
+    return trainer <T, static_network>::train(*this, data, data.get_labels(), nullptr, options);
+  }
+
+  // Same as fit (data, labels, validation_data, validation_labels, options) on datasets of bytes
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>&
+  static_network <T, Hidden, Output, Sizes...>::fit (const dataset& data, const dataset& validation, const fit_options& options) {
+    typename early_stopping <T>::validator validate = nullptr;
+    if (validation.size() > 0)
+      validate = [&] (const inference_model <T>& model) { return model.evaluate(validation, 1); };
+
+    return trainer <T, static_network>::train(*this, data, data.get_labels(), validate, options);
+  }
+
+  // Same as fit (data, options) on a set streamed from its shards; see network::fit
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>&
+  static_network <T, Hidden, Output, Sizes...>::fit (const shard_stream& data, const fit_options& options) {
+    return trainer <T, static_network>::train(*this, data, {}, nullptr, options);
+  }
+
+  // Same as fit (data, validation, options) on a set streamed from its shards
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>&
+  static_network <T, Hidden, Output, Sizes...>::fit (const shard_stream& data, const dataset& validation,
+                                                     const fit_options& options) {
+    typename early_stopping <T>::validator validate = nullptr;
+    if (validation.size() > 0)
+      validate = [&] (const inference_model <T>& model) { return model.evaluate(validation, 1); };
+
+    return trainer <T, static_network>::train(*this, data, {}, validate, options);
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::forward_propagate (const matrix <T>& data) {
+#ifdef DEBUG_MODE
+    if (data.get_cols() != sizes[0])
+      throw std::runtime_error("input does not match the size of the input layer");
+#endif
+
+    resize_batch(data.get_rows());
+    std::copy(data.data(), data.data() + (std::size_t)data.get_rows() * sizes[0], activations[0].data());
+    propagate();
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  inference_model <T> static_network <T, Hidden, Output, Sizes...>::freeze () const {
+    inference_model <T> model;
+
+    for (int i = 1; i < layer_count; ++i) {
+      matrix <T> weight (sizes[i - 1], sizes[i]);
+      matrix <T> bias (1, sizes[i]);
+
+      std::copy(weights.data() + weight_offset(i), weights.data() + weight_offset(i + 1), weight.data());
+      std::copy(biases.data() + bias_offset(i), biases.data() + bias_offset(i + 1), bias.data());
+      model.add_stage(weight, bias, kind_of_layer(i), nullptr, activation_precision);
+    }
+
+    return model;
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>& static_network <T, Hidden, Output, Sizes...>::load (const std::string& filepath) {
+    std::cout << "[*] Loading neural model from \"" << filepath << "\"" << std::endl;
+
+    std::ifstream file (filepath);
+    std::string header;
+    char newline;
+
+    if (!file.is_open())
+      throw std::runtime_error("unable to load model from provided file path");
+
+    for (int i = 1; i < layer_count; ++i) {
+      matrix <T> weight (sizes[i - 1], sizes[i]);
+      matrix <T> bias (1, sizes[i]);
+
+      std::getline(file, header);
+      std::cout << "[*] Reading " << header << std::endl;
+      file >> bias;
+      file.get(newline);
+
+      std::getline(file, header);
+      std::cout << "[*] Reading " << header << std::endl;
+      file >> weight;
+      file.get(newline);
+
+      if (not file)
+        throw std::runtime_error("model file does not match the network topology");
+
+      std::copy(weight.data(), weight.data() + weight_offset(i + 1) - weight_offset(i), weights.data() + weight_offset(i));
+      std::copy(bias.data(), bias.data() + sizes[i], biases.data() + bias_offset(i));
+    }
+
+    file.close();
+
+    return *this;
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  int static_network <T, Hidden, Output, Sizes...>::predict (const matrix <T>& data) {
+    forward_propagate(data);
+
+    const T* predictions = activations.back().data();
+    return std::max_element(predictions, predictions + sizes[layer_count - 1]) - predictions;
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>& static_network <T, Hidden, Output, Sizes...>::save (const std::string& filepath) {
+    std::cout << "[*] Saving neural network model to \"" << filepath << "\"" << std::endl;
+
+    std::ofstream file (filepath);
+    file << std::fixed << std::setprecision(20);
+
+    for (int i = 1; i < layer_count; ++i) {
+      matrix <T> weight (sizes[i - 1], sizes[i]);
+      matrix <T> bias (1, sizes[i]);
+
+      std::copy(weights.data() + weight_offset(i), weights.data() + weight_offset(i + 1), weight.data());
+      std::copy(biases.data() + bias_offset(i), biases.data() + bias_offset(i + 1), bias.data());
+
+      file << "[layer " << i << " bias]\n";
+      file << bias << '\n';
+      file << "[layer " << i << " weight]\n";
+      file << weight << '\n';
+    }
+
+    file.close();
+
+    return *this;
+  }
+
+  /**
+   * @brief Replaces the update rule; the state of the previous rule is discarded
+   */
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  static_network <T, Hidden, Output, Sizes...>&
+  static_network <T, Hidden, Output, Sizes...>::set_optimizer (const optimizer <T>& rule) {
+    update_rule = rule;
+    learning_rate = rule.learning_rate;
+    weight_state.clear();
+    bias_state.clear();
+    return *this;
+  }
+
+  // Accumulates the gradient of layer I (or applies it directly for plain SGD)
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  template <int I>
+  void static_network <T, Hidden, Output, Sizes...>::backward_layer (int rows) {
+    using inputs = kernel::fixed <sizes[I - 1]>;
+    using outputs = kernel::fixed <sizes[I]>;
+
+    const bool in_place = update_rule.type == optimizer <T>::kind::sgd;
+    const T scale = in_place ? -update_rule.learning_rate / rows : T(1) / rows;
+    T* weight = (in_place ? weights.data() : weight_gradient.data()) + weight_offset(I);
+    T* bias = (in_place ? biases.data() : bias_gradient.data()) + bias_offset(I);
+
+    kernel::gemm_tn(activations[I - 1].data(), deltas[I].data(), weight, inputs(), outputs(), rows, scale);
+    kernel::column_sum(deltas[I].data(), bias, rows, outputs(), scale);
+  }
+
+  // delta of hidden layer I from the delta of layer I + 1
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  template <int I>
+  void static_network <T, Hidden, Output, Sizes...>::delta_layer (int rows) {
+    using width = kernel::fixed <sizes[I]>;
+    using next_width = kernel::fixed <sizes[I + 1]>;
+
+    kernel::gemm_nt(deltas[I + 1].data(), weights.data() + weight_offset(I + 1), deltas[I].data(), rows, width(), next_width());
+    activation::apply_derivative <T> (Hidden, nullptr, nullptr, activations[I].data(), deltas[I].data(),
+                                      (std::size_t)rows * sizes[I]);
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  template <int I>
+  void static_network <T, Hidden, Output, Sizes...>::forward_layer (int rows) {
+    using inputs = kernel::fixed <sizes[I - 1]>;
+    using outputs = kernel::fixed <sizes[I]>;
+
+    kernel::gemm_bias(activations[I - 1].data(), weights.data() + weight_offset(I), biases.data() + bias_offset(I),
+                      activations[I].data(), rows, outputs(), inputs(), sizes[I - 1], sizes[I]);
+    activation::apply <T> (kind_of_layer(I), nullptr, activations[I].data(), rows, sizes[I], activation_precision);
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::backward_propagate () {
+    const int rows = batch_rows;
+
+    update_rule.begin_step();
+
+    if (update_rule.type != optimizer <T>::kind::sgd) {
+      const std::size_t state_size = update_rule.state_size();
+
+      weight_gradient.assign(weight_count, 0);
+      bias_gradient.assign(bias_count, 0);
+      if (weight_state.size() != state_size * weight_count) {
+        weight_state.assign(state_size * weight_count, 0);
+        bias_state.assign(state_size * bias_count, 0);
+      }
+    }
+
+    auto time = telemetry.now();
+
+    [&] <int... I> (std::integer_sequence <int, I...>) {
+      ((backward_layer <I + 1> (rows), time = telemetry.record(training_telemetry::phase::backward, I + 1, time)), ...);
+    } (std::make_integer_sequence <int, layer_count - 1> ());
+
+    // one update over the packed parameters of every layer, reported as layer 0
+    if (update_rule.type != optimizer <T>::kind::sgd) {
+      update_rule.update(weights.data(), weight_gradient.data(), weight_state.data(), weight_count, true);
+      update_rule.update(biases.data(), bias_gradient.data(), bias_state.data(), bias_count, false);
+      telemetry.record(training_telemetry::phase::backward, 0, time);
+    }
+  }
+
+  // Deltas from the last hidden layer down to the first
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::calculate_delta () {
+    const int rows = batch_rows;
+
+    auto time = telemetry.now();
+
+    [&] <int... I> (std::integer_sequence <int, I...>) {
+      ((delta_layer <layer_count - 2 - I> (rows),
+        time = telemetry.record(training_telemetry::phase::delta, layer_count - 2 - I, time)), ...);
+    } (std::make_integer_sequence <int, layer_count - 2> ());
+  }
+
+  // Snapshot for a checkpoint; see network::capture
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::capture (training_state <T>& state, int epoch, int position) const {
+    state.clear();
+    state.epoch = epoch;
+    state.position = position;
+    state.step_count = update_rule.step_count;
+    state.optimizer_kind = (int)update_rule.type;
+    state.save_generator();
+
+    for (const std::vector <T>* values : {&weights, &biases, &weight_state, &bias_state})
+      state.append(values->data(), values->size());
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  bool static_network <T, Hidden, Output, Sizes...>::fused_output () const {
+    return Output == activation::kind::softmax and loss_function == &error::cross_entropy <T>;
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::gather (const std::vector <matrix <T>>& data,
+                                                             std::span <const int> indices) {
+    resize_batch(indices.size());
+    for (std::size_t r = 0; r < indices.size(); ++r)
+      std::copy(data[indices[r]].data(), data[indices[r]].data() + sizes[0], activations[0].data() + r * sizes[0]);
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::gather (const dataset& data, std::span <const int> indices, int epoch,
+                                                             augmenter& augment) {
+#ifdef DEBUG_MODE
+    if ((int)data.get_sample_size() != sizes[0])
+      throw std::runtime_error("samples do not match the size of the input layer");
+#endif
+
+    resize_batch(indices.size());
+    augment.widen(data, indices, epoch, activations[0].data());
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::gather (const typename data_loader <T>::batch& batch) {
+    resize_batch(batch.rows);
+    std::copy(batch.values, batch.values + (std::size_t)batch.rows * sizes[0], activations[0].data());
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::propagate () {
+    const int rows = batch_rows;
+
+    auto time = telemetry.now();
+
+    [&] <int... I> (std::integer_sequence <int, I...>) {
+      ((forward_layer <I + 1> (rows), time = telemetry.record(training_telemetry::phase::forward, I + 1, time)), ...);
+    } (std::make_integer_sequence <int, layer_count - 1> ());
+  }
+
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::resize_batch (int rows) {
+    if (rows == batch_rows)
+      return;
+
+    batch_rows = rows;
+    for (int i = 0; i < layer_count; ++i) {
+      activations[i].resize((std::size_t)rows * sizes[i]);
+      deltas[i].resize((std::size_t)rows * sizes[i]);
+    }
+  }
+
+  // Puts back the state taken by capture(); see network::restore
+  template <typename T, activation::kind Hidden, activation::kind Output, int... Sizes>
+  void static_network <T, Hidden, Output, Sizes...>::restore (const training_state <T>& state) {
+    if (state.optimizer_kind != (int)update_rule.type)
+      throw std::runtime_error("checkpoint was written with a different optimizer");
+    if (state.sizes.size() != 4)
+      throw std::runtime_error("checkpoint does not match the shape of the network");
+
+    const std::size_t state_size = update_rule.state_size();
+
+    // optimizer state is empty until the first step
+    weight_state.resize(state.sizes[2] == 0 ? 0 : state_size * weight_count);
+    bias_state.resize(state.sizes[3] == 0 ? 0 : state_size * bias_count);
+
+    state.extract(0, weights.data(), weight_count);
+    state.extract(1, biases.data(), bias_count);
+    state.extract(2, weight_state.data(), weight_state.size());
+    state.extract(3, bias_state.data(), bias_state.size());
+
+    update_rule.step_count = state.step_count;
+    state.restore_generator();
+  }
+
+} // namespace fmc
+
+#endif // FMC_STATIC_NETWORK_HPP
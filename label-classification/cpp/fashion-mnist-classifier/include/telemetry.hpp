@@ -0,0 +1,319 @@
+// Arrow
+
+#ifndef FMC_TELEMETRY_HPP
+#define FMC_TELEMETRY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fmc {
+
+  namespace telemetry {
+
+    // incremented by the global operator new when FMC_TRACK_ALLOCATIONS is defined
+    inline std::atomic <std::uint64_t> allocation_count {0};
+    inline std::atomic <bool> tracking_allocations {false};
+
+  } // namespace telemetry
+
+  /**
+   * @brief one line of the training telemetry stream
+   *
+   * Phase times are cumulative since fit started and indexed by layer. Entry 0, the input
+   * layer, stays zero, except that static_network reports there the backward time of the
+   * optimizer update it applies to all of its layers at once. The stall time is how long the
+   * training thread waited for its batches: all of the time spent assembling them, unless a
+   * data_loader prefetched them. Rates, the loss and the allocation count cover the steps
+   * since the previous report.
+   */
+  struct training_metrics {
+    long step = 0;
+    int epoch = 0;
+    long samples = 0;
+    double elapsed_seconds = 0;
+    double samples_per_second = 0;
+    double gflops = 0;
+    double loss = 0;
+    long long allocations = -1;
+    std::vector <double> forward_seconds;
+    double loss_seconds = 0;
+    std::vector <double> delta_seconds;
+    std::vector <double> backward_seconds;
+    double stall_seconds = 0;
+  };
+
+  /**
+   * @brief Writes `metrics` as a single line of JSON, without the trailing newline. Unknown
+   *        values (a non-finite loss, allocations when they are not tracked) are null.
+   */
+  inline std::ostream& operator << (std::ostream& stream, const training_metrics& metrics) {
+    auto number = [&] (double value) -> std::ostream& {
+      return std::isfinite(value) ? stream << value : stream << "null";
+    };
+    auto array = [&] (const std::vector <double>& values) {
+      stream << '[';
+      for (std::size_t i = 0; i < values.size(); ++i) {
+        if (i > 0)
+          stream << ',';
+        number(values[i]);
+      }
+      stream << ']';
+    };
+
+    const auto flags = stream.flags();
+    const auto precision = stream.precision();
+    stream << std::defaultfloat << std::setprecision(6);
+
+    stream << "{\"step\":" << metrics.step << ",\"epoch\":" << metrics.epoch << ",\"samples\":" << metrics.samples
+           << ",\"elapsed_s\":";
+    number(metrics.elapsed_seconds) << ",\"samples_per_s\":";
+    number(metrics.samples_per_second) << ",\"gflops\":";
+    number(metrics.gflops) << ",\"loss\":";
+    number(metrics.loss) << ",\"allocations\":";
+    if (metrics.allocations < 0)
+      stream << "null";
+    else
+      stream << metrics.allocations;
+    stream << ",\"forward_s\":";
+    array(metrics.forward_seconds);
+    stream << ",\"loss_s\":";
+    number(metrics.loss_seconds) << ",\"delta_s\":";
+    array(metrics.delta_seconds);
+    stream << ",\"backward_s\":";
+    array(metrics.backward_seconds);
+    stream << ",\"stall_s\":";
+    number(metrics.stall_seconds) << '}';
+
+    stream.flags(flags);
+    stream.precision(precision);
+    return stream;
+  }
+
+  /**
+   * @brief timers and counters fit keeps while it trains
+   *
+   * Disabled by default, in which case every call returns at once. Once started, the
+   * training loop passes the time point of the previous phase boundary to record(), so every
+   * phase of every layer costs a single clock read. Every `period` steps a training_metrics
+   * line goes to the file and / or callback given to start().
+   */
+  class training_telemetry {
+    public:
+      using clock = std::chrono::steady_clock;
+      using callback = std::function <void (const training_metrics&)>;
+
+      enum class phase {
+        forward,
+        loss,
+        delta,
+        backward,
+        stall
+      };
+
+    private:
+      bool enabled = false;
+      long period = 0;
+      double flops_per_sample = 0;
+      std::shared_ptr <std::ofstream> file;
+      callback listener;
+      training_metrics metrics;
+
+      clock::time_point started;
+      clock::time_point window_started;
+      long window_steps = 0;
+      long window_samples = 0;
+      double window_loss = 0;
+      std::uint64_t window_allocations = 0;
+
+    public:
+      void              start  (const std::string&, const callback&, long, int, double);
+      clock::time_point now    () const;
+      clock::time_point record (phase, int, clock::time_point);
+      void              step   (int, int, double);
+      void              finish ();
+
+    private:
+      void report ();
+  };
+
+  /**
+   * @brief Starts collecting
+   *
+   * @param path file the JSON lines are written to, or empty for none
+   * @param listener function called with every report, or empty for none
+   * @param period steps between reports
+   * @param layer_count number of layers, input layer included
+   * @param flops_per_sample floating point operations of a training step, per sample
+   */
+  inline void training_telemetry::start (const std::string& path, const callback& listener, long period,
+                                         int layer_count, double flops_per_sample) {
+    if (period < 1)
+      throw std::runtime_error("telemetry period must be positive");
+
+    file.reset();
+    if (not path.empty()) {
+      file = std::make_shared <std::ofstream> (path, std::ios::app);
+      if (not file->is_open())
+        throw std::runtime_error("unable to write telemetry to \"" + path + "\"");
+    }
+
+    enabled = true;
+    this->period = period;
+    this->flops_per_sample = flops_per_sample;
+    this->listener = listener;
+
+    metrics = training_metrics();
+    metrics.forward_seconds.assign(layer_count, 0);
+    metrics.delta_seconds.assign(layer_count, 0);
+    metrics.backward_seconds.assign(layer_count, 0);
+
+    started = window_started = clock::now();
+    window_steps = window_samples = 0;
+    window_loss = 0;
+    window_allocations = telemetry::allocation_count.load(std::memory_order_relaxed);
+  }
+
+  inline training_telemetry::clock::time_point training_telemetry::now () const {
+    return enabled ? clock::now() : clock::time_point();
+  }
+
+  /**
+   * @brief Adds the time since `since` to `kind` of `layer`
+   *
+   * @return the current time, to pass to the next record()
+   */
+  inline training_telemetry::clock::time_point training_telemetry::record (phase kind, int layer,
+                                                                           clock::time_point since) {
+    if (not enabled)
+      return since;
+
+    const clock::time_point time = clock::now();
+    const double seconds = std::chrono::duration <double> (time - since).count();
+
+    switch (kind) {
+      case phase::forward:
+        metrics.forward_seconds[layer] += seconds;
+        break;
+      case phase::loss:
+        metrics.loss_seconds += seconds;
+        break;
+      case phase::delta:
+        metrics.delta_seconds[layer] += seconds;
+        break;
+      case phase::backward:
+        metrics.backward_seconds[layer] += seconds;
+        break;
+      case phase::stall:
+        metrics.stall_seconds += seconds;
+        break;
+    }
+    return time;
+  }
+
+  /**
+   * @brief Counts one training step of `rows` samples with batch cost `cost`, and reports
+   *        every `period` steps
+   */
+  inline void training_telemetry::step (int epoch, int rows, double cost) {
+    if (not enabled)
+      return;
+
+    ++metrics.step;
+    metrics.epoch = epoch;
+    metrics.samples += rows;
+    ++window_steps;
+    window_samples += rows;
+    window_loss += cost;
+
+    if (window_steps == period)
+      report();
+  }
+
+  /**
+   * @brief Reports the steps left since the last report and stops collecting
+   */
+  inline void training_telemetry::finish () {
+    if (not enabled)
+      return;
+
+    if (window_steps > 0)
+      report();
+    file.reset();
+    listener = nullptr;
+    enabled = false;
+  }
+
+  inline void training_telemetry::report () {
+    const clock::time_point time = clock::now();
+    const double window_seconds = std::chrono::duration <double> (time - window_started).count();
+    const std::uint64_t allocations = telemetry::allocation_count.load(std::memory_order_relaxed);
+
+    metrics.elapsed_seconds = std::chrono::duration <double> (time - started).count();
+    metrics.samples_per_second = window_seconds > 0 ? window_samples / window_seconds : 0;
+    metrics.gflops = metrics.samples_per_second * flops_per_sample * 1e-9;
+    metrics.loss = window_loss / window_steps;
+    metrics.allocations = telemetry::tracking_allocations ? (long long)(allocations - window_allocations) : -1;
+
+    if (file)
+      *file << metrics << std::endl;
+    if (listener)
+      listener(metrics);
+
+    // the time spent reporting is not charged to the next window
+    window_started = clock::now();
+    window_steps = window_samples = 0;
+    window_loss = 0;
+    window_allocations = telemetry::allocation_count.load(std::memory_order_relaxed);
+  }
+
+} // namespace fmc
+
+// Defined in exactly one translation unit, replaces the global operator new and delete so that
+// telemetry can report how many heap allocations every window of training made
+#ifdef FMC_TRACK_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+namespace fmc::telemetry {
+  inline const bool tracking_enabled = (tracking_allocations = true);
+}
+
+// GCC pairs the inlined free() below with the operator new call sites and warns about the mismatch
+#if defined(__GNUC__) and not defined(__clang__)
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new (std::size_t size) {
+  fmc::telemetry::allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* pointer = std::malloc(size == 0 ? 1 : size))
+    return pointer;
+  throw std::bad_alloc();
+}
+
+void operator delete (void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete (void* pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+
+#if defined(__GNUC__) and not defined(__clang__)
+#  pragma GCC diagnostic pop
+#endif
+
+#endif // FMC_TRACK_ALLOCATIONS
+
+#endif // FMC_TELEMETRY_HPP
@@ -0,0 +1,228 @@
+// Arrow
+
+#ifndef FMC_TRAINER_HPP
+#define FMC_TRAINER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "augment.hpp"
+#include "checkpoint.hpp"
+#include "data_loader.hpp"
+#include "dataset.hpp"
+#include "early_stopping.hpp"
+#include "shard_stream.hpp"
+#include "shuffle.hpp"
+#include "telemetry.hpp"
+#include "utils.hpp"
+
+namespace fmc {
+
+  /**
+   * @brief settings of a call to network::fit
+   */
+  struct fit_options {
+    int epochs = 1;
+    int batch_size = 1;
+    std::string checkpoint_path = "";
+    long checkpoint_steps = 0;
+    double checkpoint_seconds = 0;
+    std::string resume_from = "";
+    int patience = 0;
+    double min_delta = 0;
+    std::string telemetry_path = "";
+    long telemetry_steps = 100;
+    std::function <void (const training_metrics&)> telemetry_callback = nullptr;
+    int prefetch = 2;
+    int loader_threads = 1;
+    fmc::shuffle shuffle = fmc::shuffle::none;
+    std::size_t shuffle_block = 1024;
+    fmc::augmentation augmentation = {};
+    std::uint64_t data_seed = 0;
+  };
+
+  /**
+   * @brief training loop shared by network and static_network; see network::fit
+   *
+   * Resumes from a checkpoint, draws the data seed, orders, gathers and augments the samples
+   * (directly or through a data_loader), writes the checkpoints, validates for early stopping
+   * and reports telemetry. The network only supplies the steps that depend on its layout:
+   *
+   *   capture (state, epoch, position)   snapshot of the parameters and optimizer state
+   *   restore (state)                    the inverse of capture
+   *   gather (...)                       fills its input with a batch of vectors, of a dataset,
+   *                                      or of a data_loader
+   *   propagate ()                       forward pass of the gathered batch, in training mode
+   *
+   * along with calculate_loss, calculate_delta, backward_propagate, freeze, training_flops, and
+   * its `cost`, `layer_count`, `telemetry` and `update_rule` members.
+   *
+   * @tparam T type of the weights and activations
+   * @tparam Network network that befriends the trainer
+   */
+  template <typename T, typename Network>
+  class trainer {
+    public:
+      template <typename Samples>
+      static Network& train (Network&, const Samples&, const std::vector <int>&,
+                             const typename early_stopping <T>::validator&, const fit_options&);
+  };
+
+  // Body of every fit overload; `validate` scores a frozen copy on the validation set, if any
+  template <typename T, typename Network>
+  template <typename Samples>
+  Network& trainer <T, Network>::train (Network& model, const Samples& data, const std::vector <int>& labels,
+                                        const typename early_stopping <T>::validator& validate,
+                                        const fit_options& options) {
+    if (options.batch_size < 1)
+      throw std::runtime_error("batch size must be positive");
+
+    std::cout << "[*] Training model" << std::endl;
+
+    const int size = data.size();
+    int first_epoch = 0;
+    int first_sample = 0;
+    std::uint64_t data_seed = options.data_seed;
+
+    if (not options.resume_from.empty()) {
+      std::cout << "[*] Resuming from checkpoint \"" << options.resume_from << "\"" << std::endl;
+
+      const training_state <T> state = checkpoint::read <T> (options.resume_from);
+      model.restore(state);
+      first_epoch = state.epoch;
+      first_sample = state.position;
+      data_seed = state.data_seed;
+    }
+    else if (data_seed == 0 and (options.shuffle != shuffle::none or options.augmentation.enabled()))
+      data_seed = (std::uint64_t)random::generator() << 32 | random::generator();
+
+    constexpr bool bytes = std::is_same_v <Samples, dataset> or std::is_same_v <Samples, shard_stream>;
+
+    if constexpr (not bytes)
+      if (options.augmentation.enabled())
+        throw std::runtime_error("augmentation needs the samples as a dataset of bytes");
+    if constexpr (std::is_same_v <Samples, shard_stream>)
+      if (options.prefetch < 1)
+        throw std::runtime_error("shard streams are read by a data loader, which needs a positive prefetch");
+
+    const sample_order order (size, options.shuffle, data_seed, options.shuffle_block);
+    augmenter augment (options.augmentation, data_seed);
+    std::vector <int> indices;
+    std::vector <int> gathered_labels (options.batch_size);
+
+    std::unique_ptr <checkpoint_writer <T>> writer;
+    checkpoint_schedule schedule (options.checkpoint_steps, options.checkpoint_seconds);
+
+    if (not options.checkpoint_path.empty())
+      writer = std::make_unique <checkpoint_writer <T>> (options.checkpoint_path);
+
+    std::unique_ptr <early_stopping <T>> monitor;
+    bool stopped = false;
+
+    if (validate)
+      monitor = std::make_unique <early_stopping <T>> (validate, options.patience, options.min_delta);
+
+    training_telemetry& telemetry = model.telemetry;
+
+    if (not options.telemetry_path.empty() or options.telemetry_callback)
+      telemetry.start(options.telemetry_path, options.telemetry_callback, options.telemetry_steps, model.layer_count,
+                      model.training_flops());
+
+    std::unique_ptr <data_loader <T>> loader;
+
+    if constexpr (std::is_same_v <Samples, shard_stream>)
+      loader = std::make_unique <data_loader <T>> (data, order, augment, options.batch_size, first_epoch, options.epochs,
+                                                   first_sample, options.prefetch);
+    else if constexpr (bytes)
+      if (options.prefetch > 0)
+        loader = std::make_unique <data_loader <T>> (data, order, augment, options.batch_size, first_epoch, options.epochs,
+                                                     first_sample, options.prefetch, options.loader_threads);
+
+    for (int epoch = first_epoch; epoch < options.epochs and not stopped; ++epoch) {
+      std::cout << "[*] Epoch: " << epoch + 1 << '/' << options.epochs << '\n';
+
+      if (not loader)
+        order.fill(epoch, indices);
+
+      for (int first = epoch == first_epoch ? first_sample : 0; first < size; first += options.batch_size) {
+        if (monitor and monitor->poll()) {
+          std::cout << "[*] Stopping early: no improvement for " << options.patience << " epochs" << std::endl;
+          stopped = true;
+          break;
+        }
+
+        const int rows = std::min(options.batch_size, size - first);
+        std::span <const int> batch_labels;
+
+        auto time = telemetry.now();
+        if (loader) {
+          typename data_loader <T>::batch batch {};
+          loader->next(batch);
+          model.gather(batch);
+          batch_labels = {batch.labels, (std::size_t)batch.rows};
+        }
+        else {
+          const std::span <const int> samples (indices.data() + first, rows);
+          if constexpr (std::is_same_v <Samples, dataset>)
+            model.gather(data, samples, epoch, augment);
+          else if constexpr (not bytes)
+            model.gather(data, samples);
+          for (int r = 0; r < rows; ++r)
+            gathered_labels[r] = labels[samples[r]];
+          batch_labels = {gathered_labels.data(), (std::size_t)rows};
+        }
+        telemetry.record(training_telemetry::phase::stall, 0, time);
+
+        model.propagate();
+        time = telemetry.now();
+        model.calculate_loss(batch_labels);
+        telemetry.record(training_telemetry::phase::loss, model.layer_count - 1, time);
+
+        model.calculate_delta();
+        model.backward_propagate();
+        telemetry.step(epoch + 1, rows, model.cost);
+
+        if (writer and schedule.due(model.update_rule.step_count)) {
+          training_state <T>& state = writer->acquire();
+          model.capture(state, epoch, first + rows);
+          state.data_seed = data_seed;
+          writer->submit();
+        }
+      }
+
+      if (monitor and not stopped) {
+        model.capture(monitor->snapshot(), epoch + 1, 0);
+        monitor->evaluate(model.freeze(), epoch + 1);
+      }
+    }
+
+    loader.reset();
+    if constexpr (std::is_same_v <Samples, shard_stream>)
+      std::cout << "[*] Streamed the shards: " << data.get_statistics() << std::endl;
+
+    telemetry.finish();
+    if (writer)
+      writer->finish();
+
+    if (monitor) {
+      monitor->finish();
+      if (const training_state <T>* best = monitor->best_state()) {
+        std::cout << "[*] Restoring the weights of epoch " << best->epoch << std::endl;
+        model.restore(*best);
+      }
+    }
+
+    return model;
+  }
+
+} // namespace fmc
+
+#endif // FMC_TRAINER_HPP
@@ -3,9 +3,16 @@
 #ifndef FMC_UTILS_HPP
 #define FMC_UTILS_HPP
 
+#include <algorithm>
+#include <bit>
 #include <cmath>
 #include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numbers>
 #include <random>
+#include <span>
 #include <type_traits>
 
 namespace fmc {
@@ -42,8 +49,236 @@ namespace fmc {
       return distribution(generator);
     }
 
+    /**
+     * @brief `lanes` interleaved xoshiro128+ streams for filling large buffers
+     *
+     * Every call to next() advances all of the streams with the same few shifts, xors and
+     * adds, so the loop vectorizes. The streams are seeded from `generator`, which keeps
+     * bulk fills reproducible under a fixed seed.
+     */
+    class bulk_generator {
+      public:
+        static const int lanes = 8;
+
+      private:
+        std::uint32_t s0 [lanes], s1 [lanes], s2 [lanes], s3 [lanes];
+
+      public:
+        bulk_generator () {
+          for (int i = 0; i < lanes; ++i) {
+            s0[i] = generator();
+            s1[i] = generator();
+            s2[i] = generator();
+            s3[i] = generator() | 1;
+          }
+        }
+
+        // Writes one 32-bit output per lane to `out`
+        void next (std::uint32_t* out) {
+          for (int i = 0; i < lanes; ++i) {
+            out[i] = s0[i] + s3[i];
+
+            const std::uint32_t t = s1[i] << 9;
+            s2[i] ^= s0[i];
+            s3[i] ^= s1[i];
+            s1[i] ^= s2[i];
+            s0[i] ^= s3[i];
+            s2[i] ^= t;
+            s3[i] = (s3[i] << 11) | (s3[i] >> 21);
+          }
+        }
+    };
+
+    /**
+     * @brief splitmix64, a generator whose whole state is a single counter
+     *
+     * Starting one costs nothing, so every sample can get a stream of its own, seeded from
+     * its epoch and index, that replays the same values whichever thread draws them.
+     */
+    class splitmix {
+      private:
+        std::uint64_t state;
+
+      public:
+        explicit splitmix (std::uint64_t seed)
+          : state (seed)
+        { }
+
+        // Hashes `value` into an unrelated word, so that nearby seeds start unrelated streams
+        static std::uint64_t mix (std::uint64_t value) {
+          value += 0x9e3779b97f4a7c15;
+          value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+          value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+          return value ^ (value >> 31);
+        }
+
+        std::uint64_t next () {
+          const std::uint64_t value = mix(state);
+          state += 0x9e3779b97f4a7c15;
+          return value;
+        }
+
+        // Uniform in [0, 1)
+        double canonical () {
+          return (next() >> 11) * 0x1.0p-53;
+        }
+
+        // Uniform in [-bound, bound]
+        int symmetric (int bound) {
+          return (int)(next() % (2 * (std::uint64_t)bound + 1)) - bound;
+        }
+    };
+
+    // Number of raw outputs drawn at a time by the bulk fills
+    const std::size_t fill_chunk = 256;
+
+    /**
+     * @brief fills a whole buffer with uniform values in range [x, y)
+     *
+     * Draws a chunk of raw 32-bit outputs from a bulk_generator and converts them in a
+     * separate loop; both loops vectorize, unlike a distribution called per element.
+     * Every value keeps the top 24 bits of its draw.
+     *
+     * @tparam T floating point type
+     * @param values buffer to fill
+     * @param x start of range
+     * @param y end of range
+     * @param source streams to draw from
+     */
+    template <typename T>
+    void fill_uniform (std::span <T> values, const T& x, const T& y, bulk_generator& source)
+      requires std::floating_point <T> {
+      std::uint32_t bits [fill_chunk];
+      const T scale = (y - x) * T(1.0 / (1 << 24));
+
+      for (std::size_t offset = 0; offset < values.size(); offset += fill_chunk) {
+        const std::size_t count = std::min(fill_chunk, values.size() - offset);
+        T* out = values.data() + offset;
+
+        for (std::size_t i = 0; i < count; i += bulk_generator::lanes)
+          source.next(bits + i);
+        for (std::size_t i = 0; i < count; ++i)
+          out[i] = x + (T)(bits[i] >> 8) * scale;
+      }
+    }
+
+    template <typename T>
+    void fill_uniform (std::span <T> values, const T& x, const T& y) requires std::floating_point <T> {
+      bulk_generator source;
+      fill_uniform(values, x, y, source);
+    }
+
+    /**
+     * @brief fills a whole buffer with normally distributed values, two at a time through the
+     *        Box-Muller transform of bulk uniform draws
+     *
+     * @tparam T floating point type
+     * @param values buffer to fill
+     * @param mean mean of the distribution
+     * @param deviation standard deviation of the distribution
+     */
+    template <typename T>
+    void fill_normal (std::span <T> values, const T& mean, const T& deviation) requires std::floating_point <T> {
+      const T two_pi = 2 * std::numbers::pi_v <T>;
+      bulk_generator source;
+      T uniform [fill_chunk];
+
+      for (std::size_t offset = 0; offset < values.size(); offset += fill_chunk) {
+        const std::size_t count = std::min(fill_chunk, values.size() - offset);
+        const std::size_t pairs = (count + 1) / 2;
+        T* out = values.data() + offset;
+
+        fill_uniform(std::span <T> (uniform, 2 * pairs), T(0), T(1), source);
+
+        for (std::size_t i = 0; i < pairs; ++i) {
+          const T radius = deviation * std::sqrt(-2 * std::log(1 - uniform[2 * i]));
+          const T angle = two_pi * uniform[2 * i + 1];
+
+          out[2 * i] = mean + radius * std::cos(angle);
+          if (2 * i + 1 < count)
+            out[2 * i + 1] = mean + radius * std::sin(angle);
+        }
+      }
+    }
+
   } // namespace random
 
+  namespace approximate {
+
+    /**
+     * @brief Accuracy of the batch activation kernels
+     *
+     * exact: std::exp through libm
+     * high:  polynomial exp within 3 ulp for float (degree 6) and 1.2 ulp for double (degree 13)
+     * low:   degree 4 polynomial exp, relative error below 5e-5
+     *
+     * long double always uses std::exp.
+     */
+    enum class precision {
+      exact,
+      high,
+      low
+    };
+
+    /**
+     * @brief exp(x) = 2^k * p(r) with x = k * ln 2 + r, |r| <= ln 2 / 2
+     *
+     * Every step is branch-free arithmetic or bit manipulation, so loops calling it vectorize.
+     * k is rounded with the 1.5 * 2^mantissa trick instead of std::floor, and 2^k is assembled
+     * directly in the exponent bits. Inputs are clamped to the range the type can represent.
+     *
+     * @tparam T float or double
+     * @tparam Degree degree of the Taylor polynomial p
+     * @param x input
+     * @return T approximation of exp(x)
+     */
+    template <typename T, int Degree>
+    inline T exp (T x) requires (std::same_as <T, float> or std::same_as <T, double>) {
+      using bits_type = std::conditional_t <std::same_as <T, float>, std::int32_t, std::int64_t>;
+
+      const int mantissa_bits = std::numeric_limits <T>::digits - 1;
+      const int exponent_bias = std::numeric_limits <T>::max_exponent - 1;
+      const T limit = (T)(exponent_bias - 1) * std::numbers::ln2_v <T>;
+      const T round = T(1.5) * (T)((bits_type)1 << mantissa_bits);
+      const T ln2_hi = std::same_as <T, float> ? T(0.693145751953125) : T(0.693147180369123816490);
+      const T ln2_lo = std::same_as <T, float> ? T(1.428606765330187045e-06) : T(1.90821492927058770002e-10);
+
+      x = std::max(std::min(x, limit), -limit);
+
+      // after adding `round`, the low bits of the mantissa hold k itself
+      const T shifted = x * std::numbers::log2e_v <T> + round;
+      const T k = shifted - round;
+      const T r = (x - k * ln2_hi) - k * ln2_lo;
+
+      T p = 1;
+#pragma GCC unroll 16
+      for (int i = Degree; i > 0; --i)
+        p = 1 + p * r * (T(1) / i);
+
+      const bits_type exponent = (std::bit_cast <bits_type> (shifted) - std::bit_cast <bits_type> (round) + exponent_bias)
+                                 << mantissa_bits;
+      return p * std::bit_cast <T> (exponent);
+    }
+
+    /**
+     * @brief Calls `function` with an exp functor of the requested precision, so that the
+     *        choice is made once per call instead of once per element
+     */
+    template <typename T, typename F>
+    inline void with_exp (precision p, F&& function) {
+      if constexpr (std::same_as <T, float> or std::same_as <T, double>) {
+        const int high_degree = std::same_as <T, float> ? 6 : 13;
+
+        if (p == precision::high)
+          return function([] (T x) { return exp <T, high_degree> (x); });
+        if (p == precision::low)
+          return function([] (T x) { return exp <T, 4> (x); });
+      }
+      function([] (T x) -> T { return std::exp(x); });
+    }
+
+  } // namespace approximate
+
   namespace activation {
 
     /**
@@ -96,6 +331,208 @@ namespace fmc {
       return result * (1 - result);
     }
 
+    /**
+     * @brief Hyperbolic tangent
+     * 
+     * @tparam T floating point type
+     * @param x input
+     * @return T tanh(x)
+     */
+    template <typename T>
+    T tanh (const T& x) requires std::floating_point <T> {
+      return std::tanh(x);
+    }
+
+    /**
+     * @brief Derivative of the hyperbolic tangent w.r.t. its input
+     * 
+     * @tparam T floating point type
+     * @param x input
+     * @return T 1 - tanh(x) ** 2
+     */
+    template <typename T>
+    T tanh_derivative (const T& x) requires std::floating_point <T> {
+      T result = std::tanh(x);
+      return 1 - result * result;
+    }
+
+    /**
+     * @brief Identity, for layers that only rearrange their inputs such as pooling
+     * 
+     * @tparam T type
+     * @param x input
+     * @return T x
+     */
+    template <typename T>
+    T identity (const T& x) {
+      return x;
+    }
+
+    /**
+     * @brief Derivative of the identity w.r.t. its input
+     * 
+     * @tparam T type
+     * @return T 1
+     */
+    template <typename T>
+    T identity_derivative ([[maybe_unused]] const T& x) {
+      return 1;
+    }
+
+    /**
+     * @brief Softmax over a whole row: exp(x_i - max) / sum_j exp(x_j - max)
+     * 
+     * @tparam T floating point type
+     * @param values row to transform in place
+     * @param p precision of the exponentials
+     */
+    template <typename T>
+    void softmax (std::span <T> values, approximate::precision p = approximate::precision::exact)
+      requires std::floating_point <T> {
+      if (values.empty())
+        return;
+
+      T max = *std::max_element(values.begin(), values.end());
+      T sum = 0;
+
+      approximate::with_exp <T> (p, [&] (auto exp) {
+        for (T& value : values)
+          sum += value = exp(value - max);
+      });
+      for (T& value : values)
+        value /= sum;
+    }
+
+    /**
+     * @brief Activation functions that can be evaluated in bulk without an indirect call per element.
+     *        Anything that is not recognised is `custom` and goes through the function pointer.
+     *        `softmax` depends on a whole row and can only be used by an output layer that is
+     *        trained with error::cross_entropy.
+     */
+    enum class kind {
+      custom,
+      sigmoid,
+      relu,
+      softmax,
+      tanh,
+      identity
+    };
+
+    /**
+     * @brief Identifies which of the known activation functions a function pointer refers to
+     *
+     * @tparam T type of the values the activation function operates on
+     * @param function activation function
+     * @return kind kind of the activation function
+     */
+    template <typename T>
+    kind kind_of (T (*function) (const T&)) {
+      if (function == &sigmoid <T>)
+        return kind::sigmoid;
+      if (function == &relu <T>)
+        return kind::relu;
+      if (function == &tanh <T>)
+        return kind::tanh;
+      if (function == &identity <T>)
+        return kind::identity;
+      return kind::custom;
+    }
+
+    /**
+     * @brief Whether the derivative of an activation can be computed from its output alone, so
+     *        that the layer does not need to keep its pre-activation values
+     */
+    inline bool derivative_from_output (kind k) {
+      return k == kind::sigmoid or k == kind::relu or k == kind::tanh or k == kind::identity;
+    }
+
+    /**
+     * @brief Applies an activation in place to a row-major (rows x cols) block of values
+     * 
+     * @tparam T type of the values the activation function operates on
+     * @param k kind of the activation
+     * @param function activation function; only used when `k` is kind::custom
+     * @param values first of rows * cols contiguous values
+     * @param rows number of rows
+     * @param cols number of columns
+     * @param p precision of the exponentials in sigmoid, tanh and softmax
+     */
+    template <typename T>
+    void apply (kind k, T (*function) (const T&), T* values, int rows, int cols,
+                approximate::precision p = approximate::precision::exact) {
+      const std::size_t size = (std::size_t)rows * cols;
+
+      switch (k) {
+        case kind::sigmoid:
+          approximate::with_exp <T> (p, [&] (auto exp) {
+            for (std::size_t i = 0; i < size; ++i)
+              values[i] = T(1) / (T(1) + exp(-values[i]));
+          });
+          break;
+        case kind::relu:
+          for (std::size_t i = 0; i < size; ++i)
+            values[i] = relu(values[i]);
+          break;
+        case kind::tanh:
+          approximate::with_exp <T> (p, [&] (auto exp) {
+            for (std::size_t i = 0; i < size; ++i)
+              values[i] = T(1) - T(2) / (exp(2 * values[i]) + T(1));
+          });
+          break;
+        case kind::softmax:
+          for (int r = 0; r < rows; ++r)
+            softmax(std::span <T> (values + (std::size_t)r * cols, cols), p);
+          break;
+        case kind::identity:
+          break;
+        case kind::custom:
+          for (std::size_t i = 0; i < size; ++i)
+            values[i] = function(values[i]);
+          break;
+      }
+    }
+
+    /**
+     * @brief Multiplies `size` deltas in place by the derivative of their activation
+     *
+     * For sigmoid, tanh and ReLU the derivative is computed from the activation output y:
+     * y * (1 - y), 1 - y ** 2 and [y > 0]. Only kind::custom evaluates `derivative` on the
+     * pre-activation values.
+     * 
+     * @tparam T type of the values the activation function operates on
+     * @param k kind of the activation
+     * @param derivative derivative of the activation; only used when `k` is kind::custom
+     * @param inputs pre-activation values; only read when `k` is kind::custom
+     * @param outputs activation outputs
+     * @param delta values to multiply
+     * @param size number of values
+     */
+    template <typename T>
+    void apply_derivative (kind k, T (*derivative) (const T&), const T* inputs, const T* outputs,
+                           T* delta, std::size_t size) {
+      switch (k) {
+        case kind::sigmoid:
+          for (std::size_t i = 0; i < size; ++i)
+            delta[i] *= outputs[i] * (1 - outputs[i]);
+          break;
+        case kind::relu:
+          for (std::size_t i = 0; i < size; ++i)
+            delta[i] = outputs[i] > 0 ? delta[i] : 0;
+          break;
+        case kind::tanh:
+          for (std::size_t i = 0; i < size; ++i)
+            delta[i] *= 1 - outputs[i] * outputs[i];
+          break;
+        case kind::softmax:
+        case kind::identity:
+          break;
+        case kind::custom:
+          for (std::size_t i = 0; i < size; ++i)
+            delta[i] *= derivative(inputs[i]);
+          break;
+      }
+    }
+
   } // namespace activation
 
   namespace error {
@@ -128,6 +565,37 @@ namespace fmc {
       return 2 * difference;
     }
 
+    /**
+     * @brief Calculates the categorical cross-entropy term of one output: -y * log(x)
+     * 
+     * @tparam T floating point type
+     * @param lhs x, the predicted probability (in above expression)
+     * @param rhs y, the expected probability (in above expression)
+     * @return T cross-entropy
+     */
+    template <typename T>
+    T cross_entropy (const T& lhs, const T& rhs) requires std::floating_point <T> {
+      const T epsilon = std::numeric_limits <T>::min();
+      return rhs == 0 ? 0 : -rhs * std::log(std::max(lhs, epsilon));
+    }
+
+    /**
+     * @brief Calculates the derivative of the cross-entropy w.r.t. x: -y / x
+     * 
+     * When the output layer is a softmax, the network does not call this; it fuses both into
+     * the gradient p - onehot(label) instead.
+     * 
+     * @tparam T floating point type
+     * @param lhs x, the predicted probability (in above expression)
+     * @param rhs y, the expected probability (in above expression)
+     * @return T cross-entropy derivative
+     */
+    template <typename T>
+    T cross_entropy_derivative (const T& lhs, const T& rhs) requires std::floating_point <T> {
+      const T epsilon = std::numeric_limits <T>::min();
+      return rhs == 0 ? 0 : -rhs / std::max(lhs, epsilon);
+    }
+
   } // namespace error
 
 } // namespace fmc
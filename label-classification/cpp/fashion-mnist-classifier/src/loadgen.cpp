@@ -0,0 +1,164 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batching_server.hpp"
+#include "protocol.hpp"
+
+struct options {
+  std::string unix_path;
+  int port = 0;
+  int connections = 4;
+  int requests = 1000;
+  int batch = 1;
+};
+
+void usage () {
+  std::cout << "Usage: ./fmc-loadgen (--unix path | --port port) [--connections count] [--requests per-connection] [--batch images]\n";
+}
+
+void fail (const std::string& what) {
+  throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+int connect_socket (const options& settings) {
+  int fd;
+
+  if (not settings.unix_path.empty()) {
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, settings.unix_path.c_str(), sizeof(address.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 or connect(fd, (sockaddr*)&address, sizeof(address)) < 0)
+      fail("connect");
+  }
+  else {
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(settings.port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 or connect(fd, (sockaddr*)&address, sizeof(address)) < 0)
+      fail("connect");
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  }
+
+  return fd;
+}
+
+void send_all (int fd, const std::vector <std::uint8_t>& buffer) {
+  for (std::size_t sent = 0; sent < buffer.size(); ) {
+    ssize_t written = send(fd, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+    if (written <= 0)
+      fail("send");
+    sent += written;
+  }
+}
+
+void receive_all (int fd, std::uint8_t* data, std::size_t size) {
+  for (std::size_t received = 0; received < size; ) {
+    ssize_t read = recv(fd, data + received, size - received, 0);
+    if (read <= 0)
+      fail("recv");
+    received += read;
+  }
+}
+
+// Closed loop: every connection keeps exactly one request in flight
+void client (const options& settings, int seed, fmc::latency_histogram& latencies, std::atomic <long long>& errors) {
+  using clock = std::chrono::steady_clock;
+
+  std::mt19937 generator (seed);
+  std::vector <std::uint8_t> pixels ((std::size_t)settings.batch * fmc::protocol::image_size);
+  std::vector <std::uint8_t> request;
+  std::vector <std::uint8_t> response;
+
+  for (auto& pixel : pixels)
+    pixel = generator();
+  fmc::protocol::encode_request(request, pixels);
+
+  int fd = connect_socket(settings);
+
+  for (int i = 0; i < settings.requests; ++i) {
+    auto start = clock::now();
+
+    send_all(fd, request);
+    response.resize(fmc::protocol::header_size);
+    receive_all(fd, response.data(), fmc::protocol::header_size);
+    response.resize(fmc::protocol::frame_size(response));
+    receive_all(fd, response.data() + fmc::protocol::header_size, response.size() - fmc::protocol::header_size);
+
+    latencies.record(std::chrono::duration_cast <std::chrono::microseconds> (clock::now() - start).count());
+
+    fmc::protocol::response decoded = fmc::protocol::decode_response(response);
+    if (decoded.status != fmc::protocol::status_code::ok or (int)decoded.labels.size() != settings.batch)
+      ++errors;
+  }
+
+  close(fd);
+}
+
+int main (int argc, char* argv[]) {
+  options settings;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (argument == "--unix")
+      settings.unix_path = argv[++i];
+    else if (argument == "--port")
+      settings.port = std::stoi(argv[++i]);
+    else if (argument == "--connections")
+      settings.connections = std::max(1, std::stoi(argv[++i]));
+    else if (argument == "--requests")
+      settings.requests = std::max(1, std::stoi(argv[++i]));
+    else if (argument == "--batch")
+      settings.batch = std::clamp(std::stoi(argv[++i]), 1, fmc::protocol::max_count);
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (settings.unix_path.empty() == (settings.port == 0)) {
+    usage();
+    return 1;
+  }
+
+  fmc::latency_histogram latencies;
+  std::atomic <long long> errors (0);
+  std::vector <std::thread> clients;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < settings.connections; ++i)
+    clients.emplace_back(client, std::cref(settings), i, std::ref(latencies), std::ref(errors));
+  for (auto& thread : clients)
+    thread.join();
+
+  std::chrono::duration <double> elapsed = std::chrono::steady_clock::now() - start;
+  double requests = (double)settings.connections * settings.requests;
+
+  std::cout << "requests:   " << (long long)requests << " (" << errors.load() << " errors)\n"
+            << "elapsed:    " << elapsed.count() << " s\n"
+            << "throughput: " << requests / elapsed.count() << " requests/s, "
+            << requests * settings.batch / elapsed.count() << " images/s\n"
+            << "latency:    p50 " << latencies.percentile(50) << " us, p99 " << latencies.percentile(99) << " us\n";
+
+  return 0;
+}
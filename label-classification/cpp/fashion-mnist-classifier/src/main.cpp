@@ -1,64 +1,97 @@
+// count heap allocations in the training telemetry
+#define FMC_TRACK_ALLOCATIONS
+
+#include <filesystem>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "matrix.hpp"
 #include "mnist.hpp"
+#include "model.hpp"
 #include "nn.hpp"
+#include "telemetry.hpp"
 #include "utils.hpp"
 
-void init_model (fmc::network <long double>& model) {
-  model
-    .add(fmc::layer <long double> (784, fmc::activation::sigmoid, fmc::activation::sigmoid_derivative))
-    .add(fmc::layer <long double> (128, fmc::activation::sigmoid, fmc::activation::sigmoid_derivative))
-    .add(fmc::layer <long double> (128, fmc::activation::sigmoid, fmc::activation::sigmoid_derivative))
-    .add(fmc::layer <long double> (10,  fmc::activation::sigmoid, fmc::activation::sigmoid_derivative))
-    .compile();
+const std::string checkpoint_path = "../model/fmc.1.checkpoint";
+
+// Loads one split: the IDX files of the original distribution load without parsing, the Kaggle CSV export is the fallback
+void load (fmc::mnist& mnist, fmc::mnist::split split, bool rebuild_cache) {
+  const bool training = split == fmc::mnist::split::training;
+  const std::string prefix = "../res/datasets/" + std::string(training ? "train" : "t10k");
+
+  if (std::filesystem::exists(prefix + "-images-idx3-ubyte"))
+    mnist.load_idx(split, prefix + "-images-idx3-ubyte", prefix + "-labels-idx1-ubyte");
+  else
+    mnist.load(split, training ? "../res/datasets/fashion-mnist_train.csv" : "../res/datasets/fashion-mnist_test.csv",
+               rebuild_cache);
 }
 
-void train (fmc::network <long double>& model, fmc::mnist& mnist) {
-  model
-    .fit(mnist.training_dataset, mnist.training_labels, 10)
+void train (model <long double>& network, fmc::mnist& mnist, bool resume) {
+  // the last tenth of the training set is held out to decide when to stop
+  const int validation_size = mnist.training_dataset.size() / 10;
+  const fmc::dataset validation_dataset = mnist.training_dataset.split(mnist.training_dataset.size() - validation_size);
+
+  network
+    .set_optimizer(fmc::optimizer <long double>::adam(0.001))
+    .fit(mnist.training_dataset, validation_dataset, {
+      .epochs = 30,
+      .batch_size = 32,
+      .checkpoint_path = checkpoint_path,
+      .checkpoint_seconds = 60,
+      .resume_from = resume ? checkpoint_path : "",
+      .patience = 3,
+      .telemetry_path = "../model/fmc.1.training.jsonl",
+      .shuffle = fmc::shuffle::samples
+    })
     .save("../model/fmc.1.model");
 }
 
-void test (fmc::network <long double>& model, fmc::mnist& mnist) {
-  model
+void test (model <long double>& network, fmc::mnist& mnist) {
+  fmc::evaluation_result result = network
     .load("../model/fmc.1.model")
-    .evaluate(mnist.testing_dataset, mnist.testing_labels);
+    .evaluate(mnist.testing_dataset);
+
+  std::cout << result << std::endl;
 }
 
 int main (int argc, char* argv[]) {
   const std::string train_str = "train";
+  const std::string resume_str = "resume";
   const std::string test_str = "test";
+  const std::string rebuild_cache_str = "--rebuild-cache";
 
-  if (argc != 2 or (argv[1] != train_str and argv[1] != test_str)) {
-    std::cout << "Usage: ./fashion-mnist-classifier [train|test]\n";
+  if (argc < 2 or argc > 3 or (argv[1] != train_str and argv[1] != resume_str and argv[1] != test_str)
+      or (argc == 3 and argv[2] != rebuild_cache_str)) {
+    std::cout << "Usage: ./fashion-mnist-classifier [train|resume|test] [--rebuild-cache]\n";
     return 0;
   }
 
+  const bool rebuild_cache = argc == 3;
+
   const int training_size = 60000;
   const int testing_size  = 10000;
   
   fmc::mnist mnist (training_size, testing_size);
 
-  mnist
-    .load(
-      "../res/datasets/fashion-mnist_train.csv",
-      "../res/datasets/fashion-mnist_test.csv"
-    )
-    .normalize();
-
-  fmc::network <long double> model (
-    0.005,
-    fmc::error::square_error,
-    fmc::error::square_error_derivative
+  // training never looks at the testing set, nor testing at the training set, so only one is read
+  const bool training = argv[1] == train_str or argv[1] == resume_str;
+  load(mnist, training ? fmc::mnist::split::training : fmc::mnist::split::testing, rebuild_cache);
+  mnist.normalize();
+
+  model <long double> network (
+    0.1,
+    fmc::error::cross_entropy,
+    fmc::error::cross_entropy_derivative
   );
 
-  init_model(model);
+  // resuming and testing overwrite every weight with the checkpoint or the model they load
+  network.compile(argv[1] == train_str);
 
-  if (argv[1] == std::string("train"))
-    train(model, mnist);
+  if (training)
+    train(network, mnist, argv[1] == resume_str);
   else
-    test(model, mnist);
+    test(network, mnist);
 
   return 0;
 }
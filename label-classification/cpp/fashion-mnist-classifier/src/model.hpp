@@ -0,0 +1,14 @@
+// Arrow
+
+#ifndef FMC_SRC_MODEL_HPP
+#define FMC_SRC_MODEL_HPP
+
+#include "static_network.hpp"
+#include "utils.hpp"
+
+// Topology of the shipped model; shared by every binary that loads ../model/fmc.1.model.
+// The output is a softmax, so the network must be built with error::cross_entropy.
+template <typename T>
+using model = fmc::static_network <T, fmc::activation::kind::sigmoid, fmc::activation::kind::softmax, 784, 128, 128, 10>;
+
+#endif // FMC_SRC_MODEL_HPP
@@ -0,0 +1,389 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "inference.hpp"
+#include "model.hpp"
+#include "nn.hpp"
+#include "protocol.hpp"
+
+using value_type = float;
+
+static std::atomic <bool> running (true);
+
+// Replies a connection may have waiting to be sent before its requests stop being read and answered
+const std::size_t max_pending_output = 4 << 20;
+
+struct connection {
+  int fd;
+  std::vector <std::uint8_t> input;
+  std::vector <std::uint8_t> output;
+  std::size_t output_offset = 0;
+  bool input_closed = false;
+  std::uint32_t watching = EPOLLIN;
+};
+
+// The epoll instance of a worker and the connections registered with it, which the worker
+// closes as they end and main closes at shutdown
+struct worker_state {
+  int epoll_fd;
+  std::mutex lock;
+  std::unordered_set <connection*> connections;
+};
+
+struct options {
+  std::string model_path = "../model/fmc.1.model";
+  std::string unix_path;
+  int port = 0;
+  int worker_count = std::max(1u, std::thread::hardware_concurrency());
+};
+
+void usage () {
+  std::cout << "Usage: ./fmc-serve [--model path] (--unix path | --port port) [--workers count]\n";
+}
+
+void fail (const std::string& what) {
+  throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+int listen_socket (const options& settings) {
+  int fd;
+
+  if (not settings.unix_path.empty()) {
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (settings.unix_path.size() >= sizeof(address.sun_path))
+      throw std::runtime_error("unix socket path is too long");
+    std::strcpy(address.sun_path, settings.unix_path.c_str());
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+      fail("socket");
+    unlink(settings.unix_path.c_str());
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) < 0)
+      fail("bind");
+  }
+  else {
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(settings.port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+      fail("socket");
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) < 0)
+      fail("bind");
+  }
+
+  if (listen(fd, SOMAXCONN) < 0)
+    fail("listen");
+  return fd;
+}
+
+// Whether `c` has as many replies waiting as it may
+bool backlogged (const connection& c) {
+  return c.output.size() - c.output_offset >= max_pending_output;
+}
+
+// Appends one response per complete request frame in `c.input`, until `c` is backlogged; returns false
+// on a malformed frame
+bool handle_frames (connection& c, const fmc::inference_model <value_type>& model,
+                    fmc::inference_model <value_type>::scratch& buffer,
+                    std::vector <value_type>& inputs, std::vector <value_type>& outputs) {
+  const value_type scale = value_type(1) / 255;
+  std::size_t consumed = 0;
+  bool valid = true;
+
+  while (not backlogged(c)) {
+    std::span <const std::uint8_t> pending (c.input.data() + consumed, c.input.size() - consumed);
+    std::size_t size = fmc::protocol::frame_size(pending);
+
+    // a length no request can have is rejected from its prefix alone, before any of the frame is buffered
+    if (size > fmc::protocol::header_size * 2 + (std::size_t)fmc::protocol::max_count * fmc::protocol::image_size) {
+      valid = false;
+      break;
+    }
+    if (size == 0 or pending.size() < size)
+      break;
+
+    std::span <const std::uint8_t> pixels = fmc::protocol::decode_request(pending.first(size));
+    consumed += size;
+
+    if (pixels.empty()) {
+      fmc::protocol::encode_error(c.output, fmc::protocol::status_code::bad_request);
+      continue;
+    }
+
+    std::size_t count = pixels.size() / fmc::protocol::image_size;
+    inputs.resize(pixels.size());
+    outputs.resize(count * model.get_output_size());
+
+    for (std::size_t i = 0; i < pixels.size(); ++i)
+      inputs[i] = pixels[i] * scale;
+
+    model.predict_proba_batch(std::span <const value_type> (inputs), outputs, buffer);
+    fmc::protocol::encode_response(c.output, std::span <const value_type> (outputs), model.get_output_size());
+  }
+
+  c.input.erase(c.input.begin(), c.input.begin() + consumed);
+  return valid;
+}
+
+// Writes as much pending output as the socket accepts; returns false if the peer is gone
+bool flush (connection& c) {
+  while (c.output_offset < c.output.size()) {
+    ssize_t written = send(c.fd, c.output.data() + c.output_offset, c.output.size() - c.output_offset, MSG_NOSIGNAL);
+    if (written < 0) {
+      // what was sent is dropped once it is most of the buffer, so a slow reader does not keep it all
+      if (c.output_offset > c.output.size() / 2) {
+        c.output.erase(c.output.begin(), c.output.begin() + c.output_offset);
+        c.output_offset = 0;
+      }
+      return errno == EAGAIN or errno == EWOULDBLOCK;
+    }
+    c.output_offset += written;
+  }
+  c.output.clear();
+  c.output_offset = 0;
+  return true;
+}
+
+/**
+ * Reads, answers and writes as much as `c` allows without blocking. Reading stops while the replies
+ * waiting to be sent reach max_pending_output, so a client that pipelines requests without reading
+ * the replies is not served past that. Once the peer has shut down its side, the requests it sent
+ * are still answered; the connection ends when the last reply has been sent.
+ *
+ * Returns false once the connection is over, or failed.
+ */
+bool serve (connection& c, const fmc::inference_model <value_type>& model,
+            fmc::inference_model <value_type>::scratch& buffer, std::vector <value_type>& inputs,
+            std::vector <value_type>& outputs, std::vector <std::uint8_t>& chunk) {
+  for (;;) {
+    const std::size_t pending = c.input.size();
+
+    if (not handle_frames(c, model, buffer, inputs, outputs) or not flush(c))
+      return false;
+    if (backlogged(c))
+      break;
+    if (c.input_closed) {
+      // frames held back while backlogged are answered now that the output drains
+      if (c.input.size() == pending)
+        break;
+      continue;
+    }
+
+    ssize_t received = recv(c.fd, chunk.data(), chunk.size(), 0);
+    if (received > 0)
+      c.input.insert(c.input.end(), chunk.begin(), chunk.begin() + received);
+    else if (received == 0)
+      c.input_closed = true;
+    else if (errno == EAGAIN or errno == EWOULDBLOCK)
+      break;
+    else if (errno != EINTR)
+      return false;
+  }
+
+  return not c.input_closed or not c.output.empty();
+}
+
+void close_connection (worker_state& state, connection* c) {
+  {
+    std::lock_guard <std::mutex> guard (state.lock);
+    state.connections.erase(c);
+  }
+  epoll_ctl(state.epoll_fd, EPOLL_CTL_DEL, c->fd, nullptr);
+  close(c->fd);
+  delete c;
+}
+
+// Every worker owns an epoll instance and the connections the acceptor registered with it
+void worker (worker_state& state, const fmc::inference_model <value_type>& model) {
+  auto buffer = model.make_scratch();
+  std::vector <value_type> inputs;
+  std::vector <value_type> outputs;
+  std::vector <std::uint8_t> chunk (1 << 16);
+  epoll_event events [64];
+
+  while (running.load(std::memory_order_relaxed)) {
+    int ready = epoll_wait(state.epoll_fd, events, 64, 200);
+
+    for (int i = 0; i < ready; ++i) {
+      connection* c = (connection*)events[i].data.ptr;
+
+      if ((events[i].events & EPOLLERR) or not serve(*c, model, buffer, inputs, outputs, chunk)) {
+        close_connection(state, c);
+        continue;
+      }
+
+      // requests are read while the connection is open and not backlogged, replies written while any wait
+      std::uint32_t watching = (c->input_closed or backlogged(*c) ? 0 : (std::uint32_t)EPOLLIN)
+                             | (c->output.empty() ? 0 : (std::uint32_t)EPOLLOUT);
+      if (c->watching != watching) {
+        c->watching = watching;
+
+        epoll_event event {};
+        event.events = watching;
+        event.data.ptr = c;
+        epoll_ctl(state.epoll_fd, EPOLL_CTL_MOD, c->fd, &event);
+      }
+    }
+  }
+}
+
+void stop (int) {
+  running.store(false);
+}
+
+int main (int argc, char* argv[]) {
+  options settings;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (argument == "--model")
+      settings.model_path = argv[++i];
+    else if (argument == "--unix")
+      settings.unix_path = argv[++i];
+    else if (argument == "--port")
+      settings.port = std::stoi(argv[++i]);
+    else if (argument == "--workers")
+      settings.worker_count = std::max(1, std::stoi(argv[++i]));
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (settings.unix_path.empty() == (settings.port == 0)) {
+    usage();
+    return 1;
+  }
+
+  model <value_type> network (0, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+  const fmc::inference_model <value_type> frozen = network.load(settings.model_path).freeze();
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  int listen_fd = listen_socket(settings);
+  std::vector <worker_state> states (settings.worker_count);
+  std::vector <std::thread> workers;
+
+  for (worker_state& state : states) {
+    state.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (state.epoll_fd < 0)
+      fail("epoll_create1");
+    workers.emplace_back(worker, std::ref(state), std::cref(frozen));
+  }
+
+  std::cout << "[*] Serving on " << (settings.unix_path.empty() ? "127.0.0.1:" + std::to_string(settings.port) : settings.unix_path)
+            << " with " << settings.worker_count << " workers\n" << std::flush;
+
+  int accept_epoll = epoll_create1(EPOLL_CLOEXEC);
+  epoll_event listen_event {};
+  listen_event.events = EPOLLIN;
+  listen_event.data.fd = listen_fd;
+  epoll_ctl(accept_epoll, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+  // held open so that, out of descriptors, a pending connection can still be accepted and
+  // closed; left pending, it would wake the level-triggered epoll_wait below on every pass
+  int spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+  for (std::size_t next = 0; running.load(std::memory_order_relaxed); ) {
+    epoll_event event;
+    if (epoll_wait(accept_epoll, &event, 1, 200) <= 0)
+      continue;
+
+    for (;;) {
+      int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+      if (fd < 0) {
+        if (errno == EINTR or errno == ECONNABORTED)
+          continue;
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+          break;
+        if ((errno == EMFILE or errno == ENFILE) and spare_fd >= 0) {
+          // accept4 reports EMFILE even when nothing is pending; freeing the spare tells the two apart
+          close(spare_fd);
+          fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+          if (fd >= 0) {
+            std::cout << "[*] Refusing a connection: out of file descriptors\n";
+            close(fd);
+          }
+          spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+          if (fd < 0)
+            break;
+          continue;
+        }
+
+        std::cout << "[*] Failed to accept a connection: " << std::strerror(errno) << '\n';
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        break;
+      }
+
+      int enable = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+      worker_state& state = states[next++ % states.size()];
+      connection* c = new connection {fd, {}, {}};
+
+      {
+        std::lock_guard <std::mutex> guard (state.lock);
+        state.connections.insert(c);
+      }
+
+      epoll_event client {};
+      client.events = EPOLLIN;
+      client.data.ptr = c;
+      if (epoll_ctl(state.epoll_fd, EPOLL_CTL_ADD, fd, &client) < 0) {
+        std::cout << "[*] Failed to register a connection: " << std::strerror(errno) << '\n';
+        close_connection(state, c);
+      }
+    }
+  }
+
+  std::cout << "[*] Shutting down\n";
+
+  for (auto& thread : workers)
+    thread.join();
+  for (worker_state& state : states) {
+    for (connection* c : state.connections) {
+      close(c->fd);
+      delete c;
+    }
+    close(state.epoll_fd);
+  }
+  if (spare_fd >= 0)
+    close(spare_fd);
+  close(accept_epoll);
+  close(listen_fd);
+  if (not settings.unix_path.empty())
+    unlink(settings.unix_path.c_str());
+
+  return 0;
+}
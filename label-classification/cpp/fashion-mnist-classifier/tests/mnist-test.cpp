@@ -18,7 +18,7 @@ int main () {
 
   for (int i = 0; i < 5; ++i) {
     int index = fmc::random::random(0, training_size - 1);
-    std::cout << "Label: " << mnist_fashion.get_named_label(mnist_fashion.training_labels[index]) << '\n';
+    std::cout << "Label: " << mnist_fashion.get_named_label(mnist_fashion.training_dataset.get_label(index)) << '\n';
     mnist_fashion.display_training(index);
     std::cout << '\n';
   }
@@ -27,7 +27,7 @@ int main () {
 
   for (int i = 0; i < 5; ++i) {
     int index = fmc::random::random(0, testing_size - 1);
-    std::cout << "Label: " << mnist_fashion.get_named_label(mnist_fashion.testing_labels[index]) << '\n';
+    std::cout << "Label: " << mnist_fashion.get_named_label(mnist_fashion.testing_dataset.get_label(index)) << '\n';
     mnist_fashion.display_testing(index);
     std::cout << '\n';
   }
@@ -0,0 +1,867 @@
+#define FMC_TRACK_ALLOCATIONS
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numbers>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "testing.hpp"
+#include "augment.hpp"
+#include "batching_server.hpp"
+#include "conv.hpp"
+#include "csv.hpp"
+#include "data_loader.hpp"
+#include "idx.hpp"
+#include "initializer.hpp"
+#include "matrix.hpp"
+#include "mnist.hpp"
+#include "nn.hpp"
+#include "protocol.hpp"
+#include "shard_stream.hpp"
+#include "shuffle.hpp"
+#include "static_network.hpp"
+#include "telemetry.hpp"
+#include "utils.hpp"
+
+int main () {
+  const int sample_count = 64;
+
+  fmc::network <double> model (0.05, fmc::error::square_error, fmc::error::square_error_derivative);
+  
+  model
+    .add(fmc::layer <double> (16, fmc::activation::sigmoid, fmc::activation::sigmoid_derivative))
+    .add(fmc::layer <double> (8,  fmc::activation::relu,    fmc::activation::relu_derivative))
+    .add(fmc::layer <double> (4,  fmc::activation::sigmoid, fmc::activation::sigmoid_derivative))
+    .compile();
+
+  std::vector <fmc::matrix <double>> data (sample_count, fmc::matrix <double> (1, 16));
+  for (auto& sample : data)
+    sample([] ([[maybe_unused]] const double& _) { return fmc::random::random <double> (0, 1); });
+
+  std::vector <int> expected (sample_count);
+  for (int i = 0; i < sample_count; ++i)
+    expected[i] = model.predict(data[i]);
+
+  const fmc::inference_model <double> frozen = model.freeze();
+  auto scratch = frozen.make_scratch();
+
+  bool same = true;
+  for (int i = 0; i < sample_count; ++i)
+    same = same and frozen.predict(data[i], scratch) == expected[i];
+  TEST("frozen model predicts like the network", same);
+
+  std::vector <std::vector <int>> results (4, std::vector <int> (sample_count));
+  std::vector <std::thread> threads;
+  for (int t = 0; t < 4; ++t)
+    threads.emplace_back([&, t] () {
+      for (int i = 0; i < sample_count; ++i)
+        results[t][i] = frozen.predict(data[i]);
+    });
+  for (auto& thread : threads)
+    thread.join();
+
+  same = true;
+  for (const auto& result : results)
+    same = same and result == expected;
+  TEST("frozen model shared between threads", same);
+
+  std::vector <int> batch_labels (sample_count);
+  frozen.predict_batch(data, batch_labels, scratch);
+  TEST("batched prediction matches single prediction", batch_labels == expected);
+
+  fmc::inference_model <double>::scratch unsized;
+  std::fill(batch_labels.begin(), batch_labels.end(), -1);
+  frozen.predict_batch(data, batch_labels, unsized);
+  TEST("a default scratch grows to fit the model", batch_labels == expected);
+
+  std::vector <double> probabilities (sample_count * frozen.get_output_size());
+  frozen.predict_proba_batch(data, probabilities);
+  auto last_output = frozen.predict_proba(data.back()[0], scratch);
+  TEST("batched probabilities match single probabilities",
+       std::equal(last_output.begin(), last_output.end(), probabilities.end() - frozen.get_output_size()));
+
+  fmc::evaluation_result result = model.evaluate(data, expected, 3);
+  TEST("evaluation of the network against its own predictions", result.correct_count == sample_count);
+
+  std::ostringstream summary;
+  summary << std::setprecision(4) << result << ' ' << 0.125;
+  TEST("evaluation summaries leave the format of the stream as it was", summary.str().ends_with(" 0.125"));
+
+  std::vector <int> out_of_range = expected;
+  out_of_range.back() = frozen.get_output_size();
+  std::string label_error;
+  try {
+    frozen.evaluate(data, out_of_range);
+  }
+  catch (const std::runtime_error& error) {
+    label_error = error.what();
+  }
+  TEST("evaluation rejects labels the model cannot output", label_error == "label 4 is not one of the 4 outputs of the model");
+
+  {
+    fmc::batching_server <double> server (frozen, {.max_batch = 8, .max_wait_us = 1000, .worker_count = 2});
+    std::vector <std::vector <int>> served (4, std::vector <int> (sample_count));
+
+    threads.clear();
+    for (int t = 0; t < 4; ++t)
+      threads.emplace_back([&, t] () {
+        std::vector <std::future <fmc::prediction <double>>> futures;
+        for (int i = 0; i < sample_count; ++i)
+          futures.push_back(server.submit(data[i]));
+        for (int i = 0; i < sample_count; ++i)
+          served[t][i] = futures[i].get().label;
+      });
+    for (auto& thread : threads)
+      thread.join();
+
+    same = true;
+    for (const auto& labels : served)
+      same = same and labels == expected;
+    TEST("batching server answers every request", same);
+
+    fmc::batching_metrics metrics = server.metrics();
+    TEST("batching server respects max_batch", metrics.completed == 4 * sample_count and metrics.batch_sizes.size() == 9);
+
+    server.stop();
+    TEST("a stopped batching server reports an empty queue", server.metrics().queue_depth == 0);
+  }
+
+  {
+    std::vector <std::uint8_t> pixels (3 * fmc::protocol::image_size, 7);
+    std::vector <std::uint8_t> frame;
+    fmc::protocol::encode_request(frame, pixels);
+
+    std::span <const std::uint8_t> decoded = fmc::protocol::decode_request(frame);
+    TEST("protocol requests decode to their pixels", std::equal(decoded.begin(), decoded.end(), pixels.begin(), pixels.end()));
+
+    std::vector <std::uint8_t> empty;
+    fmc::protocol::put_u32(empty, 4);
+    fmc::protocol::put_u32(empty, 0);
+
+    std::vector <std::uint8_t> oversized;
+    fmc::protocol::put_u32(oversized, 4 + (fmc::protocol::max_count + 1) * fmc::protocol::image_size);
+    fmc::protocol::put_u32(oversized, fmc::protocol::max_count + 1);
+    oversized.resize(fmc::protocol::frame_size(oversized));
+
+    std::vector <std::uint8_t> truncated (frame.begin(), frame.end() - 1);
+
+    TEST("protocol rejects requests for no images", fmc::protocol::decode_request(empty).empty());
+    TEST("protocol rejects requests for more than max_count images", fmc::protocol::decode_request(oversized).empty());
+    TEST("protocol rejects requests whose size does not match their count", fmc::protocol::decode_request(truncated).empty());
+
+    std::vector <std::uint8_t> reply;
+    fmc::protocol::encode_response(reply, std::span <const double> (probabilities), frozen.get_output_size());
+    TEST("protocol frames report their own size", fmc::protocol::frame_size(reply) == reply.size());
+
+    fmc::protocol::response response = fmc::protocol::decode_response(reply);
+    bool round_trip = response.status == fmc::protocol::status_code::ok and response.labels == expected
+                      and response.classes == (std::uint32_t)frozen.get_output_size() and response.probabilities.size() == probabilities.size();
+    for (std::size_t i = 0; round_trip and i < probabilities.size(); ++i)
+      round_trip = response.probabilities[i] == (float)probabilities[i];
+    TEST("protocol responses round-trip", round_trip);
+
+    reply.clear();
+    fmc::protocol::encode_error(reply, fmc::protocol::status_code::bad_request);
+    response = fmc::protocol::decode_response(reply);
+    TEST("protocol errors decode with their status and no labels",
+         response.status == fmc::protocol::status_code::bad_request and response.labels.empty());
+  }
+
+  fmc::network <double> classifier (0.5, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+
+  classifier
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (4,  fmc::activation::kind::softmax))
+    .compile();
+
+  classifier.forward_propagate(data[0]);
+  classifier.calculate_loss(expected[0]);
+  double initial_cost = classifier.cost;
+
+  classifier.fit(data, expected, {.epochs = 300, .batch_size = 8});
+  classifier.forward_propagate(data[0]);
+  classifier.calculate_loss(expected[0]);
+  TEST("mini-batch training lowers the cross-entropy", classifier.cost < initial_cost);
+
+  result = classifier.evaluate(data, expected);
+  TEST("softmax classifier fits its training data", result.correct_count >= sample_count * 9 / 10);
+
+  auto softmax_output = classifier.freeze().predict_proba(data[0][0], scratch);
+  double total = 0;
+  for (double p : softmax_output)
+    total += p;
+  TEST("softmax outputs sum to one", std::abs(total - 1) < 1e-9);
+
+  fmc::network <double> approximate_classifier = classifier;
+  for (auto& layer : approximate_classifier.layers)
+    layer.activation_precision = fmc::approximate::precision::high;
+
+  auto exact_output = classifier.freeze().predict_proba(data[1][0], scratch);
+  std::vector <double> exact_probabilities (exact_output.begin(), exact_output.end());
+  auto approximate_output = approximate_classifier.freeze().predict_proba(data[1][0], scratch);
+  bool close = true;
+  for (int i = 0; i < 4; ++i)
+    close = close and std::abs(approximate_output[i] - exact_probabilities[i]) < 1e-12;
+  TEST("polynomial exp matches std::exp", close);
+
+  // a relative error of n epsilons is within n ulp
+  auto high_exp_error = [] <typename T> (T) {
+    double worst = 0;
+    fmc::approximate::with_exp <T> (fmc::approximate::precision::high, [&] (auto exp) {
+      for (int i = -30000; i <= 30000; ++i) {
+        const T x = (T)(i / 1000.0);
+        const long double exact = std::exp((long double)x);
+        worst = std::max(worst, (double)(std::abs(exp(x) - exact) / exact / std::numeric_limits <T>::epsilon()));
+      }
+    });
+    return worst;
+  };
+  TEST("high precision exp is within a few ulp", high_exp_error((float)0) < 3 and high_exp_error((double)0) < 1.5);
+
+  fmc::matrix <double> all_data (sample_count, 16);
+  for (int i = 0; i < sample_count; ++i)
+    std::copy(data[i].data(), data[i].data() + 16, all_data[i].begin());
+
+  auto dataset_cost = [&] (fmc::network <double>& network) {
+    network.forward_propagate(all_data);
+    network.calculate_loss(std::span <const int> (expected));
+    return network.cost;
+  };
+
+  fmc::network <double> sgd_classifier (0.05, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+
+  sgd_classifier
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (4,  fmc::activation::kind::softmax))
+    .compile();
+
+  fmc::network <double> adam_classifier = sgd_classifier;
+  adam_classifier.set_optimizer(fmc::optimizer <double>::adam(0.01));
+
+  sgd_classifier.fit(data, expected, {.epochs = 20, .batch_size = 8});
+  adam_classifier.fit(data, expected, {.epochs = 20, .batch_size = 8});
+  TEST("adam converges faster than sgd from the same weights", dataset_cost(adam_classifier) < dataset_cost(sgd_classifier));
+
+  using static_classifier = fmc::static_network <double, fmc::activation::kind::sigmoid, fmc::activation::kind::softmax, 16, 16, 4>;
+  static_classifier fixed (0.5, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+  const std::string model_path = (std::filesystem::temp_directory_path() / "fmc-nn-test.model").string();
+
+  fixed.compile().fit(data, expected, {.epochs = 300, .batch_size = 8}).save(model_path);
+  TEST("static network fits its training data", fixed.evaluate(data, expected).correct_count >= sample_count * 9 / 10);
+
+  fmc::network <double> loaded (0, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+  loaded
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (4,  fmc::activation::kind::softmax))
+    .compile()
+    .load(model_path);
+  std::filesystem::remove(model_path);
+
+  same = true;
+  for (int i = 0; i < sample_count; ++i)
+    same = same and loaded.predict(data[i]) == fixed.predict(data[i]);
+  TEST("static network model files load into a network", same);
+
+  fixed.compile(false);
+  same = true;
+  for (int i = 0; i < sample_count; ++i)
+    same = same and fixed.predict(data[i]) == loaded.predict(data[i]);
+  TEST("compiling without initialization keeps the weights", same);
+
+  fmc::matrix <double> orthogonal (32, 8);
+  fmc::matrix <double> orthogonal_bias (1, 8);
+  fmc::initializer::initialize(fmc::initializer::kind::orthogonal, orthogonal.data(), orthogonal_bias.data(), 32, 8);
+
+  fmc::matrix <double> gram = orthogonal.transpose() * orthogonal;
+  bool orthonormal = true;
+  for (int i = 0; i < 8; ++i)
+    for (int j = 0; j < 8; ++j)
+      orthonormal = orthonormal and std::abs(gram[i][j] - (i == j ? 1 : 0)) < 1e-9;
+  TEST("orthogonal initializer gives orthonormal columns", orthonormal);
+
+  const fmc::conv2d_shape strided {.channels = 2, .height = 5, .width = 4, .filters = 1, .kernel_size = 3, .stride = 2, .padding = 1};
+  std::vector <double> image (2 * strided.input_size()), unrolled (2 * strided.positions() * strided.patch_size());
+  std::vector <double> image_gradient (image.size(), 0), unrolled_gradient (unrolled.size());
+  fmc::random::fill_uniform(std::span <double> (image), -1.0, 1.0);
+  fmc::random::fill_uniform(std::span <double> (unrolled_gradient), -1.0, 1.0);
+  fmc::conv::im2col(image.data(), unrolled.data(), 2, strided);
+  fmc::conv::col2im(unrolled_gradient.data(), image_gradient.data(), 2, strided);
+
+  double forward_dot = 0, backward_dot = 0;
+  for (std::size_t i = 0; i < unrolled.size(); ++i)
+    forward_dot += unrolled[i] * unrolled_gradient[i];
+  for (std::size_t i = 0; i < image.size(); ++i)
+    backward_dot += image[i] * image_gradient[i];
+  TEST("col2im is the adjoint of im2col", std::abs(forward_dot - backward_dot) < 1e-9);
+
+  const fmc::conv2d_shape oversized_kernel {.height = 3, .width = 3, .kernel_size = 4, .stride = 2};
+  const fmc::pool2d_shape oversized_window {.height = 1, .width = 4, .window_size = 2, .stride = 2};
+  TEST("kernels and windows larger than their input are rejected",
+       not oversized_kernel.valid() and oversized_kernel.output_height() == 0
+       and not oversized_window.valid() and oversized_window.output_height() == 0);
+
+  fmc::network <double> convolutional (0.05, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+  convolutional
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> ({.channels = 1, .height = 4, .width = 4, .filters = 4, .kernel_size = 3, .padding = 1},
+                              fmc::activation::kind::relu))
+    .add(fmc::layer <double> ({.channels = 4, .height = 4, .width = 4, .filters = 8, .kernel_size = 2, .stride = 2},
+                              fmc::activation::kind::relu))
+    .add(fmc::layer <double> (4, fmc::activation::kind::softmax))
+    .compile()
+    .set_optimizer(fmc::optimizer <double>::adam(0.01))
+    .fit(data, expected, {.epochs = 200, .batch_size = 8});
+  TEST("convolutional classifier fits its training data",
+       convolutional.evaluate(data, expected).correct_count >= sample_count * 9 / 10);
+
+  const fmc::inference_model <double> frozen_convolutional = convolutional.freeze();
+  same = true;
+  for (int i = 0; i < sample_count; ++i)
+    same = same and frozen_convolutional.predict(data[i]) == convolutional.predict(data[i]);
+  TEST("frozen convolutional model predicts like the network", same);
+
+  fmc::matrix <double> picture (1, 28 * 28);
+  fmc::random::fill_uniform(std::span <double> (picture.data(), 28 * 28), 0.0, 1.0);
+  const fmc::pool2d_shape halve {.channels = 1, .height = 28, .width = 28};
+  std::vector <double> pooled (halve.output_size());
+  std::vector <std::uint8_t> winners (halve.output_size());
+  fmc::pool::max_forward(picture.data(), pooled.data(), winners.data(), 1, halve);
+
+  bool maxima = pooled.size() == 14 * 14;
+  for (int y = 0; y < 14; ++y)
+    for (int x = 0; x < 14; ++x) {
+      double best = std::max({picture[0][56 * y + 2 * x], picture[0][56 * y + 2 * x + 1],
+                              picture[0][56 * y + 28 + 2 * x], picture[0][56 * y + 28 + 2 * x + 1]});
+      int winner = winners[14 * y + x];
+      maxima = maxima and pooled[14 * y + x] == best
+                      and picture[0][(2 * y + winner / 2) * 28 + 2 * x + winner % 2] == best;
+    }
+  TEST("max pooling of a 28x28 image keeps the maximum of every window", maxima);
+
+  // the label of every sample is the 2x2 quadrant of its 4x4 image that is brighter than the rest
+  std::vector <fmc::matrix <double>> quadrants (sample_count, fmc::matrix <double> (1, 16));
+  std::vector <int> quadrant_labels (sample_count);
+  for (int i = 0; i < sample_count; ++i) {
+    quadrant_labels[i] = i % 4;
+    for (int j = 0; j < 16; ++j)
+      quadrants[i][0][j] = fmc::random::random <double> (0, 0.5) + ((j / 8) * 2 + (j % 4) / 2 == i % 4 ? 0.5 : 0);
+  }
+
+  fmc::network <double> pooling (0.05, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+  pooling
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> ({.channels = 1, .height = 4, .width = 4, .filters = 8, .kernel_size = 3, .padding = 1},
+                              fmc::activation::kind::relu))
+    .add(fmc::layer <double> (fmc::layer_type::maxpool2d, {.channels = 8, .height = 4, .width = 4}))
+    .add(fmc::layer <double> (fmc::layer_type::avgpool2d, {.channels = 8, .height = 2, .width = 2}))
+    .add(fmc::layer <double> (4, fmc::activation::kind::softmax))
+    .compile()
+    .set_optimizer(fmc::optimizer <double>::adam(0.01))
+    .fit(quadrants, quadrant_labels, {.epochs = 200, .batch_size = 8});
+
+  const fmc::inference_model <double> frozen_pooling = pooling.freeze();
+  same = true;
+  for (int i = 0; i < sample_count; ++i)
+    same = same and frozen_pooling.predict(data[i]) == pooling.predict(data[i]);
+  TEST("pooling classifier fits and freezes", same and pooling.evaluate(quadrants, quadrant_labels).correct_count >= sample_count * 9 / 10);
+
+  fmc::network <double> normalized (0.5, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+  normalized
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (16, fmc::activation::kind::identity))
+    .add(fmc::layer <double> (fmc::layer_type::batchnorm, 16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (4,  fmc::activation::kind::softmax))
+    .compile()
+    .fit(quadrants, quadrant_labels, {.epochs = 300, .batch_size = 8});
+
+  const fmc::inference_model <double> folded = normalized.freeze();
+  close = folded.get_stage_count() == 2;
+  for (int i = 0; i < sample_count; ++i) {
+    normalized.predict(data[i]);
+    auto output = folded.predict_proba(data[i][0], scratch);
+    for (int j = 0; j < 4; ++j)
+      close = close and std::abs(output[j] - normalized.layers.back().get_activation()[0][j]) < 1e-9;
+  }
+  TEST("batch normalization folds into the dense layer before it", close);
+  TEST("batch normalized classifier fits its training data", folded.evaluate(quadrants, quadrant_labels).correct_count >= sample_count * 9 / 10);
+
+  folded.save(model_path);
+  fmc::network <double> unfolded (0, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+  unfolded
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+    .add(fmc::layer <double> (4,  fmc::activation::kind::softmax))
+    .compile()
+    .load(model_path);
+  std::filesystem::remove(model_path);
+
+  same = true;
+  for (int i = 0; i < sample_count; ++i)
+    same = same and unfolded.predict(data[i]) == folded.predict(data[i]);
+  TEST("folded model files load into a network without batch normalization", same);
+
+  auto same_probabilities = [&] (const fmc::inference_model <double>& a, const fmc::inference_model <double>& b) {
+    std::vector <double> first (sample_count * a.get_output_size()), second (sample_count * b.get_output_size());
+    a.predict_proba_batch(data, first);
+    b.predict_proba_batch(data, second);
+    return first == second;
+  };
+
+  // 8 steps per epoch: the last checkpoint is taken after step 15, one batch before the end.
+  // The resumed network starts from other random weights, so only the checkpoint can make it match.
+  const std::string checkpoint_path = (std::filesystem::temp_directory_path() / "fmc-nn-test.checkpoint").string();
+  auto normalized_classifier = [] () {
+    fmc::network <double> network (0.5, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+    network
+      .add(fmc::layer <double> (16, fmc::activation::kind::sigmoid))
+      .add(fmc::layer <double> (16, fmc::activation::kind::identity))
+      .add(fmc::layer <double> (fmc::layer_type::batchnorm, 16, fmc::activation::kind::sigmoid))
+      .add(fmc::layer <double> (4,  fmc::activation::kind::softmax))
+      .compile()
+      .set_optimizer(fmc::optimizer <double>::adam(0.01));
+    return network;
+  };
+
+  fmc::network <double> interrupted = normalized_classifier();
+  fmc::network <double> resumed = normalized_classifier();
+  interrupted.fit(data, expected, {.epochs = 2, .batch_size = 8, .checkpoint_path = checkpoint_path, .checkpoint_steps = 5});
+
+  const std::mt19937 generator = fmc::random::generator;
+  fmc::random::generator.discard(100);
+  resumed.fit(data, expected, {.epochs = 2, .batch_size = 8, .resume_from = checkpoint_path});
+  TEST("resumed training matches uninterrupted training",
+       same_probabilities(resumed.freeze(), interrupted.freeze()) and resumed.update_rule.step_count == 16);
+  TEST("resuming restores the random generator", fmc::random::generator == generator);
+
+  static_classifier static_interrupted (0.5, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+  static_interrupted.compile().set_optimizer(fmc::optimizer <double>::momentum_sgd(0.1));
+
+  static_classifier static_resumed (0.5, fmc::error::cross_entropy, fmc::error::cross_entropy_derivative);
+  static_resumed.compile().set_optimizer(fmc::optimizer <double>::momentum_sgd(0.1));
+  static_interrupted.fit(data, expected, {.epochs = 2, .batch_size = 8, .checkpoint_path = checkpoint_path, .checkpoint_steps = 3});
+  static_resumed.fit(data, expected, {.epochs = 2, .batch_size = 8, .resume_from = checkpoint_path});
+  TEST("resumed static network training matches uninterrupted training",
+       same_probabilities(static_resumed.freeze(), static_interrupted.freeze()));
+
+  // the shuffle seed is drawn from the generator, so only the checkpoint can give both runs the same order
+  fmc::network <double> shuffled = normalized_classifier();
+  fmc::network <double> shuffled_resumed = normalized_classifier();
+  shuffled.fit(data, expected, {.epochs = 2, .batch_size = 8, .checkpoint_path = checkpoint_path, .checkpoint_steps = 5,
+                                .shuffle = fmc::shuffle::samples});
+  shuffled_resumed.fit(data, expected, {.epochs = 2, .batch_size = 8, .resume_from = checkpoint_path,
+                                        .shuffle = fmc::shuffle::samples});
+  std::filesystem::remove(checkpoint_path);
+  TEST("resumed shuffled training matches uninterrupted training",
+       same_probabilities(shuffled_resumed.freeze(), shuffled.freeze()));
+
+  // validation labels the classifier is trained away from, so validation accuracy stops improving
+  std::vector <int> shifted (sample_count);
+  for (int i = 0; i < sample_count; ++i)
+    shifted[i] = (expected[i] + 1) % 4;
+
+  fmc::network <double> stopping = normalized_classifier();
+  stopping.fit(data, expected, data, shifted, {.epochs = 100, .batch_size = 8, .patience = 3});
+  TEST("early stopping ends training and keeps the weights of an epoch",
+       stopping.update_rule.step_count < 100 * 8 and stopping.update_rule.step_count % 8 == 0);
+
+  // 16 steps reported every 4; the file gets the same lines as the callback
+  const std::string telemetry_path = (std::filesystem::temp_directory_path() / "fmc-nn-test.jsonl").string();
+  std::vector <fmc::training_metrics> reports;
+  std::filesystem::remove(telemetry_path);
+
+  fmc::network <double> measured = normalized_classifier();
+  measured.fit(data, expected, {
+    .epochs = 2,
+    .batch_size = 8,
+    .telemetry_path = telemetry_path,
+    .telemetry_steps = 4,
+    .telemetry_callback = [&] (const fmc::training_metrics& metrics) { reports.push_back(metrics); }
+  });
+
+  std::ifstream telemetry_file (telemetry_path);
+  std::vector <std::string> lines;
+  for (std::string line; std::getline(telemetry_file, line); )
+    lines.push_back(line);
+  telemetry_file.close();
+  std::filesystem::remove(telemetry_path);
+
+  same = reports.size() == 4 and lines.size() == 4;
+  for (const auto& metrics : reports)
+    same = same and metrics.gflops > 0 and metrics.loss > 0 and metrics.forward_seconds.size() == 4
+                and metrics.backward_seconds[1] > 0 and metrics.allocations >= 0;
+  TEST("telemetry reports every few steps as JSON lines", same and reports.back().step == 16 and reports.back().samples == 128
+       and reports.back().epoch == 2 and lines.front().front() == '{' and lines.back().back() == '}');
+  TEST("training allocates nothing once the buffers are sized",
+       std::all_of(reports.begin() + 1, reports.end(), [] (const auto& metrics) { return metrics.allocations == 0; }));
+
+  auto write_idx = [] (const std::string& path, const std::vector <std::uint32_t>& dimensions,
+                       const std::vector <std::uint8_t>& values) {
+    std::ofstream file (path, std::ios::binary);
+    const char magic[4] = {0, 0, 0x08, (char)dimensions.size()};
+    file.write(magic, 4);
+    for (std::uint32_t dimension : dimensions) {
+      const char big_endian[4] = {(char)(dimension >> 24), (char)(dimension >> 16), (char)(dimension >> 8), (char)dimension};
+      file.write(big_endian, 4);
+    }
+    file.write((const char*)values.data(), values.size());
+  };
+
+  const std::string images_path = (std::filesystem::temp_directory_path() / "fmc-nn-test-images-idx3-ubyte").string();
+  const std::string labels_path = (std::filesystem::temp_directory_path() / "fmc-nn-test-labels-idx1-ubyte").string();
+  std::vector <std::uint8_t> pixels (3 * 784);
+  for (std::size_t i = 0; i < pixels.size(); ++i)
+    pixels[i] = i * 7 % 256;
+  write_idx(images_path, {3, 28, 28}, pixels);
+  write_idx(labels_path, {3}, {4, 0, 9});
+
+  {
+    const fmc::idx_file images (images_path, 3);
+    TEST("idx images are viewed in place", images.item_count() == 3 and images.get_item_size() == 784
+         and std::equal(images.item(2).begin(), images.item(2).end(), pixels.begin() + 2 * 784));
+  }
+
+  fmc::mnist idx_mnist (2, 1);
+  idx_mnist.load_idx(images_path, labels_path, images_path, labels_path);
+  TEST("mnist loads idx files", idx_mnist.training_dataset.get_labels() == std::vector <int> ({4, 0})
+       and idx_mnist.testing_dataset.get_label(0) == 4 and idx_mnist.training_dataset.sample(1)[5] == pixels[784 + 5]);
+
+  // the header promises one more label than the file holds
+  write_idx(labels_path, {4}, {4, 0, 9});
+  bool rejected = false;
+  try {
+    fmc::idx_file truncated (labels_path, 1);
+  }
+  catch (const std::runtime_error&) {
+    rejected = true;
+  }
+  std::filesystem::remove(images_path);
+  std::filesystem::remove(labels_path);
+  TEST("idx files that do not match their header are rejected", rejected);
+
+  fmc::dataset images (sample_count, 4, 4);
+  for (int i = 0; i < sample_count; ++i) {
+    for (std::uint8_t& pixel : images.sample(i))
+      pixel = fmc::random::random(0, 255);
+    images.set_label(i, expected[i]);
+  }
+  images.set_scale(1.0 / 255);
+
+  std::vector <fmc::matrix <double>> widened;
+  for (int i = 0; i < sample_count; ++i)
+    widened.push_back(images.to_matrix <double> (i));
+  TEST("datasets widen bytes to scaled values", widened[3][0][5] == images.sample(3)[5] * (1.0 / 255));
+
+  fmc::network <double> from_bytes = normalized_classifier();
+  fmc::network <double> from_matrices = from_bytes;
+  from_bytes.fit(images, {.epochs = 2, .batch_size = 8});
+  from_matrices.fit(widened, expected, {.epochs = 2, .batch_size = 8});
+  TEST("training on a dataset matches training on its widened samples",
+       same_probabilities(from_bytes.freeze(), from_matrices.freeze())
+       and from_bytes.evaluate(images).correct_count == from_matrices.evaluate(widened, expected).correct_count);
+
+  const fmc::sample_order sample_shuffle (sample_count, fmc::shuffle::samples, 7);
+  const fmc::sample_order block_shuffle (sample_count - 4, fmc::shuffle::blocks, 7, 8);
+  std::vector <int> epoch_orders[2], replayed, blocks, sorted (sample_count);
+  sample_shuffle.fill(0, epoch_orders[0]);
+  sample_shuffle.fill(1, epoch_orders[1]);
+  sample_shuffle.fill(0, replayed);
+  block_shuffle.fill(0, blocks);
+  std::iota(sorted.begin(), sorted.end(), 0);
+
+  auto is_permutation = [] (std::vector <int> order, std::size_t size) {
+    std::sort(order.begin(), order.end());
+    for (std::size_t i = 0; i < size; ++i)
+      if (order[i] != (int)i)
+        return false;
+    return order.size() == size;
+  };
+  // every block of 8 (and the last one, of 4) lands whole, in positions of its own
+  bool whole_blocks = true;
+  for (std::size_t first = 0; first < blocks.size(); ) {
+    const int block = blocks[first] / 8;
+    const std::size_t length = std::min <std::size_t> (8, blocks.size() - block * 8);
+    for (std::size_t i = first; i < first + length; ++i)
+      whole_blocks = whole_blocks and blocks[i] / 8 == block;
+    first += length;
+  }
+  TEST("sample orders are seeded permutations of every epoch", is_permutation(epoch_orders[0], sample_count)
+       and epoch_orders[0] == replayed and epoch_orders[0] != epoch_orders[1] and epoch_orders[0] != sorted
+       and is_permutation(blocks, sample_count - 4) and whole_blocks);
+
+  // three producers on a ring of two slots, resuming the first of two epochs at sample 10
+  fmc::data_loader <double> loader (images, sample_shuffle, fmc::augmenter ({}, 0), 12, 0, 2, 10, 1, 3);
+  fmc::data_loader <double>::batch batch;
+  std::vector <int> firsts;
+  bool in_order = true;
+  while (loader.next(batch)) {
+    firsts.push_back(batch.first);
+    for (int r = 0; r < batch.rows; ++r) {
+      const int index = epoch_orders[batch.epoch][batch.first + r];
+      in_order = in_order and batch.labels[r] == expected[index] and batch.values[r * 16 + 5] == widened[index][0][5];
+    }
+  }
+  TEST("data loaders hand out batches in order", in_order
+       and firsts == std::vector <int> ({10, 22, 34, 46, 58, 0, 12, 24, 36, 48, 60}));
+
+  fmc::network <double> synchronous = normalized_classifier();
+  fmc::network <double> prefetched = synchronous;
+  double stall_seconds = 0;
+  synchronous.fit(images, {
+    .epochs = 2,
+    .batch_size = 8,
+    .telemetry_callback = [&] (const fmc::training_metrics& metrics) { stall_seconds = metrics.stall_seconds; },
+    .prefetch = 0
+  });
+  prefetched.fit(images, {.epochs = 2, .batch_size = 8, .prefetch = 3, .loader_threads = 2});
+  TEST("prefetching batches does not change training", same_probabilities(synchronous.freeze(), prefetched.freeze())
+       and stall_seconds > 0);
+
+  fmc::network <double> shuffled_bytes = normalized_classifier();
+  fmc::network <double> shuffled_matrices = shuffled_bytes;
+  fmc::network <double> unshuffled = shuffled_bytes;
+  unshuffled.fit(images, {.epochs = 2, .batch_size = 8});
+  shuffled_bytes.fit(images, {.epochs = 2, .batch_size = 8, .loader_threads = 2, .shuffle = fmc::shuffle::samples,
+                              .data_seed = 11});
+  shuffled_matrices.fit(widened, expected, {.epochs = 2, .batch_size = 8, .shuffle = fmc::shuffle::samples,
+                                            .data_seed = 11});
+  TEST("a shuffle seed gives the same training whatever assembles the batches",
+       same_probabilities(shuffled_bytes.freeze(), shuffled_matrices.freeze())
+       and not same_probabilities(shuffled_bytes.freeze(), unshuffled.freeze()));
+
+  std::vector <std::uint8_t> garment (28 * 28), moved (28 * 28), warped (28 * 28), mirrored (28 * 28), restored (28 * 28);
+  for (std::uint8_t& pixel : garment)
+    pixel = fmc::random::random(1, 255);
+
+  fmc::augment::transform shift_and_flip;
+  shift_and_flip.shift_x = 3;
+  shift_and_flip.shift_y = -2;
+  shift_and_flip.flip = true;
+  fmc::augment::shift_flip(garment.data(), moved.data(), 28, 28, 3, -2, true);
+  fmc::augment::warp(garment.data(), warped.data(), 28, 28, shift_and_flip);
+  fmc::augment::shift_flip(garment.data(), mirrored.data(), 28, 28, 0, 0, true);
+  fmc::augment::shift_flip(mirrored.data(), restored.data(), 28, 28, 0, 0, true);
+
+  bool moved_right = true;
+  for (int y = 0; y < 28; ++y)
+    for (int x = 0; x < 28; ++x)
+      moved_right = moved_right and moved[y * 28 + x] == (x < 3 or y >= 26 ? 0 : garment[(y + 2) * 28 + 27 - (x - 3)]);
+  TEST("shifts and flips move whole pixels, as warps do", moved_right and warped == moved and restored == garment);
+
+  fmc::augment::transform quarter_turn;
+  quarter_turn.angle = std::numbers::pi / 2;
+  fmc::augment::warp(garment.data(), warped.data(), 28, 28, quarter_turn);
+  std::vector <std::uint8_t> cut = garment;
+  fmc::augment::cut(cut.data(), 28, 28, 5, 26, 4);
+
+  bool turned = true, cut_out = true;
+  for (int y = 0; y < 28; ++y)
+    for (int x = 0; x < 28; ++x) {
+      turned = turned and warped[y * 28 + x] == garment[(27 - x) * 28 + y];
+      cut_out = cut_out and cut[y * 28 + x] == (x >= 5 and x < 9 and y >= 26 ? 0 : garment[y * 28 + x]);
+    }
+  TEST("warps rotate around the center and cutout clips to the garment", turned and cut_out);
+
+  const fmc::augmentation every_augmentation {.max_shift = 1, .flip = true, .max_rotation = 15, .max_scale = 0.1, .cutout = 2};
+  fmc::augmenter augment (every_augmentation, 9), other_augment (every_augmentation, 9);
+  std::vector <double> augmented (3 * 16), reordered (2 * 16), next_epoch (3 * 16);
+  const std::vector <int> augmented_indices {3, 5, 7}, reordered_indices {7, 3};
+  augment.widen(images, augmented_indices, 1, augmented.data());
+  other_augment.widen(images, reordered_indices, 1, reordered.data());
+  augment.widen(images, augmented_indices, 2, next_epoch.data());
+  TEST("augmentations are drawn per seed, epoch and sample",
+       std::equal(augmented.begin() + 32, augmented.end(), reordered.begin())
+       and std::equal(augmented.begin(), augmented.begin() + 16, reordered.begin() + 16) and augmented != next_epoch);
+
+  fmc::network <double> augmented_synchronous = normalized_classifier();
+  fmc::network <double> augmented_prefetched = augmented_synchronous;
+  augmented_synchronous.fit(images, {.epochs = 2, .batch_size = 8, .prefetch = 0, .augmentation = every_augmentation,
+                                     .data_seed = 5});
+  augmented_prefetched.fit(images, {.epochs = 2, .batch_size = 8, .loader_threads = 2, .augmentation = every_augmentation,
+                                    .data_seed = 5});
+  TEST("augmented training does not depend on the threads assembling batches",
+       same_probabilities(augmented_synchronous.freeze(), augmented_prefetched.freeze()));
+
+  // 64 samples in shards of 10, read 64 bytes at a time so that records straddle reads
+  const std::string shard_prefix = (std::filesystem::temp_directory_path() / "fmc-nn-test").string();
+  const std::vector <std::string> shard_paths = fmc::shard::write(images, shard_prefix, 10);
+  const fmc::shard_stream streamed (shard_paths, 6, 64);
+  fmc::shard_stream::reader stream_reader (streamed);
+  fmc::dataset streamed_samples (sample_count, 4, 4);
+  std::vector <std::uint64_t> identities (sample_count);
+
+  stream_reader.start(0, fmc::shuffle::none, 0);
+  const bool sequential = stream_reader.read(streamed_samples, identities) == sample_count
+                      and stream_reader.read(streamed_samples, identities) == 0
+                      and streamed_samples.get_labels() == images.get_labels()
+                      and std::equal(images.data(), images.data() + sample_count * 16, streamed_samples.data())
+                      and streamed.get_statistics().bytes == sample_count * 20;
+
+  auto read_shuffled = [&] (int epoch, std::size_t skipped) {
+    std::vector <std::uint64_t> order (sample_count - skipped);
+    stream_reader.start(epoch, fmc::shuffle::samples, 7);
+    stream_reader.skip(skipped);
+    stream_reader.read(streamed_samples, order);
+    return order;
+  };
+  const std::vector <std::uint64_t> shuffled_order = read_shuffled(1, 0);
+  std::vector <std::uint64_t> sorted_order = shuffled_order;
+  std::sort(sorted_order.begin(), sorted_order.end());
+
+  bool streamed_whole = true;
+  for (int r = 0; r < sample_count; ++r)
+    streamed_whole = streamed_whole and sorted_order[r] == (std::uint64_t)r
+                 and streamed_samples.get_label(r) == images.get_label(shuffled_order[r])
+                 and std::equal(streamed_samples.sample(r).begin(), streamed_samples.sample(r).end(),
+                                images.sample(shuffled_order[r]).begin());
+  TEST("shard streams read every sample once per epoch, shuffled through a window", sequential and streamed_whole
+       and shuffled_order != sorted_order and shuffled_order != read_shuffled(2, 0)
+       and std::equal(shuffled_order.begin() + 20, shuffled_order.end(), read_shuffled(1, 20).begin()));
+
+  fmc::network <double> from_dataset = normalized_classifier();
+  fmc::network <double> from_shards = from_dataset;
+  fmc::network <double> from_shuffled_shards = from_dataset;
+  from_dataset.fit(images, {.epochs = 2, .batch_size = 8, .augmentation = every_augmentation, .data_seed = 5});
+  from_shards.fit(streamed, {.epochs = 2, .batch_size = 8, .augmentation = every_augmentation, .data_seed = 5});
+  from_shuffled_shards.fit(streamed, {.epochs = 2, .batch_size = 8, .shuffle = fmc::shuffle::samples, .data_seed = 5});
+  for (const std::string& path : shard_paths)
+    std::filesystem::remove(path);
+  TEST("training on a shard stream matches training on its dataset",
+       same_probabilities(from_dataset.freeze(), from_shards.freeze())
+       and not same_probabilities(from_shards.freeze(), from_shuffled_shards.freeze()));
+
+  const fmc::dataset held_out = images.split(sample_count - 8);
+  TEST("splitting a dataset moves its tail out", images.size() == sample_count - 8 and held_out.size() == 8
+       and held_out.get_label(0) == expected[sample_count - 8] and held_out.get_scale() == images.get_scale()
+       and held_out.to_matrix <double> (7) == widened.back());
+
+  // the header and the carriage returns are those of the Kaggle export
+  const std::string csv_path = (std::filesystem::temp_directory_path() / "fmc-nn-test.csv").string();
+  auto write_csv = [&] (const std::vector <std::string>& extra_rows) {
+    std::ofstream file (csv_path);
+    file << "label";
+    for (int j = 1; j <= 784; ++j)
+      file << ",pixel" << j;
+    file << "\r\n";
+    for (int i = 0; i < 3; ++i) {
+      file << (i * 3 + 1);
+      for (int j = 0; j < 784; ++j)
+        file << ',' << (int)pixels[i * 784 + j];
+      file << "\r\n";
+    }
+    for (const std::string& row : extra_rows)
+      file << row << '\n';
+  };
+
+  write_csv({});
+  const std::vector <std::size_t> every_row {0, 1, 2};
+  bool parsed = true;
+  for (int thread_count : {1, 2, 8}) {
+    fmc::dataset rows (3, 28, 28);
+    const fmc::csv_statistics statistics = fmc::csv::read_rows(csv_path, fmc::csv::index_rows(csv_path, thread_count),
+                                                               every_row, rows, 10, thread_count);
+    parsed = parsed and statistics.rows == 3 and rows.get_labels() == std::vector <int> ({1, 4, 7})
+                    and std::equal(pixels.begin(), pixels.end(), rows.data());
+  }
+  TEST("csv files parse the same on any number of threads", parsed);
+
+  const fmc::csv::row_index row_offsets = fmc::csv::index_rows(csv_path, 2);
+  bool indexed = row_offsets.rows() == 3 and row_offsets.first_line == 2
+             and row_offsets.offsets.back() == std::filesystem::file_size(csv_path);
+  for (std::size_t r = 0; r < 3; ++r) {
+    std::ifstream file (csv_path, std::ios::binary);
+    std::string row;
+    file.seekg(row_offsets.offsets[r]);
+    std::getline(file, row);
+    indexed = indexed and row.starts_with(std::to_string(r * 3 + 1) + ",")
+                      and row_offsets.offsets[r + 1] - row_offsets.offsets[r] == row.size() + 1;
+  }
+
+  fmc::dataset picked_rows (2, 28, 28);
+  const std::vector <std::size_t> picked {2, 0};
+  fmc::csv::read_rows(csv_path, row_offsets, picked, picked_rows, 10, 2);
+  TEST("csv row indexes jump straight to any row", indexed and picked_rows.get_labels() == std::vector <int> ({7, 1})
+       and std::equal(pixels.begin() + 2 * 784, pixels.begin() + 3 * 784, picked_rows.sample(0).begin())
+       and std::equal(pixels.begin(), pixels.begin() + 784, picked_rows.sample(1).begin()));
+
+  write_csv({"2,0,0", "11,0", "3,256"});
+  std::string report;
+  std::string subset_report;
+  auto read_malformed = [&] (const std::vector <std::size_t>& rows, std::string& message) {
+    try {
+      fmc::dataset samples (rows.size(), 28, 28);
+      fmc::csv::read_rows(csv_path, fmc::csv::index_rows(csv_path), rows, samples, 10, 2);
+    }
+    catch (const std::runtime_error& error) {
+      message = error.what();
+    }
+  };
+  read_malformed({0, 1, 2, 3, 4, 5}, report);
+  read_malformed({4, 1}, subset_report);
+  TEST("malformed csv rows are reported with their line numbers", report.find("3 malformed rows") != std::string::npos
+       and report.find("line 5: expected 785 fields, found 3") != std::string::npos
+       and report.find("line 6: label 11") != std::string::npos and report.find("line 7: field 2") != std::string::npos
+       and subset_report.find("1 malformed rows\n  line 6: label 11") != std::string::npos);
+
+  // a cache whose pixels are overwritten shows whether a load read it or parsed the csv
+  write_csv({});
+  const std::string cache_path = csv_path + ".fmcd";
+  std::filesystem::remove(cache_path);
+  fmc::mnist parsed_mnist (3, 3);
+  parsed_mnist.load(csv_path, csv_path);
+
+  std::fstream cache_file (cache_path, std::ios::binary | std::ios::in | std::ios::out);
+  cache_file.seekp(-1, std::ios::end);
+  cache_file.put((char)(pixels[3 * 784 - 1] + 1));
+  cache_file.close();
+
+  fmc::mnist cached_mnist (3, 3);
+  cached_mnist.load(csv_path, csv_path);
+  fmc::mnist rebuilt_mnist (3, 3);
+  rebuilt_mnist.load(csv_path, csv_path, true);
+  const bool reused = cached_mnist.testing_dataset.sample(2)[783] == (std::uint8_t)(pixels[3 * 784 - 1] + 1)
+                  and cached_mnist.training_dataset.get_labels() == parsed_mnist.training_dataset.get_labels();
+  const bool rebuilt = rebuilt_mnist.testing_dataset.sample(2)[783] == pixels[3 * 784 - 1];
+
+  std::string blank_row = "5";
+  for (int j = 0; j < 784; ++j)
+    blank_row += ",0";
+  write_csv({blank_row});
+  fmc::mnist changed_mnist (3, 3);
+  changed_mnist.load(csv_path, csv_path);
+  fmc::mnist testing_mnist (3, 3);
+  testing_mnist.load(fmc::mnist::split::testing, csv_path);
+  const std::vector <std::size_t> subset {3, 1};
+  fmc::mnist subset_mnist (3, 3);
+  subset_mnist.load_rows(fmc::mnist::split::training, csv_path, subset);
+  std::filesystem::remove(csv_path);
+  std::filesystem::remove(cache_path);
+  std::filesystem::remove(csv_path + ".fmci");
+  TEST("parsed csv files are cached until they change", reused
+       and changed_mnist.testing_dataset.sample(2)[783] == pixels[3 * 784 - 1]);
+  TEST("rebuilding the cache parses the csv again", rebuilt);
+  TEST("loading one split leaves the other unallocated", testing_mnist.training_dataset.size() == 0
+       and testing_mnist.testing_dataset.get_labels() == changed_mnist.testing_dataset.get_labels());
+  TEST("any rows of a csv load as a split", subset_mnist.training_size == 2
+       and subset_mnist.training_dataset.get_labels() == std::vector <int> ({5, 4})
+       and std::all_of(subset_mnist.training_dataset.sample(0).begin(), subset_mnist.training_dataset.sample(0).end(),
+                       [] (std::uint8_t pixel) { return pixel == 0; })
+       and std::equal(pixels.begin() + 784, pixels.begin() + 2 * 784, subset_mnist.training_dataset.sample(1).begin()));
+
+  test_stats();
+
+  return 0;
+}